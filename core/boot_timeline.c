@@ -0,0 +1,106 @@
+/* Copyright 2016 IBM Corp.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <skiboot.h>
+#include <boot_timeline.h>
+#include <timebase.h>
+#include <device.h>
+#include <cpu.h>
+#include <lock.h>
+#include <opal.h>
+
+/*
+ * Lives in our own image so it is usable from the very first stage and
+ * stays covered by the firmware reservation once the OS is up.
+ */
+static struct {
+	struct boot_timeline		hdr;
+	struct boot_timeline_entry	entries[BOOT_TIMELINE_MAX_ENTRIES];
+} timeline;
+
+static struct lock timeline_lock = LOCK_UNLOCKED;
+static bool timeline_synced;
+static bool timeline_done;
+
+int boot_timeline_start(const char *name, u8 type)
+{
+	struct boot_timeline_entry *e;
+	u32 idx;
+
+	if (timeline_done)
+		return -1;
+
+	lock(&timeline_lock);
+	idx = be32_to_cpu(timeline.hdr.nr_entries);
+	if (idx >= BOOT_TIMELINE_MAX_ENTRIES) {
+		timeline.hdr.dropped =
+			cpu_to_be32(be32_to_cpu(timeline.hdr.dropped) + 1);
+		unlock(&timeline_lock);
+		return -1;
+	}
+	timeline.hdr.nr_entries = cpu_to_be32(idx + 1);
+	unlock(&timeline_lock);
+
+	e = &timeline.entries[idx];
+	strncpy(e->name, name, BOOT_TIMELINE_NAME_LEN - 1);
+	e->pir = cpu_to_be16(this_cpu()->pir);
+	e->type = type;
+	e->flags = timeline_synced ? 0 : BOOT_TIMELINE_UNSYNCED;
+	e->start = cpu_to_be64(mftb());
+
+	return idx;
+}
+
+void boot_timeline_end(int handle)
+{
+	if (handle < 0)
+		return;
+
+	timeline.entries[handle].end = cpu_to_be64(mftb());
+}
+
+void boot_timeline_tb_synced(void)
+{
+	timeline_synced = true;
+}
+
+void boot_timeline_finish(void)
+{
+	struct boot_timeline *hdr = &timeline.hdr;
+	u32 nr;
+
+	lock(&timeline_lock);
+	timeline_done = true;
+	unlock(&timeline_lock);
+
+	hdr->magic = cpu_to_be32(BOOT_TIMELINE_MAGIC);
+	hdr->version = cpu_to_be16(BOOT_TIMELINE_VERSION);
+	hdr->entry_size = cpu_to_be16(sizeof(struct boot_timeline_entry));
+	hdr->max_entries = cpu_to_be32(BOOT_TIMELINE_MAX_ENTRIES);
+	hdr->tb_hz = cpu_to_be64(tb_hz);
+
+	nr = be32_to_cpu(hdr->nr_entries);
+	prlog(PR_DEBUG, "BOOT: Timeline has %u entries (%u dropped)\n",
+	      nr, be32_to_cpu(hdr->dropped));
+
+	/* On fast reboot we've already been here */
+	if (!opal_node ||
+	    dt_find_property(opal_node, "ibm,opal-boot-timeline"))
+		return;
+
+	dt_add_property_u64s(opal_node, "ibm,opal-boot-timeline",
+			     (u64)&timeline, sizeof(timeline));
+}
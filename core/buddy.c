@@ -0,0 +1,162 @@
+/* Copyright 2016 IBM Corp.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * The map has a byte per min_order block. For the first block of a
+ * free or allocated buddy block it holds the order of that block, with
+ * BUDDY_MAP_FREE set if it is free. Other entries are zero, which never
+ * matches a free head since min_order is at least a list_node.
+ */
+
+#include <buddy.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BUDDY_MAP_FREE		0x80
+
+static inline size_t buddy_index(const struct buddy *b, unsigned long addr)
+{
+	return (addr - b->base) >> b->min_order;
+}
+
+static void buddy_add_free(struct buddy *b, unsigned long addr,
+			   unsigned int order)
+{
+	b->map[buddy_index(b, addr)] = BUDDY_MAP_FREE | order;
+	list_add(&b->free_list[order - b->min_order],
+		 (struct list_node *)addr);
+}
+
+unsigned int buddy_order(size_t size)
+{
+	unsigned int order = 0;
+
+	while ((1ul << order) < size)
+		order++;
+
+	return order;
+}
+
+struct buddy *buddy_create(void *base, unsigned int max_order,
+			   unsigned int min_order)
+{
+	unsigned long addr = (unsigned long)base;
+	struct buddy *b;
+	unsigned int i;
+
+	if (min_order < buddy_order(sizeof(struct list_node)))
+		min_order = buddy_order(sizeof(struct list_node));
+	assert(max_order >= min_order);
+	assert(max_order - min_order < BUDDY_MAX_ORDERS);
+	assert(!(addr & ((1ul << max_order) - 1)));
+
+	b = zalloc(sizeof(*b) + (1ul << (max_order - min_order)));
+	if (!b)
+		return NULL;
+
+	b->base = addr;
+	b->min_order = min_order;
+	b->max_order = max_order;
+	for (i = 0; i < BUDDY_MAX_ORDERS; i++)
+		list_head_init(&b->free_list[i]);
+
+	buddy_add_free(b, addr, max_order);
+	b->free_bytes = 1ul << max_order;
+
+	return b;
+}
+
+void buddy_destroy(struct buddy *b)
+{
+	/* Everything must have been given back */
+	assert(b->free_bytes == 1ul << b->max_order);
+	free(b);
+}
+
+void *buddy_alloc(struct buddy *b, unsigned int order)
+{
+	struct list_node *n = NULL;
+	unsigned long addr;
+	unsigned int o;
+
+	if (order < b->min_order)
+		order = b->min_order;
+	if (order > b->max_order)
+		return NULL;
+
+	/* Smallest free block that fits */
+	for (o = order; o <= b->max_order; o++) {
+		n = (struct list_node *)
+			list_pop_(&b->free_list[o - b->min_order], 0);
+		if (n)
+			break;
+	}
+	if (!n)
+		return NULL;
+	addr = (unsigned long)n;
+
+	/* Split it down, giving back the upper halves */
+	while (o > order) {
+		o--;
+		buddy_add_free(b, addr + (1ul << o), o);
+	}
+
+	b->map[buddy_index(b, addr)] = order;
+	b->free_bytes -= 1ul << order;
+
+	return (void *)addr;
+}
+
+void buddy_free(struct buddy *b, void *ptr)
+{
+	unsigned long addr = (unsigned long)ptr;
+	unsigned long buddy;
+	unsigned int order;
+	size_t idx;
+
+	assert(buddy_contains(b, ptr));
+	idx = buddy_index(b, addr);
+	order = b->map[idx];
+	assert(!(order & BUDDY_MAP_FREE));
+	assert(order >= b->min_order && order <= b->max_order);
+	assert(!((addr - b->base) & ((1ul << order) - 1)));
+
+	b->free_bytes += 1ul << order;
+	b->map[idx] = 0;
+
+	/* Merge with our buddy for as long as it is free too */
+	while (order < b->max_order) {
+		buddy = b->base + ((addr - b->base) ^ (1ul << order));
+		idx = buddy_index(b, buddy);
+		if (b->map[idx] != (BUDDY_MAP_FREE | order))
+			break;
+		list_del((struct list_node *)buddy);
+		b->map[idx] = 0;
+		if (buddy < addr)
+			addr = buddy;
+		order++;
+	}
+
+	buddy_add_free(b, addr, order);
+}
+
+bool buddy_contains(const struct buddy *b, const void *ptr)
+{
+	unsigned long addr = (unsigned long)ptr;
+
+	return addr >= b->base && addr < b->base + (1ul << b->max_order);
+}
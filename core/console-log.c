@@ -26,6 +26,7 @@
 #include "stdio.h"
 #include "console.h"
 #include "timebase.h"
+#include "trace.h"
 
 static int vprlog(int log_level, const char *fmt, va_list ap)
 {
@@ -43,13 +44,26 @@ static int vprlog(int log_level, const char *fmt, va_list ap)
 	if (log_level > (debug_descriptor.console_log_levels >> 4))
 		return 0;
 
+	if (log_level > (debug_descriptor.console_log_levels & 0x0f)) {
+		flush_to_drivers = false;
+
+		/* Memory only messages can be left for the reader to format */
+		if (debug_descriptor.trace_mask & (1ul << TRACE_PRLOG)) {
+			va_list aq;
+			bool done;
+
+			va_copy(aq, ap);
+			done = trace_prlog(log_level, fmt, aq);
+			va_end(aq);
+			if (done)
+				return 0;
+		}
+	}
+
 	count = snprintf(buffer, sizeof(buffer), "[%lu,%d] ",
 			 mftb(), log_level);
 	count+= vsnprintf(buffer+count, sizeof(buffer)-count, fmt, ap);
 
-	if (log_level > (debug_descriptor.console_log_levels & 0x0f))
-		flush_to_drivers = false;
-
 	console_write(flush_to_drivers, buffer, count);
 
 	return count;
@@ -26,6 +26,7 @@
 #include <device.h>
 #include <processor.h>
 #include <cpu.h>
+#include <timebase.h>
 
 static char *con_buf = (char *)INMEM_CON_START;
 static size_t con_in;
@@ -35,6 +36,41 @@ static struct con_ops *con_driver;
 
 struct lock con_lock = LOCK_UNLOCKED;
 
+/*
+ * Messages that only go to the in memory console are first copied to
+ * a staging ring owned by the logging CPU, without taking con_lock.
+ * Whoever next holds con_lock drains all the rings into con_buf,
+ * merged in timebase order, so memcons looks just as it always did.
+ *
+ * Each ring has a single producer (its CPU) and a single consumer
+ * (the con_lock holder). Entries are a header followed by the text,
+ * padded to CON_STAGE_ALIGN so a header never wraps.
+ */
+#define CON_STAGE_SZ		4096
+#define CON_STAGE_ALIGN		16
+
+struct con_stage_hdr {
+	uint64_t	tb;
+	uint32_t	len;
+	uint32_t	unused;
+};
+
+struct con_stage {
+	/* Written by the owning CPU */
+	uint64_t	head;
+	/* Written by the drainer, keep it in its own cache line */
+	uint64_t	tail __attribute__((aligned(128)));
+	/* Head as seen by the current drain */
+	uint64_t	drain_head;
+	char		buf[CON_STAGE_SZ] __attribute__((aligned(128)));
+};
+
+static struct con_stage **con_stages;
+static unsigned int con_nr_stages;
+static bool con_staged;
+
+static void con_stage_drain(void);
+
 /* This is mapped via TCEs so we keep it alone in a page */
 struct memcons memcons __section(".data.memcons") = {
 	.magic		= MEMCONS_MAGIC,
@@ -189,6 +225,7 @@ bool flush_console(void)
 	bool ret;
 
 	lock(&con_lock);
+	con_stage_drain();
 	ret = __flush_console(true);
 	unlock(&con_lock);
 
@@ -248,13 +285,189 @@ static void write_char(char c)
 	inmem_write(c);
 }
 
+static bool con_stage_write(const char *buf, size_t count)
+{
+	struct cpu_thread *cpu = this_cpu();
+	struct con_stage *st = cpu->con_stage;
+	struct con_stage_hdr *hdr;
+	size_t need, pos, first;
+
+	/* Not allocated yet, or we interrupted ourselves */
+	if (!st || cpu->con_staging || bust_locks)
+		return false;
+
+	need = ALIGN_UP(sizeof(*hdr) + count, CON_STAGE_ALIGN);
+	if (need > CON_STAGE_SZ - (st->head - st->tail))
+		return false;
+	cpu->con_staging = true;
+
+	pos = st->head % CON_STAGE_SZ;
+	hdr = (struct con_stage_hdr *)(st->buf + pos);
+	hdr->tb = mftb();
+	hdr->len = count;
+	pos = (pos + sizeof(*hdr)) % CON_STAGE_SZ;
+	first = CON_STAGE_SZ - pos;
+	if (first > count)
+		first = count;
+	memcpy(st->buf + pos, buf, first);
+	memcpy(st->buf, buf + first, count - first);
+
+	lwsync(); /* write barrier: complete the entry before exposing it */
+	st->head += need;
+	cpu->con_staging = false;
+
+	/*
+	 * Pairs with the sync() in con_stage_drain(): either the drainer
+	 * sees our head, or we set the flag after it cleared it.
+	 */
+	sync();
+	con_staged = true;
+
+	return true;
+}
+
+static void con_stage_drain_one(struct con_stage *st)
+{
+	struct con_stage_hdr *hdr;
+	size_t pos, i;
+	char c;
+
+	hdr = (struct con_stage_hdr *)(st->buf + st->tail % CON_STAGE_SZ);
+	pos = st->tail + sizeof(*hdr);
+	for (i = 0; i < hdr->len; i++) {
+		c = st->buf[(pos + i) % CON_STAGE_SZ];
+		if (c == 10)
+			write_char(13);
+		write_char(c);
+	}
+
+	lwsync(); /* Done with the entry before the producer can reuse it */
+	st->tail += ALIGN_UP(sizeof(*hdr) + hdr->len, CON_STAGE_ALIGN);
+}
+
+/* Move everything staged so far into con_buf. Called with con_lock held */
+static void con_stage_drain(void)
+{
+	struct con_stage *st, *first;
+	struct con_stage_hdr *hdr;
+	unsigned int i, n = 0;
+	uint64_t first_tb = 0;
+
+	if (!con_staged)
+		return;
+
+	/*
+	 * Staged text is memory only, so con_out is moved over it once it
+	 * is in con_buf. That's only right if the drivers already have
+	 * everything before it: push that out first, and if they can't
+	 * take it all yet (partial write, or someone else is flushing)
+	 * leave the text staged for a later drain.
+	 */
+	if (con_driver && con_out != con_in)
+		__flush_console(true);
+	if (con_driver && con_out != con_in)
+		return;
+
+	con_staged = false;
+	sync(); /* Clear the flag before looking, so we can't miss one */
+
+	/* Only merge the rings with something in them */
+	for (i = 0; i < con_nr_stages; i++) {
+		st = con_stages[i];
+		st->drain_head = st->head;
+		if (st->drain_head == st->tail)
+			continue;
+		con_stages[i] = con_stages[n];
+		con_stages[n++] = st;
+	}
+	lwsync(); /* read barrier: read heads before the entries */
+
+	while (n) {
+		first = NULL;
+		for (i = 0; i < n; i++) {
+			st = con_stages[i];
+			hdr = (struct con_stage_hdr *)
+				(st->buf + st->tail % CON_STAGE_SZ);
+			if (!first || tb_compare(hdr->tb, first_tb) ==
+			    TB_ABEFOREB) {
+				first = st;
+				first_tb = hdr->tb;
+			}
+		}
+		con_stage_drain_one(first);
+
+		if (first->tail != first->drain_head)
+			continue;
+		for (i = 0; con_stages[i] != first; i++)
+			;
+		con_stages[i] = con_stages[--n];
+		con_stages[n] = first;
+	}
+
+	/* Staged text is memory only, don't hand it to the drivers */
+	if (con_driver)
+		con_out = con_in;
+}
+
+static void con_stage_poll(void *data __unused)
+{
+	if (!con_staged || !try_lock(&con_lock))
+		return;
+	con_stage_drain();
+	unlock(&con_lock);
+}
+
+void init_console_stages(void)
+{
+	struct cpu_thread *cpu;
+	unsigned int n = 0;
+
+	for_each_cpu(cpu)
+		n++;
+	con_stages = zalloc(n * sizeof(*con_stages));
+	if (!con_stages) {
+		prerror("CONSOLE: Failed to allocate staging buffers\n");
+		return;
+	}
+
+	for_each_cpu(cpu) {
+		cpu->con_stage = local_alloc(cpu->chip_id,
+					     sizeof(*cpu->con_stage), 128);
+		if (!cpu->con_stage) {
+			prerror("CONSOLE: cpu 0x%x staging allocation failed\n",
+				cpu->pir);
+			continue;
+		}
+		memset(cpu->con_stage, 0, sizeof(*cpu->con_stage));
+		con_stages[con_nr_stages++] = cpu->con_stage;
+	}
+
+	opal_add_poller(con_stage_poll, NULL);
+}
+
 ssize_t console_write(bool flush_to_drivers, const void *buf, size_t count)
 {
+	bool need_unlock;
+	const char *cbuf = buf;
+
+	/* Memory only messages don't need con_lock until drained */
+	if (!flush_to_drivers && con_stage_write(buf, count)) {
+		/* Drain now if it's getting full and nobody else is at it */
+		if (this_cpu()->con_stage->head - this_cpu()->con_stage->tail >
+		    CON_STAGE_SZ / 2 && try_lock(&con_lock)) {
+			con_stage_drain();
+			unlock(&con_lock);
+		}
+		return count;
+	}
+
 	/* We use recursive locking here as we can get called
 	 * from fairly deep debug path
 	 */
-	bool need_unlock = lock_recursive(&con_lock);
-	const char *cbuf = buf;
+	need_unlock = lock_recursive(&con_lock);
+
+	/* Keep anything staged ahead of this message */
+	con_stage_drain();
 
 	while(count--) {
 		char c = *(cbuf++);
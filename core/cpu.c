@@ -28,6 +28,7 @@
 #include <affinity.h>
 #include <chip.h>
 #include <timebase.h>
+#include <boot_timeline.h>
 #include <ccan/str/str.h>
 #include <ccan/container_of/container_of.h>
 
@@ -111,7 +112,10 @@ struct cpu_job *__cpu_queue_job(struct cpu_thread *cpu,
 		list_add_tail(&cpu->job_queue, &job->link);
 		unlock(&cpu->job_lock);
 	} else {
+		int bt = boot_timeline_start(name, BOOT_TIMELINE_JOB);
+
 		func(data);
+		boot_timeline_end(bt);
 		job->complete = true;
 	}
 
@@ -176,6 +180,7 @@ void cpu_process_jobs(void)
 	lock(&cpu->job_lock);
 	while (true) {
 		bool no_return;
+		int bt;
 
 		if (list_empty(&cpu->job_queue)) {
 			smt_medium();
@@ -197,9 +202,11 @@ void cpu_process_jobs(void)
 		no_return = job->no_return;
 		unlock(&cpu->job_lock);
 		prlog(PR_TRACE, "running job %s on %x\n", job->name, cpu->pir);
+		bt = boot_timeline_start(job->name, BOOT_TIMELINE_JOB);
 		if (no_return)
 			free(job);
 		func(data);
+		boot_timeline_end(bt);
 		lock(&cpu->job_lock);
 		if (!no_return) {
 			lwsync();
@@ -379,6 +386,7 @@ static void init_cpu_thread(struct cpu_thread *t,
 			    unsigned int pir)
 {
 	init_lock(&t->job_lock);
+	init_lock(&t->hmi_lock);
 	list_head_init(&t->job_queue);
 	t->state = state;
 	t->pir = pir;
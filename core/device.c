@@ -55,8 +55,8 @@ static struct dt_node *new_node(const char *name)
 	node->parent = NULL;
 	list_head_init(&node->properties);
 	list_head_init(&node->children);
-	/* FIXME: locking? */
-	node->phandle = ++last_phandle;
+	/* Nodes may be created on several CPUs during init */
+	node->phandle = __sync_add_and_fetch(&last_phandle, 1);
 	return node;
 }
 
@@ -85,6 +85,23 @@ bool dt_attach_root(struct dt_node *parent, struct dt_node *root)
 	return true;
 }
 
+bool dt_move_children(struct dt_node *from, struct dt_node *to)
+{
+	struct dt_node *child, *next;
+	bool ok = true;
+
+	list_for_each_safe(&from->children, child, next, list) {
+		list_del_from(&from->children, &child->list);
+		child->parent = NULL;
+		if (!dt_attach_root(to, child)) {
+			dt_free(child);
+			ok = false;
+		}
+	}
+
+	return ok;
+}
+
 static inline void dt_destroy(struct dt_node *dn)
 {
 	if (!dn)
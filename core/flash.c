@@ -29,6 +29,7 @@ struct flash {
 	bool			registered;
 	bool			busy;
 	struct blocklevel_device *bl;
+	struct ffs_handle	*ffs;
 	uint32_t		size;
 	uint32_t		block_size;
 };
@@ -138,7 +139,13 @@ static int flash_nvram_write(uint32_t dst, void *src, uint32_t len)
 		rc = OPAL_PARAMETER;
 		goto out;
 	}
-	rc = blocklevel_write(nvram_flash->bl, nvram_offset + dst, src, len);
+
+	/*
+	 * Writes arrive as coalesced runs from the nvram write-back, only
+	 * erase the blocks whose contents need it.
+	 */
+	rc = blocklevel_smart_write(nvram_flash->bl, nvram_offset + dst, src,
+				    len);
 
 out:
 	unlock(&flash_lock);
@@ -268,14 +275,17 @@ int flash_register(struct blocklevel_device *bl, bool is_system_flash)
 		ffs = NULL;
 	}
 
+	/*
+	 * Keep the partition table around for later resource loads, libffs
+	 * re-reads it if the host writes over it.
+	 */
+	flash->ffs = ffs;
+
 	node = flash_add_dt_node(flash, i);
 
 	if (is_system_flash)
 		setup_system_flash(flash, node, name, ffs);
 
-	if (ffs)
-		ffs_close(ffs);
-
 	unlock(&flash_lock);
 
 	return OPAL_SUCCESS;
@@ -503,7 +513,6 @@ static int flash_load_resource(enum resource_id id, uint32_t subid,
 			       void *buf, size_t *len)
 {
 	int i, rc, part_num, part_size, part_start, size;
-	struct ffs_handle *ffs;
 	struct flash *flash;
 	const char *name;
 	bool status, ecc;
@@ -541,22 +550,23 @@ static int flash_load_resource(enum resource_id id, uint32_t subid,
 		goto out_unlock;
 	}
 
-	rc = ffs_init(0, flash->size, flash->bl, &ffs, 0);
-	if (rc) {
+	/* No usable partition table at registration, see if there is now */
+	if (!flash->ffs &&
+	    ffs_init(0, flash->size, flash->bl, &flash->ffs, 0)) {
 		prerror("FLASH: Can't open ffs handle\n");
 		goto out_unlock;
 	}
 
-	rc = ffs_lookup_part(ffs, name, &part_num);
+	rc = ffs_lookup_part(flash->ffs, name, &part_num);
 	if (rc) {
 		prerror("FLASH: No %s partition\n", name);
-		goto out_free_ffs;
+		goto out_unlock;
 	}
-	rc = ffs_part_info(ffs, part_num, NULL,
+	rc = ffs_part_info(flash->ffs, part_num, NULL,
 			   &part_start, &part_size, NULL, &ecc);
 	if (rc) {
 		prerror("FLASH: Failed to get %s partition info\n", name);
-		goto out_free_ffs;
+		goto out_unlock;
 	}
 	prlog(PR_DEBUG,"FLASH: %s partition %s ECC\n",
 	      name, ecc  ? "has" : "doesn't have");
@@ -571,7 +581,7 @@ static int flash_load_resource(enum resource_id id, uint32_t subid,
 		rc = flash_find_subpartition(flash->bl, subid, &part_start,
 					     &part_size, &ecc);
 		if (rc)
-			goto out_free_ffs;
+			goto out_unlock;
 	}
 
 	/* Work out what the final size of buffer will be without ECC */
@@ -580,7 +590,7 @@ static int flash_load_resource(enum resource_id id, uint32_t subid,
 		if (ecc_buffer_size_check(part_size)) {
 			prerror("FLASH: %s image invalid size for ECC %d\n",
 				name, part_size);
-			goto out_free_ffs;
+			goto out_unlock;
 		}
 		size = ecc_buffer_size_minus_ecc(part_size);
 	}
@@ -588,20 +598,18 @@ static int flash_load_resource(enum resource_id id, uint32_t subid,
 	if (size > *len) {
 		prerror("FLASH: %s image too large (%d > %zd)\n", name,
 			part_size, *len);
-		goto out_free_ffs;
+		goto out_unlock;
 	}
 
 	rc = flash_read_corrected(flash->bl, part_start, buf, size, ecc);
 	if (rc) {
 		prerror("FLASH: failed to read %s partition\n", name);
-		goto out_free_ffs;
+		goto out_unlock;
 	}
 
 	*len = size;
 	status = true;
 
-out_free_ffs:
-	ffs_close(ffs);
 out_unlock:
 	unlock(&flash_lock);
 	return status ? OPAL_SUCCESS : rc;
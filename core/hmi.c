@@ -24,6 +24,7 @@
 #include <pci.h>
 #include <cpu.h>
 #include <chip.h>
+#include <timebase.h>
 
 /*
  * HMER register layout:
@@ -213,7 +214,15 @@ static const struct nx_xstop_bit_info nx_pbi_xstop_bits[] = {
 	{ 12, NX_CHECKSTOP_PBI_ISN_UE },
 };
 
-static struct lock hmi_lock = LOCK_UNLOCKED;
+/*
+ * TFMR is a per [sub]core register, so the timer facility checks and
+ * recovery only need to be serialized between the threads of a core.
+ * The lock lives in the primary thread.
+ */
+static inline struct lock *hmi_core_lock(void)
+{
+	return &this_cpu()->primary->hmi_lock;
+}
 
 static int queue_hmi_event(struct OpalHMIEvent *hmi_evt, int recover)
 {
@@ -424,12 +433,26 @@ static void find_nx_checkstop_reason(int flat_chip_id,
 
 static int decode_malfunction(struct OpalHMIEvent *hmi_evt)
 {
+	struct proc_chip *chip = get_chip(this_cpu()->chip_id);
 	int i;
 	int recover = -1;
-	uint64_t malf_alert;
+	uint64_t malf_alert = 0;
 	int event_generated = 0;
 
+	/*
+	 * Every thread of the chip takes the malfunction alert. The
+	 * alert register is read under the chip lock, so whoever gets
+	 * the lock first decodes and clears the bits pending at that
+	 * point. A thread that waited for it finds nothing left and
+	 * neither re-scans every core FIR nor queues duplicate events,
+	 * while bits raised after the first read are still decoded.
+	 */
+	lock(&chip->hmi_lock);
 	xscom_read(this_cpu()->chip_id, 0x2020011, &malf_alert);
+	if (!malf_alert) {
+		unlock(&chip->hmi_lock);
+		return -1;
+	}
 
 	for (i = 0; i < 64; i++)
 		if (malf_alert & PPC_BIT(i)) {
@@ -457,6 +480,8 @@ static int decode_malfunction(struct OpalHMIEvent *hmi_evt)
 		}
 	}
 
+	unlock(&chip->hmi_lock);
+
 	return recover;
 }
 
@@ -565,10 +590,10 @@ static void pre_recovery_cleanup(void)
 	 * from here. We would just fall through recovery code which would
 	 * check for other errors on TFMR and fix them.
 	 */
-	lock(&hmi_lock);
+	lock(hmi_core_lock());
 	tfmr = mfspr(SPR_TFMR);
 	if (!(tfmr & (SPR_TFMR_TB_RESIDUE_ERR | SPR_TFMR_HDEC_PARITY_ERROR))) {
-		unlock(&hmi_lock);
+		unlock(hmi_core_lock());
 		return;
 	}
 
@@ -619,7 +644,7 @@ static void pre_recovery_cleanup(void)
 	if (i == split_core_mode)
 		*(this_cpu()->core_hmi_state_ptr) |= HMI_STATE_CLEANUP_DONE;
 
-	unlock(&hmi_lock);
+	unlock(hmi_core_lock());
 
 	/* Wait for other subcore to complete the cleanup. */
 	wait_for_subcore_threads();
@@ -631,10 +656,28 @@ static void hmi_exit(void)
 	*(this_cpu()->core_hmi_state_ptr) &= ~(this_cpu()->thread_mask);
 }
 
+static void hmi_update_stats(uint64_t start)
+{
+	struct cpu_thread *cpu = this_cpu();
+	uint64_t delta = mftb() - start;
+
+	cpu->hmi_count++;
+	cpu->hmi_tb_total += delta;
+	if (delta > cpu->hmi_tb_max)
+		cpu->hmi_tb_max = delta;
+
+	prlog(PR_DEBUG, "HMI: CPU 0x%04x handled in %lu us"
+	      " (avg %lu us, max %lu us over %llu HMIs)\n", cpu->pir,
+	      tb_to_usecs(delta), tb_to_usecs(cpu->hmi_tb_total / cpu->hmi_count),
+	      tb_to_usecs(cpu->hmi_tb_max), cpu->hmi_count);
+}
+
 int handle_hmi_exception(uint64_t hmer, struct OpalHMIEvent *hmi_evt)
 {
 	int recover = 1;
 	uint64_t tfmr;
+	uint64_t start = mftb();
+	bool tb_was_valid = !!(mfspr(SPR_TFMR) & SPR_TFMR_TB_VALID);
 
 	/*
 	 * In case of split core, some of the Timer facility errors need
@@ -642,7 +685,7 @@ int handle_hmi_exception(uint64_t hmer, struct OpalHMIEvent *hmi_evt)
 	 */
 	pre_recovery_cleanup();
 
-	lock(&hmi_lock);
+	lock(hmi_core_lock());
 	/*
 	 * Not all HMIs would move TB into invalid state. Set the TB state
 	 * looking at TFMR register. TFMR will tell us correct state of
@@ -738,7 +781,12 @@ int handle_hmi_exception(uint64_t hmer, struct OpalHMIEvent *hmi_evt)
 	hmi_exit();
 	/* Set the TB state looking at TFMR register before we head out. */
 	this_cpu()->tb_invalid = !(mfspr(SPR_TFMR) & SPR_TFMR_TB_VALID);
-	unlock(&hmi_lock);
+	unlock(hmi_core_lock());
+
+	/* Latency is only meaningful if the TB was good on both ends */
+	if (tb_was_valid && !this_cpu()->tb_invalid)
+		hmi_update_stats(start);
+
 	return recover;
 }
 
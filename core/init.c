@@ -44,6 +44,8 @@
 #include <timer.h>
 #include <ipmi.h>
 #include <sensor.h>
+#include <boot_timeline.h>
+#include <timebase.h>
 
 enum proc_gen proc_gen;
 
@@ -384,7 +386,9 @@ void __noreturn load_and_boot_kernel(bool is_reboot)
 {
 	const struct dt_property *memprop;
 	uint64_t mem_top;
+	bool loaded;
 	void *fdt;
+	int bt;
 
 	memprop = dt_find_property(dt_root, DT_PRIVATE "maxmem");
 	if (memprop)
@@ -396,15 +400,18 @@ void __noreturn load_and_boot_kernel(bool is_reboot)
 	op_display(OP_LOG, OP_MOD_INIT, 0x000A);
 
 	if (platform.exit)
-		platform.exit();
+		boot_stage(platform.exit());
 
 	/* Load kernel LID */
-	if (!load_kernel()) {
+	bt = boot_timeline_start("load_kernel()", BOOT_TIMELINE_STAGE);
+	loaded = load_kernel();
+	boot_timeline_end(bt);
+	if (!loaded) {
 		op_display(OP_FATAL, OP_MOD_INIT, 1);
 		abort();
 	}
 
-	load_initramfs();
+	boot_stage(load_initramfs());
 
 	ipmi_set_fw_progress_sensor(IPMI_FW_OS_BOOT);
 
@@ -412,10 +419,10 @@ void __noreturn load_and_boot_kernel(bool is_reboot)
 		/* We wait for the nvram read to complete here so we can
 		 * grab stuff from there such as the kernel arguments
 		 */
-		fsp_nvram_wait_open();
+		boot_stage(fsp_nvram_wait_open());
 
 		/* Wait for FW VPD data read to complete */
-		fsp_code_update_wait_vpd(true);
+		boot_stage(fsp_code_update_wait_vpd(true));
 	}
 	fsp_console_select_stdout();
 
@@ -423,7 +430,7 @@ void __noreturn load_and_boot_kernel(bool is_reboot)
 	 * OCC takes few secs to boot.  Call this as late as
 	 * as possible to avoid delay.
 	 */
-	occ_pstates_init();
+	boot_stage(occ_pstates_init());
 
 	/* Set kernel command line argument if specified */
 #ifdef KERNEL_COMMAND_LINE
@@ -432,6 +439,9 @@ void __noreturn load_and_boot_kernel(bool is_reboot)
 
 	op_display(OP_LOG, OP_MOD_INIT, 0x000B);
 
+	/* Nothing more worth recording, hand the timeline over */
+	boot_timeline_finish();
+
 	/* Create the device tree blob to boot OS. */
 	fdt = create_dtb(dt_root);
 	if (!fdt) {
@@ -536,6 +546,244 @@ static void setup_branch_null_catcher(void)
 	memcpy(0, bn, 16);
 }
 
+/*
+ * Init stages run once the secondaries are called in and the timebases
+ * are synchronised.
+ *
+ * The table is in a valid order for running the stages one after the
+ * other, which is what happens on the boot CPU. Stages marked any_cpu are
+ * instead handed to a secondary thread as soon as their dependencies are
+ * complete, and run concurrently with the rest. Such a stage must not
+ * touch the device-tree (which isn't locked), nor anything else that the
+ * boot CPU stages might be using without a lock.
+ *
+ * Define INIT_STAGES_SERIAL in config.h to run everything on the boot CPU
+ * in table order.
+ */
+struct init_stage {
+	const char	*name;
+	void		(*func)(void);
+	u32		deps;		/* Bitmask of init_stage_id */
+	bool		any_cpu;
+
+	struct cpu_job	*job;
+	bool		started;
+};
+
+enum init_stage_id {
+	STAGE_I2C,
+	STAGE_SENSORS,
+	STAGE_PLATFORM,
+	STAGE_SLW,
+	STAGE_SLW_TIMER,
+	STAGE_NVRAM,
+	STAGE_PHB3_VPD,
+	STAGE_PHB3_CAPP,
+	STAGE_PRELOAD_KERNEL,
+	STAGE_NX,
+	STAGE_OPAL_MSG,
+	STAGE_HDAT_VPD,
+};
+
+#define STAGE_DEP(id)	(1u << (id))
+
+static void init_platform(void)
+{
+	/*
+	 * We have initialized the basic HW, we can now call into the
+	 * platform to perform subsequent inits, such as establishing
+	 * communication with the FSP or starting IPMI.
+	 */
+	if (platform.init)
+		platform.init();
+
+	/* Setup dummy console nodes if it's enabled */
+	if (dummy_console_enabled())
+		dummy_console_add_nodes();
+}
+
+static void init_preload_capp_ucode(void)
+{
+	phb3_preload_capp_ucode();
+}
+
+static void init_preload_kernel(void)
+{
+	start_preload_kernel();
+}
+
+static struct init_stage init_stages[] = {
+	/* Initialize i2c */
+	[STAGE_I2C] = {
+		.name = "p8_i2c_init",
+		.func = p8_i2c_init,
+	},
+	/* Register routine to dispatch and read sensors */
+	[STAGE_SENSORS] = {
+		.name = "sensor_init",
+		.func = sensor_init,
+	},
+	[STAGE_PLATFORM] = {
+		.name = "platform.init",
+		.func = init_platform,
+		.deps = STAGE_DEP(STAGE_I2C) | STAGE_DEP(STAGE_SENSORS),
+	},
+	/* Init SLW related stuff, including fastsleep, XSCOM only */
+	[STAGE_SLW] = {
+		.name = "slw_init",
+		.func = slw_init,
+		.any_cpu = true,
+	},
+	[STAGE_SLW_TIMER] = {
+		.name = "slw_init_timer",
+		.func = slw_init_timer,
+		.deps = STAGE_DEP(STAGE_SLW),
+	},
+	/* Read in NVRAM and set it up */
+	[STAGE_NVRAM] = {
+		.name = "nvram_init",
+		.func = nvram_init,
+		.deps = STAGE_DEP(STAGE_PLATFORM),
+	},
+	[STAGE_PHB3_VPD] = {
+		.name = "phb3_preload_vpd",
+		.func = phb3_preload_vpd,
+		.deps = STAGE_DEP(STAGE_PLATFORM),
+	},
+	[STAGE_PHB3_CAPP] = {
+		.name = "phb3_preload_capp_ucode",
+		.func = init_preload_capp_ucode,
+		.deps = STAGE_DEP(STAGE_PLATFORM),
+	},
+	[STAGE_PRELOAD_KERNEL] = {
+		.name = "start_preload_kernel",
+		.func = init_preload_kernel,
+		.deps = STAGE_DEP(STAGE_PLATFORM),
+	},
+	/* NX init */
+	[STAGE_NX] = {
+		.name = "nx_init",
+		.func = nx_init,
+	},
+	/* Initialize the opal messaging */
+	[STAGE_OPAL_MSG] = {
+		.name = "opal_init_msg",
+		.func = opal_init_msg,
+	},
+	/* FRU VPD from HDAT, into a detached subtree */
+	[STAGE_HDAT_VPD] = {
+		.name = "parse_hdat_fru_vpd",
+		.func = parse_hdat_fru_vpd,
+		.any_cpu = true,
+	},
+};
+
+static void run_init_stage(struct init_stage *stage)
+{
+	int bt = boot_timeline_start(stage->name, BOOT_TIMELINE_STAGE);
+
+	prlog(PR_DEBUG, "INIT: Running %s on CPU 0x%04x\n", stage->name,
+	      this_cpu()->pir);
+	stage->func();
+	boot_timeline_end(bt);
+}
+
+static void run_init_stage_job(void *data)
+{
+	run_init_stage(data);
+}
+
+/* Any available thread other than ourselves, round robin */
+static struct cpu_thread *next_init_cpu(struct cpu_thread *prev)
+{
+	struct cpu_thread *cpu;
+
+	for (cpu = prev ? next_available_cpu(prev) : NULL; cpu;
+	     cpu = next_available_cpu(cpu))
+		if (cpu != this_cpu())
+			return cpu;
+	for_each_available_cpu(cpu)
+		if (cpu != this_cpu())
+			return cpu;
+	return NULL;
+}
+
+static void run_init_stages(struct init_stage *stages, unsigned int count)
+{
+	struct cpu_thread *cpu = NULL;
+	u32 done = 0, all = (1u << count) - 1;
+	bool serial = false;
+	unsigned int i;
+
+#ifdef INIT_STAGES_SERIAL
+	serial = true;
+#endif
+
+	/* Dependencies can only point backward, see above */
+	for (i = 0; i < count; i++)
+		assert(!(stages[i].deps & ~(STAGE_DEP(i) - 1)));
+
+	while (done != all) {
+		bool progress = false;
+
+		/* Hand out whatever can go to the secondaries */
+		for (i = 0; i < count && !serial; i++) {
+			struct init_stage *s = &stages[i];
+
+			if (s->started || !s->any_cpu ||
+			    (s->deps & done) != s->deps)
+				continue;
+			cpu = next_init_cpu(cpu);
+			if (!cpu)
+				break;
+			s->started = true;
+			s->job = cpu_queue_job(cpu, s->name,
+					       run_init_stage_job, s);
+			if (!s->job) {
+				run_init_stage(s);
+				done |= STAGE_DEP(i);
+			}
+		}
+
+		/* Reap the completed ones */
+		for (i = 0; i < count; i++) {
+			struct init_stage *s = &stages[i];
+
+			if (!s->job || !cpu_poll_job(s->job))
+				continue;
+			cpu_free_job(s->job);
+			s->job = NULL;
+			done |= STAGE_DEP(i);
+			progress = true;
+		}
+
+		/* And run the first ready one ourselves */
+		for (i = 0; i < count; i++) {
+			struct init_stage *s = &stages[i];
+
+			if (s->started || (s->deps & done) != s->deps)
+				continue;
+			if (s->any_cpu && !serial && next_init_cpu(NULL))
+				continue;
+			s->started = true;
+			run_init_stage(s);
+			done |= STAGE_DEP(i);
+			progress = true;
+			break;
+		}
+
+		/*
+		 * Only waiting on secondaries. A stage running there may
+		 * queue jobs back to us (slw_for_each_chip() does), so run
+		 * those as well as keeping the pollers going.
+		 */
+		if (!progress) {
+			cpu_process_jobs();
+			time_wait_ms(1);
+		}
+	}
+}
+
 /* Called from head.S, thus no prototype. */
 void __noreturn main_cpu_entry(const void *fdt, u32 master_cpu);
 
@@ -599,7 +847,7 @@ void __noreturn main_cpu_entry(const void *fdt, u32 master_cpu)
 	/* Create the OPAL call table early on, entries can be overridden
 	 * later on (FSP console code for example)
 	 */
-	opal_table_init();
+	boot_stage(opal_table_init());
 
 	/*
 	 * If we are coming in with a flat device-tree, we expand it
@@ -609,11 +857,11 @@ void __noreturn main_cpu_entry(const void *fdt, u32 master_cpu)
 	 * is set to -1, we record that and pass it to parse_hdat
 	 */
 	if (fdt == (void *)-1ul)
-		parse_hdat(true, master_cpu);
+		boot_stage(parse_hdat(true, master_cpu));
 	else if (fdt == NULL)
-		parse_hdat(false, master_cpu);
+		boot_stage(parse_hdat(false, master_cpu));
 	else {
-		dt_expand(fdt);
+		boot_stage(dt_expand(fdt));
 	}
 
 	/*
@@ -628,18 +876,18 @@ void __noreturn main_cpu_entry(const void *fdt, u32 master_cpu)
 	 * We also initialize the FSI master at that point in case we need
 	 * to access chips via that path early on.
 	 */
-	init_chips();
+	boot_stage(init_chips());
 	if (chip_quirk(QUIRK_MAMBO_CALLOUTS))
 		enable_mambo_console();
-	xscom_init();
-	mfsi_init();
+	boot_stage(xscom_init());
+	boot_stage(mfsi_init());
 
 	/*
 	 * Put various bits & pieces in device-tree that might not
 	 * already be there such as the /chosen node if not there yet,
 	 * the ICS node, etc... This can potentially use XSCOM
 	 */
-	dt_init_misc();
+	boot_stage(dt_init_misc());
 
 	/*
 	 * Initialize LPC (P8 only) so we can get to UART, BMC and
@@ -647,7 +895,7 @@ void __noreturn main_cpu_entry(const void *fdt, u32 master_cpu)
 	 * so that the platform probing code can access an external
 	 * BMC if needed.
 	 */
-	lpc_init();
+	boot_stage(lpc_init());
 
 	/*
 	 * Now, we init our memory map from the device-tree, and immediately
@@ -656,13 +904,13 @@ void __noreturn main_cpu_entry(const void *fdt, u32 master_cpu)
 	 * allocations outside of our heap, such as chip local allocs,
 	 * otherwise we might clobber those data.
 	 */
-	mem_region_init();
+	boot_stage(mem_region_init());
 
 	/* Reserve HOMER and OCC area */
-	homer_init();
+	boot_stage(homer_init());
 
 	/* Add the /opal node to the device-tree */
-	add_opal_node();
+	boot_stage(add_opal_node());
 
 	/*
 	 * We probe the platform now. This means the platform probe gets
@@ -670,84 +918,63 @@ void __noreturn main_cpu_entry(const void *fdt, u32 master_cpu)
 	 *
 	 * Note: Timebases still not synchronized.
 	 */
-	probe_platform();
+	boot_stage(probe_platform());
 
 	/* Initialize the rest of the cpu thread structs */
-	init_all_cpus();
+	boot_stage(init_all_cpus());
 
 	/* Allocate our split trace buffers now. Depends add_opal_node() */
-	init_trace_buffers();
+	boot_stage(init_trace_buffers());
+
+	/* And the per cpu console staging buffers */
+	boot_stage(init_console_stages());
 
 	/* Get the ICPs and make sure they are in a sane state */
-	init_interrupts();
+	boot_stage(init_interrupts());
 
 	/* Grab centaurs from device-tree if present (only on FSP-less) */
-	centaur_init();
+	boot_stage(centaur_init());
 
 	/* Initialize PSI (depends on probe_platform being called) */
-	psi_init();
+	boot_stage(psi_init());
 
 	/* Call in secondary CPUs */
-	cpu_bringup();
+	boot_stage(cpu_bringup());
 
 	/*
 	 * Sycnhronize time bases. Thi resets all the TB values to a small
 	 * value (so they appear to go backward at this point), and synchronize
 	 * all core timebases to the global ChipTOD network
 	 */
-	chiptod_init();
-
-	/* Initialize i2c */
-	p8_i2c_init();
-
-	/* Register routine to dispatch and read sensors */
-	sensor_init();
+	boot_stage(chiptod_init());
+	boot_timeline_tb_synced();
 
 	/*
-	 * We have initialized the basic HW, we can now call into the
-	 * platform to perform subsequent inits, such as establishing
-	 * communication with the FSP or starting IPMI.
+	 * Subsequent subsystem inits, some of which can run in parallel
+	 * on secondaries.
 	 */
-	if (platform.init)
-		platform.init();
-
-	/* Setup dummy console nodes if it's enabled */
-	if (dummy_console_enabled())
-		dummy_console_add_nodes();
+	run_init_stages(init_stages, ARRAY_SIZE(init_stages));
 
-	/* Init SLW related stuff, including fastsleep */
-	slw_init();
+	/* Graft the FRU VPD back now that nothing else updates the DT */
+	boot_stage(attach_hdat_fru_vpd());
 
 	op_display(OP_LOG, OP_MOD_INIT, 0x0002);
 
-	/* Read in NVRAM and set it up */
-	nvram_init();
-
-	phb3_preload_vpd();
-	phb3_preload_capp_ucode();
-	start_preload_kernel();
-
-	/* NX init */
-	nx_init();
-
-	/* Initialize the opal messaging */
-	opal_init_msg();
-
 	/* Probe IO hubs */
-	probe_p5ioc2();
-	probe_p7ioc();
+	boot_stage(probe_p5ioc2());
+	boot_stage(probe_p7ioc());
 
 	/* Probe PHB3 on P8 */
-	probe_phb3();
+	boot_stage(probe_phb3());
 
 	/* Probe NPUs */
-	probe_npu();
+	boot_stage(probe_npu());
 
 	/* Initialize PCI */
-	pci_init_slots();
+	boot_stage(pci_init_slots());
 
 	/* Add OPAL timer related properties */
-	late_init_timers();
+	boot_stage(late_init_timers());
 
 	ipmi_set_fw_progress_sensor(IPMI_FW_PCI_INIT);
 
@@ -762,15 +989,15 @@ void __noreturn main_cpu_entry(const void *fdt, u32 master_cpu)
 	 */
 
 	/* Add the list of interrupts going to OPAL */
-	add_opal_interrupts();
+	boot_stage(add_opal_interrupts());
 
 	/* Now release parts of memory nodes we haven't used ourselves... */
-	mem_region_release_unused();
+	boot_stage(mem_region_release_unused());
 
 	/* ... and add remaining reservations to the DT */
-	mem_region_add_dt_reserved();
+	boot_stage(mem_region_add_dt_reserved());
 
-	prd_register_reserved_memory();
+	boot_stage(prd_register_reserved_memory());
 
 	load_and_boot_kernel(false);
 }
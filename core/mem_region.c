@@ -25,6 +25,7 @@
 #include <types.h>
 #include <mem_region.h>
 #include <mem_region-malloc.h>
+#include <buddy.h>
 
 int64_t mem_dump_free(void);
 void mem_dump_allocs(void);
@@ -195,23 +196,16 @@ static void make_free(struct mem_region *region, struct free_hdr *f,
 /* Can we fit this many longs with this alignment in this free block? */
 static bool fits(struct free_hdr *f, size_t longs, size_t align, size_t *offset)
 {
-	*offset = 0;
+	size_t addr = (unsigned long)f + ALLOC_HDR_LONGS * sizeof(long);
 
-	while (f->hdr.num_longs >= *offset + longs) {
-		size_t addr;
+	*offset = 0;
 
-		addr = (unsigned long)f
-			+ (*offset + ALLOC_HDR_LONGS) * sizeof(long);
-		if ((addr & (align - 1)) == 0)
-			return true;
+	/* Don't make tiny chunks! */
+	if (addr & (align - 1))
+		*offset = (ALIGN_UP(addr + ALLOC_MIN_LONGS * sizeof(long),
+				    align) - addr) / sizeof(long);
 
-		/* Don't make tiny chunks! */
-		if (*offset == 0)
-			*offset = ALLOC_MIN_LONGS;
-		else
-			(*offset)++;
-	}
-	return false;
+	return f->hdr.num_longs >= *offset + longs;
 }
 
 static void discard_excess(struct mem_region *region,
@@ -263,7 +257,7 @@ static bool region_is_reservable(struct mem_region *region)
 	return region->type != REGION_OS;
 }
 
-static bool region_is_reserved(struct mem_region *region)
+static bool region_is_reserved(const struct mem_region *region)
 {
 	return region->type != REGION_OS && region->type != REGION_MEMORY;
 }
@@ -627,6 +621,207 @@ static struct mem_region *new_region(const char *name,
 	return region;
 }
 
+/*
+ * Address index over the regions list: an array sorted by start
+ * address, used as an implicit balanced tree (the root of [lo, hi) is
+ * the middle entry) where each entry also holds the highest end address
+ * in its subtree. Regions parsed from the device tree may overlap the
+ * memory regions, so this is an interval tree rather than a plain
+ * binary search. New regions are first put on a small pending array
+ * which is searched linearly, and merged in batches, so that adding
+ * thousands of regions doesn't rebuild the tree every time.
+ *
+ * The list is still the authority on region order for mem_region_next()
+ * and friends; every list addition or removal, and any growth of a
+ * region, must update the index under mem_region_lock. Shrinking a
+ * region needs nothing: a stale, larger max_end only costs a visit.
+ */
+struct region_index_entry {
+	struct mem_region *region;
+	uint64_t max_end;
+};
+
+#define REGION_INDEX_PENDING	32
+
+static struct region_index_entry *region_index;
+static size_t region_index_nr, region_index_max;
+static struct mem_region *region_pending[REGION_INDEX_PENDING];
+static unsigned int region_pending_nr;
+
+static uint64_t region_end(const struct mem_region *region)
+{
+	return region->start + region->len;
+}
+
+static uint64_t region_index_build(size_t lo, size_t hi)
+{
+	size_t mid = lo + (hi - lo) / 2;
+	uint64_t max_end, e;
+
+	if (lo >= hi)
+		return 0;
+
+	max_end = region_end(region_index[mid].region);
+	e = region_index_build(lo, mid);
+	if (e > max_end)
+		max_end = e;
+	e = region_index_build(mid + 1, hi);
+	if (e > max_end)
+		max_end = e;
+	region_index[mid].max_end = max_end;
+
+	return max_end;
+}
+
+/* Recompute the subtree ends after a region has grown */
+static void region_index_update(void)
+{
+	region_index_build(0, region_index_nr);
+}
+
+static bool region_index_merge(void)
+{
+	struct region_index_entry *ri;
+	struct mem_region *r;
+	size_t max, i, k;
+	unsigned int j;
+
+	if (region_index_nr + region_pending_nr > region_index_max) {
+		max = region_index_max ? region_index_max * 2 : 64;
+		ri = realloc(region_index, max * sizeof(*ri));
+		if (!ri)
+			return false;
+		region_index = ri;
+		region_index_max = max;
+	}
+
+	/* Sort the pending regions, there are only a few */
+	for (j = 1; j < region_pending_nr; j++) {
+		r = region_pending[j];
+		for (k = j; k > 0 &&
+			     region_pending[k - 1]->start > r->start; k--)
+			region_pending[k] = region_pending[k - 1];
+		region_pending[k] = r;
+	}
+
+	/* Merge from the top down; new regions go after equal starts */
+	i = region_index_nr;
+	k = region_index_nr + region_pending_nr;
+	j = region_pending_nr;
+	while (j) {
+		if (i && region_index[i - 1].region->start >
+		    region_pending[j - 1]->start)
+			region_index[--k] = region_index[--i];
+		else
+			region_index[--k].region = region_pending[--j];
+	}
+
+	region_index_nr += region_pending_nr;
+	region_pending_nr = 0;
+	region_index_update();
+
+	return true;
+}
+
+static bool region_index_add(struct mem_region *region)
+{
+	if (region_pending_nr == REGION_INDEX_PENDING &&
+	    !region_index_merge())
+		return false;
+
+	region_pending[region_pending_nr++] = region;
+	return true;
+}
+
+static void region_index_del(struct mem_region *region)
+{
+	size_t lo = 0, hi = region_index_nr, mid;
+	unsigned int j;
+
+	for (j = 0; j < region_pending_nr; j++) {
+		if (region_pending[j] == region) {
+			region_pending[j] = region_pending[--region_pending_nr];
+			return;
+		}
+	}
+
+	/* Find the first region with this start, then ours among them */
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (region_index[mid].region->start < region->start)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	while (lo < region_index_nr && region_index[lo].region != region)
+		lo++;
+	assert(lo < region_index_nr);
+
+	region_index_nr--;
+	memmove(&region_index[lo], &region_index[lo + 1],
+		(region_index_nr - lo) * sizeof(*region_index));
+	region_index_update();
+}
+
+/*
+ * Find a region with start < end and start + len > start (ie, one that
+ * overlaps [start, end)) for which match() is true. Subtrees that end
+ * at or before start are skipped, so this costs O(log n) per
+ * overlapping region rather than a walk of the whole list.
+ */
+static struct mem_region *region_index_search(size_t lo, size_t hi,
+		uint64_t start, uint64_t end,
+		bool (*match)(const struct mem_region *, const void *),
+		const void *data)
+{
+	struct mem_region *region;
+	size_t mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (region_index[mid].max_end <= start)
+			return NULL;
+
+		region = region_index_search(lo, mid, start, end, match, data);
+		if (region)
+			return region;
+
+		region = region_index[mid].region;
+		if (region->start >= end)
+			return NULL;
+		if (region_end(region) > start && match(region, data))
+			return region;
+
+		lo = mid + 1;
+	}
+	return NULL;
+}
+
+static struct mem_region *region_find(uint64_t start, uint64_t end,
+		bool (*match)(const struct mem_region *, const void *),
+		const void *data)
+{
+	struct mem_region *region;
+	unsigned int j;
+
+	/* An empty range still finds the regions around start */
+	if (end <= start)
+		end = start + 1;
+
+	region = region_index_search(0, region_index_nr, start, end,
+				     match, data);
+	if (region)
+		return region;
+
+	for (j = 0; j < region_pending_nr; j++) {
+		region = region_pending[j];
+		if (region->start < end && region_end(region) > start &&
+		    match(region, data))
+			return region;
+	}
+	return NULL;
+}
+
 /* We always split regions, so we only have to replace one. */
 static struct mem_region *split_region(struct mem_region *head,
 				       uint64_t split_at,
@@ -644,43 +839,43 @@ static struct mem_region *split_region(struct mem_region *head,
 	return tail;
 }
 
-static bool intersects(const struct mem_region *region, uint64_t addr)
+static bool intersects(const struct mem_region *region, const void *data)
 {
+	uint64_t addr = *(const uint64_t *)data;
+
 	return addr > region->start &&
 		addr < region->start + region->len;
 }
 
-static bool maybe_split(struct mem_region *r, uint64_t split_at)
+static bool split_all(uint64_t split_at)
 {
-	struct mem_region *tail;
-
-	if (!intersects(r, split_at))
-		return true;
+	struct mem_region *r, *tail;
 
-	tail = split_region(r, split_at, r->type);
-	if (!tail)
-		return false;
-
-	/* Tail add is important: we may need to split again! */
-	list_add_tail(&regions, &tail->list);
+	/* Each split leaves neither half intersecting split_at */
+	while ((r = region_find(split_at, split_at + 1,
+				intersects, &split_at)) != NULL) {
+		tail = split_region(r, split_at, r->type);
+		if (!tail)
+			return false;
+		list_add_tail(&regions, &tail->list);
+		if (!region_index_add(tail))
+			return false;
+	}
 	return true;
 }
 
-static bool overlaps(const struct mem_region *r1, const struct mem_region *r2)
+static bool overlaps(const struct mem_region *r1, const void *data)
 {
+	const struct mem_region *r2 = data;
+
 	return (r1->start + r1->len > r2->start
 		&& r1->start < r2->start + r2->len);
 }
 
 static struct mem_region *get_overlap(const struct mem_region *region)
 {
-	struct mem_region *i;
-
-	list_for_each(&regions, i, list) {
-		if (overlaps(region, i))
-			return i;
-	}
-	return NULL;
+	return region_find(region->start, region_end(region),
+			   overlaps, region);
 }
 
 static bool add_region(struct mem_region *region)
@@ -694,20 +889,22 @@ static bool add_region(struct mem_region *region)
 	}
 
 	/* First split any regions which intersect. */
-	list_for_each(&regions, r, list)
-		if (!maybe_split(r, region->start) ||
-		    !maybe_split(r, region->start + region->len))
-			return false;
+	if (!split_all(region->start) ||
+	    !split_all(region->start + region->len))
+		return false;
 
 	/* Now we have only whole overlaps, if any. */
 	while ((r = get_overlap(region)) != NULL) {
 		assert(r->start == region->start);
 		assert(r->len == region->len);
 		list_del_from(&regions, &r->list);
+		region_index_del(r);
 		free(r);
 	}
 
 	/* Finally, add in our own region. */
+	if (!region_index_add(region))
+		return false;
 	list_add(&regions, &region->list);
 	return true;
 }
@@ -736,14 +933,39 @@ static bool matches_chip_id(const __be32 ids[], size_t num, u32 chip_id)
 	return false;
 }
 
-void *__local_alloc(unsigned int chip_id, size_t size, size_t align,
-		    const char *location)
+/*
+ * Large naturally aligned allocations (the PHB tables) come from per-chip
+ * buddy pools carved out of node local memory. With mem_alloc() each of
+ * them leaves most of an alignment unit unusable behind its header; the
+ * buddy allocator packs them with no padding.
+ * Protected by mem_region_lock.
+ */
+#define LOCAL_POOL_ORDER	21	/* 2MB per pool */
+#define LOCAL_POOL_MIN_ORDER	12
+
+struct local_pool {
+	struct list_node link;
+	unsigned int chip_id;
+	struct buddy *buddy;
+};
+
+static LIST_HEAD(local_pools);
+
+static bool local_pool_wants(size_t size, size_t align)
+{
+	return size >= (1ul << LOCAL_POOL_MIN_ORDER) &&
+		size <= (1ul << LOCAL_POOL_ORDER) &&
+		!(size & (size - 1)) && align <= size;
+}
+
+static void *local_alloc_region(unsigned int chip_id, size_t size,
+				size_t align, const char *location)
 {
 	struct mem_region *region;
 	void *p = NULL;
 	bool use_local = true;
 
-	lock(&mem_region_lock);
+	assert(lock_held_by_me(&mem_region_lock));
 
 restart:
 	list_for_each(&regions, region, list) {
@@ -786,6 +1008,54 @@ restart:
 		goto restart;
 	}
 
+	return p;
+}
+
+static void *local_pool_alloc(unsigned int chip_id, size_t size,
+			      const char *location)
+{
+	unsigned int order = buddy_order(size);
+	struct local_pool *pool;
+	void *chunk, *p;
+
+	list_for_each(&local_pools, pool, link) {
+		if (pool->chip_id != chip_id)
+			continue;
+		p = buddy_alloc(pool->buddy, order);
+		if (p)
+			return p;
+	}
+
+	pool = zalloc(sizeof(*pool));
+	if (!pool)
+		return NULL;
+	chunk = local_alloc_region(chip_id, 1ul << LOCAL_POOL_ORDER,
+				   1ul << LOCAL_POOL_ORDER, location);
+	if (!chunk) {
+		free(pool);
+		return NULL;
+	}
+	pool->buddy = buddy_create(chunk, LOCAL_POOL_ORDER,
+				   LOCAL_POOL_MIN_ORDER);
+	assert(pool->buddy);
+	pool->chip_id = chip_id;
+	list_add_tail(&local_pools, &pool->link);
+	prlog(PR_DEBUG, "MEM: New local pool for chip %d at %p\n",
+	      chip_id, chunk);
+
+	return buddy_alloc(pool->buddy, order);
+}
+
+void *__local_alloc(unsigned int chip_id, size_t size, size_t align,
+		    const char *location)
+{
+	void *p = NULL;
+
+	lock(&mem_region_lock);
+	if (local_pool_wants(size, align))
+		p = local_pool_alloc(chip_id, size, location);
+	if (!p)
+		p = local_alloc_region(chip_id, size, align, location);
 	unlock(&mem_region_lock);
 
 	return p;
@@ -802,44 +1072,37 @@ struct mem_region *find_mem_region(const char *name)
 	return NULL;
 }
 
+static bool region_covers_reserved(const struct mem_region *region,
+				   const void *data __unused)
+{
+	/* The search only returns regions with a non-zero overlap */
+	return region_is_reserved(region);
+}
+
 bool mem_range_is_reserved(uint64_t start, uint64_t size)
 {
 	uint64_t end = start + size;
 	struct mem_region *region;
 
 	/* We may have the range covered by a number of regions, which could
-	 * appear in any order. So, we look for a region that covers the
-	 * start address, and bump start up to the end of that region.
+	 * overlap. So, we look for a region that covers the start address,
+	 * and bump start up to the end of that region.
 	 *
 	 * We repeat until we've either bumped past the end of the range,
-	 * or we didn't find a matching region.
-	 *
-	 * This has a worst-case of O(n^2), but n is well bounded by the
-	 * small number of reservations.
+	 * or we didn't find a matching region. Each lookup is a search of
+	 * the region index, so this is O(k log n) for a range covered by
+	 * k regions.
 	 */
 	for (;;) {
-		bool found = false;
-
-		list_for_each(&regions, region, list) {
-			if (!region_is_reserved(region))
-				continue;
-
-			/* does this region overlap the start address, and
-			 * have a non-zero size? */
-			if (region->start <= start &&
-					region->start + region->len > start &&
-					region->len) {
-				start = region->start + region->len;
-				found = true;
-			}
-		}
-
 		/* 'end' is the first byte outside of the range */
 		if (start >= end)
 			return true;
 
-		if (!found)
+		region = region_find(start, start + 1,
+				     region_covers_reserved, NULL);
+		if (!region)
 			break;
+		start = region_end(region);
 	}
 
 	return false;
@@ -851,13 +1114,17 @@ void adjust_cpu_stacks_alloc(void)
 	 * we adjust, then when we bring all CPUs online we know the
 	 * runtime max PIR, so we adjust this a few times during boot.
 	 */
+	lock(&mem_region_lock);
 	skiboot_cpu_stacks.len = (cpu_max_pir + 1) * STACK_SIZE;
+	region_index_update();
+	unlock(&mem_region_lock);
 }
 
 static void mem_region_parse_reserved_properties(void)
 {
 	const struct dt_property *names, *ranges;
 	struct mem_region *region;
+	bool added;
 
 	prlog(PR_INFO, "MEM: parsing reserved memory from "
 			"reserved-names/-ranges properties\n");
@@ -881,6 +1148,8 @@ static void mem_region_parse_reserved_properties(void)
 					dt_get_number(range + 1, 2),
 					NULL, REGION_HW_RESERVED);
 			list_add(&regions, &region->list);
+			added = region_index_add(region);
+			assert(added);
 		}
 	} else if (names || ranges) {
 		prerror("Invalid properties: reserved-names=%p "
@@ -905,6 +1174,7 @@ static bool mem_region_parse_reserved_nodes(const char *path)
 	dt_for_each_child(parent, node) {
 		const struct dt_property *reg;
 		struct mem_region *region;
+		bool added;
 
 		reg = dt_find_property(node, "reg");
 		if (!reg) {
@@ -920,6 +1190,8 @@ static bool mem_region_parse_reserved_nodes(const char *path)
 				dt_get_number(reg->prop + sizeof(u64), 2),
 				node, REGION_HW_RESERVED);
 		list_add(&regions, &region->list);
+		added = region_index_add(region);
+		assert(added);
 	}
 
 	return true;
@@ -936,6 +1208,12 @@ void mem_region_init(void)
 	extern char _end[];
 	BUILD_ASSERT(HEAP_BASE >= (uint64_t)_end);
 
+	/* The regions list is built from scratch here */
+	lock(&mem_region_lock);
+	region_index_nr = 0;
+	region_pending_nr = 0;
+	unlock(&mem_region_lock);
+
 	/*
 	 * Add associativity properties outside of the lock
 	 * to avoid recursive locking caused by allocations
@@ -964,7 +1242,7 @@ void mem_region_init(void)
 		start = dt_get_address(i, 0, &len);
 		lock(&mem_region_lock);
 		region = new_region(rname, start, len, i, REGION_MEMORY);
-		if (!region) {
+		if (!region || !region_index_add(region)) {
 			prerror("MEM: Could not add mem region %s!\n", i->name);
 			abort();
 		}
@@ -1068,6 +1346,11 @@ void mem_region_release_unused(void)
 				abort();
 			}
 			list_add(&regions, &for_linux->list);
+			if (!region_index_add(for_linux)) {
+				prerror("OOM indexing mem node %s for linux\n",
+					r->name);
+				abort();
+			}
 		}
 	}
 	unlock(&mem_region_lock);
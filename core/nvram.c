@@ -20,12 +20,159 @@
 #include <lock.h>
 #include <device.h>
 #include <platform.h>
+#include <timer.h>
+#include <timebase.h>
 #include <nvram-format.h>
 
+/*
+ * Writes only update nvram_image and mark the blocks they touch dirty.
+ * A timer commits runs of adjacent dirty blocks to the backend later,
+ * so a burst of small writes (pstore, oops) costs one flash update.
+ */
+#define NVRAM_DIRTY_SHIFT	12
+#define NVRAM_MAX_SIZE		0x100000
+#define NVRAM_DIRTY_BITS	(NVRAM_MAX_SIZE >> NVRAM_DIRTY_SHIFT)
+#define NVRAM_FLUSH_DELAY_MS	1000
+#define NVRAM_FLUSH_RETRY_MS	100
+#define NVRAM_FLUSH_TIMEOUT_MS	5000
+
 static void *nvram_image;
 static uint32_t nvram_size;
 static bool nvram_ready;
 
+static struct lock nvram_lock = LOCK_UNLOCKED;
+static uint64_t nvram_dirty[NVRAM_DIRTY_BITS / 64];
+static struct timer nvram_timer;
+static bool nvram_flush_scheduled;
+
+static inline unsigned int nvram_blocks(void)
+{
+	return (nvram_size + (1 << NVRAM_DIRTY_SHIFT) - 1) >> NVRAM_DIRTY_SHIFT;
+}
+
+static inline bool nvram_block_dirty(unsigned int b)
+{
+	return nvram_dirty[b / 64] & (1ull << (b % 64));
+}
+
+static inline void nvram_set_dirty(unsigned int b, bool dirty)
+{
+	if (dirty)
+		nvram_dirty[b / 64] |= 1ull << (b % 64);
+	else
+		nvram_dirty[b / 64] &= ~(1ull << (b % 64));
+}
+
+/* Called with nvram_lock held */
+static void nvram_mark_dirty(uint32_t offset, uint32_t size)
+{
+	unsigned int b, last;
+
+	b = offset >> NVRAM_DIRTY_SHIFT;
+	last = (offset + size - 1) >> NVRAM_DIRTY_SHIFT;
+	for (; b <= last; b++)
+		nvram_set_dirty(b, true);
+
+	if (!nvram_flush_scheduled) {
+		nvram_flush_scheduled = true;
+		schedule_timer(&nvram_timer, msecs_to_tb(NVRAM_FLUSH_DELAY_MS));
+	}
+}
+
+/*
+ * Write back all dirty blocks, one backend write per run of adjacent
+ * blocks. Returns the backend's error (OPAL_BUSY if the flash is in
+ * use) if it couldn't finish, in which case what is left stays dirty.
+ */
+static int64_t nvram_flush_dirty(void)
+{
+	unsigned int b, start, end, nr = nvram_blocks();
+	uint32_t offset, len;
+	int rc;
+
+	for (;;) {
+		lock(&nvram_lock);
+		for (start = 0; start < nr; start++)
+			if (nvram_block_dirty(start))
+				break;
+		if (start == nr) {
+			unlock(&nvram_lock);
+			return OPAL_SUCCESS;
+		}
+		for (end = start; end < nr && nvram_block_dirty(end); end++)
+			nvram_set_dirty(end, false);
+		unlock(&nvram_lock);
+
+		/*
+		 * A write landing in the range while we commit it marks
+		 * its block dirty again, so it gets written next time.
+		 */
+		offset = start << NVRAM_DIRTY_SHIFT;
+		len = MIN(end << NVRAM_DIRTY_SHIFT, nvram_size) - offset;
+		rc = platform.nvram_write(offset, nvram_image + offset, len);
+		if (rc) {
+			if (rc != OPAL_BUSY)
+				prerror("NVRAM: Error %d writing 0x%x bytes at"
+					" 0x%x\n", rc, len, offset);
+			lock(&nvram_lock);
+			for (b = start; b < end; b++)
+				nvram_set_dirty(b, true);
+			unlock(&nvram_lock);
+			return rc;
+		}
+	}
+}
+
+static void nvram_flush_timer(struct timer *t __unused, void *data __unused,
+			      uint64_t now __unused)
+{
+	lock(&nvram_lock);
+	nvram_flush_scheduled = false;
+	unlock(&nvram_lock);
+
+	if (nvram_flush_dirty() == OPAL_SUCCESS)
+		return;
+
+	lock(&nvram_lock);
+	if (!nvram_flush_scheduled) {
+		nvram_flush_scheduled = true;
+		schedule_timer(&nvram_timer, msecs_to_tb(NVRAM_FLUSH_RETRY_MS));
+	}
+	unlock(&nvram_lock);
+}
+
+/* Don't leave writes waiting on our timer across kexec */
+static bool nvram_host_sync(void *data __unused)
+{
+	return nvram_flush_dirty() == OPAL_SUCCESS;
+}
+
+/*
+ * Called before a reboot or power down, so wait out the flash being busy
+ * (our own timer flush on another CPU, or another flash user) for a
+ * while rather than dropping what's dirty.
+ */
+void nvram_flush(void)
+{
+	uint64_t end;
+	int64_t rc;
+
+	if (!nvram_ready || !platform.nvram_write)
+		return;
+
+	end = mftb() + msecs_to_tb(NVRAM_FLUSH_TIMEOUT_MS);
+	for (;;) {
+		rc = nvram_flush_dirty();
+		if (rc != OPAL_BUSY || tb_compare(mftb(), end) == TB_AAFTERB)
+			break;
+		opal_run_pollers();
+		time_wait_ms(10);
+	}
+
+	if (rc)
+		prerror("NVRAM: Failed to flush pending writes (%lld)\n", rc);
+}
+
 static int64_t opal_read_nvram(uint64_t buffer, uint64_t size, uint64_t offset)
 {
 	if (!nvram_ready)
@@ -44,9 +191,15 @@ static int64_t opal_write_nvram(uint64_t buffer, uint64_t size, uint64_t offset)
 		return OPAL_HARDWARE;
 	if (offset >= nvram_size || (offset + size) > nvram_size)
 		return OPAL_PARAMETER;
+	if (!size)
+		return OPAL_SUCCESS;
+
+	lock(&nvram_lock);
 	memcpy(nvram_image + offset, (void *)buffer, size);
 	if (platform.nvram_write)
-		platform.nvram_write(offset, nvram_image + offset, size);
+		nvram_mark_dirty(offset, size);
+	unlock(&nvram_lock);
+
 	return OPAL_SUCCESS;
 }
 opal_call(OPAL_WRITE_NVRAM, opal_write_nvram, 3);
@@ -76,6 +229,9 @@ void nvram_read_complete(bool success)
 	dt_add_property_cells(np, "#bytes", nvram_size);
 	dt_add_property_string(np, "compatible", "ibm,opal-nvram");
 
+	init_timer(&nvram_timer, nvram_flush_timer, NULL);
+	opal_add_host_sync_notifier(nvram_host_sync, NULL);
+
 	/* Mark ready */
 	nvram_ready = true;
 }
@@ -92,9 +248,9 @@ void nvram_init(void)
 		return;
 	}
 	printf("NVRAM: Size is %d KB\n", nvram_size >> 10);
-	if (nvram_size > 0x100000) {
+	if (nvram_size > NVRAM_MAX_SIZE) {
 		printf("NVRAM: Cropping to 1MB !\n");
-		nvram_size = 0x100000;
+		nvram_size = NVRAM_MAX_SIZE;
 	}
 
 	/*
@@ -19,55 +19,454 @@
 #include <opal-msg.h>
 #include <opal-api.h>
 #include <lock.h>
+#include <device.h>
+#include <processor.h>
+#include <cpu.h>
 
 #define OPAL_MAX_MSGS		(OPAL_MSG_TYPE_MAX + OPAL_MAX_ASYNC_COMP - 1)
 
+/* Must be a power of two */
+#define OPAL_MSG_RING_ENTRIES	256
+
+/* Async tokens that get a completion slot */
+#define OPAL_ASYNC_COMP_SLOTS	64
+
 struct opal_msg_entry {
 	struct list_node link;
+	struct opal_msg_entry *next;	/* On msg_queue or a CPU's cache */
+	struct cpu_thread *home;	/* Whose cache it goes back to */
 	void (*consumed)(void *data);
 	void *data;
 	struct opal_msg msg;
 };
 
 static LIST_HEAD(msg_free_list);
+static unsigned int msg_free_count;
 static LIST_HEAD(msg_pending_list);
 
 static struct lock opal_msg_lock = LOCK_UNLOCKED;
 
-int _opal_queue_msg(enum opal_msg_type msg_type, void *data,
-		    void (*consumed)(void *data), size_t num_params,
-		    const u64 *params)
+/*
+ * Producers don't take opal_msg_lock. They pick an entry from the
+ * cache of their CPU and push it on msg_queue, a lock-free stack.
+ * Whoever holds opal_msg_lock takes the whole stack, puts it back in
+ * order and moves it to the ring or msg_pending_list. Consumed entries
+ * go back to the cache of the CPU that last took them from
+ * msg_free_list. Only that CPU pops its cache, so there's no ABA.
+ *
+ * A CPU caches at most OPAL_MSG_CPU_CACHE entries, and only while the
+ * pool holds at least half of OPAL_MAX_MSGS, so CPUs that haven't sent
+ * anything yet still find entries there.
+ */
+#define OPAL_MSG_CPU_CACHE	2
+
+static struct opal_msg_entry *msg_queue;
+
+/*
+ * Shared ring advertised to the host in "ibm,opal-msg-ring". OPAL owns
+ * the head, the host owns the tail. The consumed callbacks live on our
+ * side so the host can't corrupt them; they are run once the host tail
+ * has moved past their entry.
+ */
+struct opal_msg_ring_cb {
+	void (*consumed)(void *data);
+	void *data;
+};
+
+static struct opal_msg_ring *msg_ring;
+static struct opal_msg_ring_cb msg_ring_cbs[OPAL_MSG_RING_ENTRIES];
+static u64 msg_ring_head;	/* Our copy, the host may scribble on the ring */
+static u64 msg_ring_reclaimed;	/* Callbacks have run up to here */
+
+/*
+ * Async completions are written straight into the slot of their token,
+ * without opal_msg_lock or a message entry. A token has a single
+ * operation outstanding at a time, so the only other writer of a slot
+ * is whoever consumes it.
+ */
+static struct opal_async_comp_table *async_comp;
+static bool async_comp_evt;	/* We raised MSG_PENDING for a slot */
+
+static inline void ring_stat_inc(__be64 *stat)
 {
-	struct opal_msg_entry *entry;
+	*stat = cpu_to_be64(be64_to_cpu(*stat) + 1);
+}
 
-	lock(&opal_msg_lock);
+/* Called with opal_msg_lock held */
+static bool opal_msg_ring_active(void)
+{
+	return msg_ring &&
+		(be32_to_cpu(msg_ring->flags) & OPAL_MSG_RING_HOST_ACTIVE);
+}
+
+/* Called with opal_msg_lock held */
+static u64 opal_msg_ring_tail(void)
+{
+	u64 tail = be64_to_cpu(msg_ring->tail);
+
+	/* Don't believe a tail outside of what we actually produced */
+	if (tail < msg_ring_reclaimed || tail > msg_ring_head)
+		return msg_ring_reclaimed;
+	return tail;
+}
+
+/*
+ * Retire one entry the host has consumed, handing back its callback.
+ * Called with opal_msg_lock held, the callback must be run unlocked.
+ */
+static bool opal_msg_ring_reclaim_one(struct opal_msg_ring_cb *cb)
+{
+	u32 idx;
+
+	if (msg_ring_reclaimed == opal_msg_ring_tail())
+		return false;
+
+	idx = msg_ring_reclaimed & (OPAL_MSG_RING_ENTRIES - 1);
+	*cb = msg_ring_cbs[idx];
+	msg_ring_cbs[idx].consumed = NULL;
+	msg_ring_cbs[idx].data = NULL;
+	msg_ring_reclaimed++;
+
+	return true;
+}
+
+static void opal_msg_ring_reclaim(void)
+{
+	struct opal_msg_ring_cb cb;
+
+	for (;;) {
+		lock(&opal_msg_lock);
+		if (!msg_ring || !opal_msg_ring_reclaim_one(&cb)) {
+			unlock(&opal_msg_lock);
+			return;
+		}
+		unlock(&opal_msg_lock);
+
+		if (cb.consumed)
+			cb.consumed(cb.data);
+	}
+}
 
+/*
+ * Try to post a message straight into the ring. We only do so while
+ * nothing is queued on the pending list so the host sees messages in
+ * order. Called with opal_msg_lock held.
+ */
+static bool opal_msg_ring_post(const struct opal_msg *m, void *data,
+			       void (*consumed)(void *data))
+{
+	struct opal_msg *msg;
+	u64 tail;
+	u32 idx;
+
+	if (!opal_msg_ring_active() || !list_empty(&msg_pending_list))
+		return false;
+
+	/*
+	 * Entries without a callback can be retired right here, the others
+	 * have to wait for the poller or the next OPAL_GET_MSG.
+	 */
+	tail = opal_msg_ring_tail();
+	while (msg_ring_reclaimed < tail &&
+	       !msg_ring_cbs[msg_ring_reclaimed &
+			     (OPAL_MSG_RING_ENTRIES - 1)].consumed)
+		msg_ring_reclaimed++;
+
+	if (msg_ring_head - msg_ring_reclaimed >= OPAL_MSG_RING_ENTRIES) {
+		ring_stat_inc(&msg_ring->full_count);
+		return false;
+	}
+
+	idx = msg_ring_head & (OPAL_MSG_RING_ENTRIES - 1);
+	msg = &msg_ring->msgs[idx];
+	memcpy(msg, m, sizeof(*msg));
+	msg_ring_cbs[idx].consumed = consumed;
+	msg_ring_cbs[idx].data = data;
+
+	/* The entry must be visible before the head moves */
+	lwsync();
+	msg_ring->head = cpu_to_be64(++msg_ring_head);
+
+	return true;
+}
+
+static bool opal_async_comp_active(void)
+{
+	return async_comp &&
+		(be32_to_cpu(async_comp->flags) & OPAL_ASYNC_COMP_HOST_ACTIVE);
+}
+
+static bool opal_async_comp_post(void (*consumed)(void *data),
+				 size_t num_params, const u64 *params)
+{
+	struct opal_async_comp_slot *slot;
+	u64 token;
+
+	/* We couldn't tell when the host reads a slot */
+	if (!opal_async_comp_active() || consumed || !num_params)
+		return false;
+
+	token = params[0];
+	if (token >= OPAL_ASYNC_COMP_SLOTS)
+		return false;
+	slot = &async_comp->slots[token];
+	if (be64_to_cpu(slot->state) != OPAL_ASYNC_SLOT_EMPTY)
+		return false;
+
+	memset(&slot->msg, 0, sizeof(slot->msg));
+	slot->msg.msg_type = cpu_to_be32(OPAL_MSG_ASYNC_COMP);
+	memcpy(slot->msg.params, params, num_params*sizeof(u64));
+
+	/* The message must be visible before the state */
+	lwsync();
+	slot->state = cpu_to_be64(OPAL_ASYNC_SLOT_COMPLETE);
+
+	async_comp_evt = true;
+	opal_update_pending_evt(OPAL_EVENT_MSG_PENDING,
+				OPAL_EVENT_MSG_PENDING);
+
+	return true;
+}
+
+static bool opal_async_comp_take(u64 token, uint64_t *buffer, uint64_t size)
+{
+	struct opal_async_comp_slot *slot;
+
+	if (!async_comp || token >= OPAL_ASYNC_COMP_SLOTS)
+		return false;
+
+	slot = &async_comp->slots[token];
+	if (be64_to_cpu(slot->state) != OPAL_ASYNC_SLOT_COMPLETE)
+		return false;
+
+	lwsync();
+	if (size >= sizeof(struct opal_msg))
+		memcpy(buffer, &slot->msg, sizeof(slot->msg));
+	lwsync();
+	slot->state = cpu_to_be64(OPAL_ASYNC_SLOT_EMPTY);
+
+	return true;
+}
+
+static bool opal_async_comp_pending(void)
+{
+	unsigned int i;
+
+	if (!opal_async_comp_active())
+		return false;
+
+	for (i = 0; i < OPAL_ASYNC_COMP_SLOTS; i++)
+		if (be64_to_cpu(async_comp->slots[i].state) ==
+		    OPAL_ASYNC_SLOT_COMPLETE)
+			return true;
+
+	return false;
+}
+
+static struct opal_msg_entry *opal_msg_entry_get(void)
+{
+	struct cpu_thread *cpu = this_cpu();
+	struct opal_msg_entry *entry, *next;
+
+	do {
+		entry = cpu->msg_cache;
+		if (!entry)
+			break;
+		next = entry->next;
+	} while (!__sync_bool_compare_and_swap(&cpu->msg_cache, entry, next));
+	if (entry) {
+		__sync_fetch_and_sub(&cpu->msg_cache_len, 1);
+		return entry;
+	}
+
+	/* First use on this CPU, or a burst: take one from the pool */
+	lock(&opal_msg_lock);
 	entry = list_pop(&msg_free_list, struct opal_msg_entry, link);
-	if (!entry) {
+	if (entry)
+		msg_free_count--;
+	else {
 		prerror("No available node in the free list, allocating\n");
+		if (msg_ring)
+			ring_stat_inc(&msg_ring->overflow_count);
 		entry = zalloc(sizeof(struct opal_msg_entry));
-		if (!entry) {
-			prerror("Allocation failed\n");
-			unlock(&opal_msg_lock);
-			return OPAL_RESOURCE;
+	}
+	unlock(&opal_msg_lock);
+
+	if (entry)
+		entry->home = cpu;
+	return entry;
+}
+
+/* Called with opal_msg_lock held */
+static void opal_msg_entry_put(struct opal_msg_entry *entry)
+{
+	struct cpu_thread *cpu = entry->home;
+	struct opal_msg_entry *head;
+
+	if (msg_free_count < OPAL_MAX_MSGS / 2 ||
+	    cpu->msg_cache_len >= OPAL_MSG_CPU_CACHE) {
+		list_add(&msg_free_list, &entry->link);
+		msg_free_count++;
+		return;
+	}
+
+	__sync_fetch_and_add(&cpu->msg_cache_len, 1);
+	do {
+		head = cpu->msg_cache;
+		entry->next = head;
+	} while (!__sync_bool_compare_and_swap(&cpu->msg_cache, head, entry));
+}
+
+/* Move whatever producers queued to the ring or the pending list */
+static void opal_msg_flush_queue(void)
+{
+	struct opal_msg_entry *entry, *next, *prev = NULL;
+
+	if (!msg_queue)
+		return;
+
+	/* Newest first, turn it around */
+	entry = __sync_lock_test_and_set(&msg_queue, NULL);
+	while (entry) {
+		next = entry->next;
+		entry->next = prev;
+		prev = entry;
+		entry = next;
+	}
+
+	for (entry = prev; entry; entry = next) {
+		next = entry->next;
+		if (be32_to_cpu(entry->msg.msg_type) == OPAL_MSG_ASYNC_COMP &&
+		    opal_async_comp_active())
+			ring_stat_inc(&async_comp->overflow_count);
+		if (opal_msg_ring_post(&entry->msg, entry->data,
+				       entry->consumed)) {
+			opal_msg_entry_put(entry);
+			continue;
 		}
+		list_add_tail(&msg_pending_list, &entry->link);
 	}
+}
 
-	entry->consumed = consumed;
-	entry->data = data;
-	entry->msg.msg_type = cpu_to_be32(msg_type);
+/* Called with opal_msg_lock held */
+static void opal_msg_update_evt(void)
+{
+	bool pending = !list_empty(&msg_pending_list) || msg_queue;
+
+	if (opal_msg_ring_active())
+		pending |= opal_msg_ring_tail() != msg_ring_head;
+
+	async_comp_evt = opal_async_comp_pending();
+	pending |= async_comp_evt;
+
+	opal_update_pending_evt(OPAL_EVENT_MSG_PENDING,
+				pending ? OPAL_EVENT_MSG_PENDING : 0);
+	if (pending)
+		return;
+
+	/*
+	 * Producers don't take opal_msg_lock. One that saw the event
+	 * still up didn't raise it, and opal_async_comp_post() may have
+	 * completed a slot and raised it after we scanned, only for us
+	 * to lower it again. Look again now that it's down.
+	 */
+	sync();
+	if (opal_async_comp_pending())
+		async_comp_evt = true;
+	if (msg_queue || async_comp_evt)
+		opal_update_pending_evt(OPAL_EVENT_MSG_PENDING,
+					OPAL_EVENT_MSG_PENDING);
+}
+
+static void opal_msg_ring_poll(void *data __unused)
+{
+	/* Also lowers the event once the host has emptied its slots */
+	if (msg_ring && msg_ring_reclaimed != msg_ring_head)
+		opal_msg_ring_reclaim();
+	else if (!async_comp_evt && !msg_queue)
+		return;
+
+	lock(&opal_msg_lock);
+	opal_msg_flush_queue();
+	opal_msg_update_evt();
+	unlock(&opal_msg_lock);
+}
+
+/*
+ * On kexec the next kernel knows nothing about the ring, fall back to
+ * OPAL_GET_MSG until it opts in again. Whatever is left in the ring is
+ * treated as consumed.
+ */
+static bool opal_msg_ring_host_sync(void *data __unused)
+{
+	lock(&opal_msg_lock);
+	if (async_comp) {
+		async_comp->flags = 0;
+		memset(async_comp->slots, 0,
+		       OPAL_ASYNC_COMP_SLOTS * sizeof(async_comp->slots[0]));
+	}
+	if (!msg_ring) {
+		opal_msg_update_evt();
+		unlock(&opal_msg_lock);
+		return true;
+	}
+	msg_ring->flags = 0;
+	msg_ring->tail = msg_ring->head;
+	unlock(&opal_msg_lock);
+
+	opal_msg_ring_reclaim();
+
+	lock(&opal_msg_lock);
+	msg_ring_head = msg_ring_reclaimed = 0;
+	msg_ring->head = msg_ring->tail = 0;
+	opal_msg_update_evt();
+	unlock(&opal_msg_lock);
+
+	return true;
+}
+
+int _opal_queue_msg(enum opal_msg_type msg_type, void *data,
+		    void (*consumed)(void *data), size_t num_params,
+		    const u64 *params)
+{
+	struct opal_msg_entry *entry, *head;
 
 	if (num_params > ARRAY_SIZE(entry->msg.params)) {
 		prerror("Discarding extra parameters\n");
 		num_params = ARRAY_SIZE(entry->msg.params);
 	}
+
+	if (msg_type == OPAL_MSG_ASYNC_COMP &&
+	    opal_async_comp_post(consumed, num_params, params))
+		return 0;
+
+	entry = opal_msg_entry_get();
+	if (!entry) {
+		prerror("Allocation failed\n");
+		return OPAL_RESOURCE;
+	}
+
+	entry->consumed = consumed;
+	entry->data = data;
+	memset(&entry->msg, 0, sizeof(entry->msg));
+	entry->msg.msg_type = cpu_to_be32(msg_type);
 	memcpy(entry->msg.params, params, num_params*sizeof(u64));
 
-	list_add_tail(&msg_pending_list, &entry->link);
-	opal_update_pending_evt(OPAL_EVENT_MSG_PENDING,
-				OPAL_EVENT_MSG_PENDING);
+	do {
+		head = msg_queue;
+		entry->next = head;
+	} while (!__sync_bool_compare_and_swap(&msg_queue, head, entry));
 
-	unlock(&opal_msg_lock);
+	/* Hand it over now unless someone else is already at it */
+	if (try_lock(&opal_msg_lock)) {
+		opal_msg_flush_queue();
+		unlock(&opal_msg_lock);
+	}
+
+	/* The CAS above orders this against opal_msg_update_evt() */
+	if (!(opal_pending_events & OPAL_EVENT_MSG_PENDING))
+		opal_update_pending_evt(OPAL_EVENT_MSG_PENDING,
+					OPAL_EVENT_MSG_PENDING);
 
 	return 0;
 }
@@ -81,10 +480,14 @@ static int64_t opal_get_msg(uint64_t *buffer, uint64_t size)
 	if (size < sizeof(struct opal_msg) || !buffer)
 		return OPAL_PARAMETER;
 
+	opal_msg_ring_reclaim();
+
 	lock(&opal_msg_lock);
+	opal_msg_flush_queue();
 
 	entry = list_pop(&msg_pending_list, struct opal_msg_entry, link);
 	if (!entry) {
+		opal_msg_update_evt();
 		unlock(&opal_msg_lock);
 		return OPAL_RESOURCE;
 	}
@@ -93,9 +496,8 @@ static int64_t opal_get_msg(uint64_t *buffer, uint64_t size)
 	callback = entry->consumed;
 	data = entry->data;
 
-	list_add(&msg_free_list, &entry->link);
-	if (list_empty(&msg_pending_list))
-		opal_update_pending_evt(OPAL_EVENT_MSG_PENDING, 0);
+	opal_msg_entry_put(entry);
+	opal_msg_update_evt();
 
 	unlock(&opal_msg_lock);
 
@@ -114,25 +516,30 @@ static int64_t opal_check_completion(uint64_t *buffer, uint64_t size,
 	int rc = OPAL_BUSY;
 	void *data = NULL;
 
+	/* With the host using the slots, this is just a memory read */
+	if (opal_async_comp_take(token, buffer, size))
+		return OPAL_SUCCESS;
+
+	opal_msg_ring_reclaim();
+
 	lock(&opal_msg_lock);
+	opal_msg_flush_queue();
 	list_for_each_safe(&msg_pending_list, entry, next_entry, link) {
 		if (entry->msg.msg_type == OPAL_MSG_ASYNC_COMP &&
 		    be64_to_cpu(entry->msg.params[0]) == token) {
 			list_del(&entry->link);
 			callback = entry->consumed;
 			data = entry->data;
-			list_add(&msg_free_list, &entry->link);
-			if (list_empty(&msg_pending_list))
-				opal_update_pending_evt(OPAL_EVENT_MSG_PENDING,
-							0);
+			if (size >= sizeof(struct opal_msg))
+				memcpy(buffer, &entry->msg,
+				       sizeof(entry->msg));
+			opal_msg_entry_put(entry);
+			opal_msg_update_evt();
 			rc = OPAL_SUCCESS;
 			break;
 		}
 	}
 
-	if (rc == OPAL_SUCCESS && size >= sizeof(struct opal_msg))
-		memcpy(buffer, &entry->msg, sizeof(entry->msg));
-
 	unlock(&opal_msg_lock);
 
 	if (callback)
@@ -143,24 +550,77 @@ static int64_t opal_check_completion(uint64_t *buffer, uint64_t size,
 }
 opal_call(OPAL_CHECK_ASYNC_COMPLETION, opal_check_completion, 3);
 
+static void opal_init_msg_ring(void)
+{
+	size_t size;
+
+	size = sizeof(*msg_ring) +
+		OPAL_MSG_RING_ENTRIES * sizeof(struct opal_msg);
+	msg_ring = memalign(0x1000, size);
+	if (!msg_ring) {
+		prerror("Failed to allocate message ring\n");
+		return;
+	}
+
+	memset(msg_ring, 0, size);
+	msg_ring->magic = cpu_to_be32(OPAL_MSG_RING_MAGIC);
+	msg_ring->nr_entries = cpu_to_be32(OPAL_MSG_RING_ENTRIES);
+	msg_ring->entry_size = cpu_to_be32(sizeof(struct opal_msg));
+
+	if (opal_node)
+		dt_add_property_u64s(opal_node, "ibm,opal-msg-ring",
+				     (u64)msg_ring, size);
+
+	opal_add_poller(opal_msg_ring_poll, NULL);
+	opal_add_host_sync_notifier(opal_msg_ring_host_sync, NULL);
+}
+
+static void opal_init_async_comp(void)
+{
+	size_t size;
+
+	size = sizeof(*async_comp) +
+		OPAL_ASYNC_COMP_SLOTS * sizeof(struct opal_async_comp_slot);
+	async_comp = zalloc(size);
+	if (!async_comp) {
+		prerror("Failed to allocate async completion slots\n");
+		return;
+	}
+
+	async_comp->magic = cpu_to_be32(OPAL_ASYNC_COMP_MAGIC);
+	async_comp->nr_slots = cpu_to_be32(OPAL_ASYNC_COMP_SLOTS);
+
+	if (opal_node)
+		dt_add_property_u64s(opal_node, "ibm,opal-async-comp",
+				     (u64)async_comp, size);
+}
+
 void opal_init_msg(void)
 {
 	struct opal_msg_entry *entry;
 	int i;
 
+	if (!msg_ring)
+		opal_init_msg_ring();
+	if (!async_comp)
+		opal_init_async_comp();
+
 	for (i = 0; i < OPAL_MAX_MSGS; i++, entry++) {
                 entry = zalloc(sizeof(*entry));
                 if (!entry)
                         goto err;
 		list_add_tail(&msg_free_list, &entry->link);
+		msg_free_count++;
         }
         return;
 
 err:
         for (; i > 0; i--) {
                 entry = list_pop(&msg_free_list, struct opal_msg_entry, link);
-                if (entry)
+                if (entry) {
                         free(entry);
+                        msg_free_count--;
+                }
         }
 }
 
@@ -342,6 +342,13 @@ static int64_t opal_pci_msi_eoi(uint64_t phb_id,
 
 	if (!phb)
 		return OPAL_PARAMETER;
+
+	/* EOIs are hot, skip the PHB lock when the backend allows it */
+	if (phb->ops->pci_msi_eoi_nolock) {
+		rc = phb->ops->pci_msi_eoi_nolock(phb, hwirq);
+		pci_put_phb(phb);
+		return rc;
+	}
 	if (!phb->ops->pci_msi_eoi)
 		return OPAL_UNSUPPORTED;
 	phb->ops->lock(phb);
@@ -481,6 +488,156 @@ static int64_t opal_pci_map_pe_dma_window_real(uint64_t phb_id,
 }
 opal_call(OPAL_PCI_MAP_PE_DMA_WINDOW_REAL, opal_pci_map_pe_dma_window_real, 5);
 
+#define PCI_PE_CONFIG_ALL	(OPAL_PCI_PE_CONFIG_RID |	\
+				 OPAL_PCI_PE_CONFIG_PELTV |	\
+				 OPAL_PCI_PE_CONFIG_MVE |	\
+				 OPAL_PCI_PE_CONFIG_DMA |	\
+				 OPAL_PCI_PE_CONFIG_DMA_REAL)
+
+/* Entries converted per round in OPAL_PCI_SET_PE_BATCH, kept small
+ * enough for the on-stack copy to stay well inside the frame limit
+ */
+#define PCI_PE_CONFIG_CHUNK	8
+
+/* Used when the PHB has no set_pe_batch() of its own */
+static int64_t pci_pe_config_one(struct phb *phb, struct pci_pe_config *c)
+{
+	const struct phb_ops *ops = phb->ops;
+	int64_t rc;
+
+	if (c->flags & OPAL_PCI_PE_CONFIG_RID) {
+		if (!ops->set_pe)
+			return OPAL_UNSUPPORTED;
+		rc = ops->set_pe(phb, c->pe_number, c->bus_dev_func,
+				 c->bus_compare, c->dev_compare,
+				 c->func_compare, c->pe_action);
+		if (rc)
+			return rc;
+	}
+	if (c->flags & OPAL_PCI_PE_CONFIG_PELTV) {
+		if (!ops->set_peltv)
+			return OPAL_UNSUPPORTED;
+		rc = ops->set_peltv(phb, c->parent_pe, c->pe_number,
+				    c->peltv_state);
+		if (rc)
+			return rc;
+	}
+	if (c->flags & OPAL_PCI_PE_CONFIG_MVE) {
+		if (!ops->set_mve || !ops->set_mve_enable)
+			return OPAL_UNSUPPORTED;
+		rc = ops->set_mve(phb, c->mve_number, c->pe_number);
+		if (rc)
+			return rc;
+		rc = ops->set_mve_enable(phb, c->mve_number, OPAL_ENABLE_MVE);
+		if (rc)
+			return rc;
+	}
+	if (c->flags & OPAL_PCI_PE_CONFIG_DMA) {
+		if (!ops->map_pe_dma_window)
+			return OPAL_UNSUPPORTED;
+		rc = ops->map_pe_dma_window(phb, c->pe_number, c->window_id,
+					    c->tce_levels, c->dma_addr,
+					    c->dma_size, c->tce_page_size);
+		if (rc)
+			return rc;
+	}
+	if (c->flags & OPAL_PCI_PE_CONFIG_DMA_REAL) {
+		if (!ops->map_pe_dma_window_real)
+			return OPAL_UNSUPPORTED;
+		rc = ops->map_pe_dma_window_real(phb, c->pe_number,
+						 c->window_id, c->dma_addr,
+						 c->dma_size);
+		if (rc)
+			return rc;
+	}
+
+	return OPAL_SUCCESS;
+}
+
+static int64_t pci_set_pe_batch(struct phb *phb, struct pci_pe_config *cfg,
+				unsigned int count)
+{
+	int64_t rc = OPAL_SUCCESS;
+	unsigned int i;
+
+	if (phb->ops->set_pe_batch)
+		return phb->ops->set_pe_batch(phb, cfg, count);
+
+	for (i = 0; i < count; i++) {
+		if (cfg[i].rc)
+			continue;
+		cfg[i].rc = pci_pe_config_one(phb, &cfg[i]);
+		if (cfg[i].rc && rc == OPAL_SUCCESS)
+			rc = cfg[i].rc;
+	}
+	return rc;
+}
+
+static int64_t opal_pci_set_pe_batch(uint64_t phb_id,
+				     struct opal_pci_pe_config *entries,
+				     uint64_t count)
+{
+	struct pci_pe_config cfg[PCI_PE_CONFIG_CHUNK];
+	struct opal_pci_pe_config *e;
+	int64_t rc = OPAL_SUCCESS;
+	struct phb *phb;
+	unsigned int i, j, n;
+
+	if (!entries || !count || count > OPAL_PCI_PE_CONFIG_MAX)
+		return OPAL_PARAMETER;
+
+	phb = pci_get_phb(phb_id);
+	if (!phb)
+		return OPAL_PARAMETER;
+
+	phb->ops->lock(phb);
+	for (i = 0; i < count; i += n) {
+		n = count - i;
+		if (n > ARRAY_SIZE(cfg))
+			n = ARRAY_SIZE(cfg);
+
+		for (j = 0; j < n; j++) {
+			e = &entries[i + j];
+			cfg[j].flags = be32_to_cpu(e->flags);
+			cfg[j].pe_number = be32_to_cpu(e->pe_number);
+			cfg[j].bus_dev_func = be64_to_cpu(e->bus_dev_func);
+			cfg[j].bus_compare = e->bus_compare;
+			cfg[j].dev_compare = e->dev_compare;
+			cfg[j].func_compare = e->func_compare;
+			cfg[j].pe_action = e->pe_action;
+			cfg[j].peltv_state = e->peltv_state;
+			cfg[j].parent_pe = be32_to_cpu(e->parent_pe);
+			cfg[j].mve_number = be32_to_cpu(e->mve_number);
+			cfg[j].window_id = be16_to_cpu(e->window_id);
+			cfg[j].tce_levels = be16_to_cpu(e->tce_levels);
+			cfg[j].dma_addr = be64_to_cpu(e->dma_addr);
+			cfg[j].dma_size = be64_to_cpu(e->dma_size);
+			cfg[j].tce_page_size = be64_to_cpu(e->tce_page_size);
+			cfg[j].rc = OPAL_SUCCESS;
+
+			/* Entries with rc already set are skipped */
+			if (!cfg[j].flags || (cfg[j].flags & ~PCI_PE_CONFIG_ALL) ||
+			    ((cfg[j].flags & OPAL_PCI_PE_CONFIG_DMA) &&
+			     (cfg[j].flags & OPAL_PCI_PE_CONFIG_DMA_REAL)))
+				cfg[j].rc = OPAL_PARAMETER;
+		}
+
+		/* The entries have the status, in order */
+		pci_set_pe_batch(phb, cfg, n);
+
+		for (j = 0; j < n; j++) {
+			if (cfg[j].rc && rc == OPAL_SUCCESS)
+				rc = cfg[j].rc;
+			entries[i + j].rc = cpu_to_be64(cfg[j].rc);
+		}
+	}
+	phb->ops->unlock(phb);
+	pci_put_phb(phb);
+
+	return rc;
+}
+opal_call(OPAL_PCI_SET_PE_BATCH, opal_pci_set_pe_batch, 3);
+
 static int64_t opal_pci_reset(uint64_t phb_id, uint8_t reset_scope,
                               uint8_t assert_state)
 {
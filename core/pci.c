@@ -25,6 +25,9 @@
 #define MAX_PHB_ID	256
 static struct phb *phbs[MAX_PHB_ID];
 
+/* Leave out device node properties Linux reads from config space */
+static bool pci_compact_nodes;
+
 #define PCITRACE(_p, _bdfn, fmt, a...) \
 	prlog(PR_TRACE, "PHB#%04x:%02x:%02x.%x " fmt,	\
 	      (_p)->opal_id,				\
@@ -1150,9 +1153,15 @@ void pci_std_swizzle_irq_map(struct dt_node *np,
 	free(map);
 }
 
-static void pci_add_slot_properties(struct phb *phb, struct pci_slot_info *info,
-				    struct dt_node *np)
+/*
+ * Returns the slot location code, which lives in the property, so that
+ * the nodes below can inherit it without walking back up the tree.
+ */
+static const char *pci_add_slot_properties(struct phb *phb,
+					   struct pci_slot_info *info,
+					   struct dt_node *np)
 {
+	const struct dt_property *prop = NULL;
 	char loc_code[LOC_CODE_SIZE];
 	size_t base_loc_code_len = 0, slot_label_len = 0;
 
@@ -1168,8 +1177,8 @@ static void pci_add_slot_properties(struct phb *phb, struct pci_slot_info *info,
 			if (base_loc_code_len)
 				strcat(loc_code, "-");
 			strcat(loc_code, info->label);
-			dt_add_property(np, "ibm,slot-location-code",
-					loc_code, strlen(loc_code) + 1);
+			prop = dt_add_property(np, "ibm,slot-location-code",
+					       loc_code, strlen(loc_code) + 1);
 		} else {
 			PCIERR(phb, 0, "Loc Code too long - %zu + %zu + 1\n",
 			       base_loc_code_len, slot_label_len);
@@ -1194,32 +1203,41 @@ static void pci_add_slot_properties(struct phb *phb, struct pci_slot_info *info,
 		dt_add_property_cells(np, "ibm,slot-attn-led-ctl", info->attn_led_ctl);
 	if (strlen(info->label) > 0)
 		dt_add_property_string(np, "ibm,slot-label", info->label);
+
+	return prop ? prop->prop : NULL;
 }
 
-static void pci_add_loc_code(struct dt_node *np, struct pci_device *pd)
+/* Find the slot location code the PHB's devices start from */
+static const char *pci_phb_loc_code(struct phb *phb)
 {
-	struct dt_node *p = np->parent;
+	struct dt_node *p;
 	const char *blcode = NULL;
+
+	for (p = phb->dt_node; p && !blcode; p = p->parent)
+		blcode = dt_prop_get_def(p, "ibm,slot-location-code", NULL);
+
+	return blcode;
+}
+
+/*
+ * slot_loc is the slot location code of the closest parent that has
+ * one, passed down as we add the nodes.
+ */
+static void pci_add_loc_code(struct dt_node *np, struct pci_device *pd,
+			     uint32_t class_code, const char *slot_loc)
+{
+	const char *blcode = slot_loc;
 	char *lcode;
-	uint32_t class_code;
 	uint8_t class, sub;
 	uint8_t pos, len;
 
 	/* If there is a label assigned to the function, use it on openpower machines */
-	if (pd->slot_info && strlen(pd->slot_info->label) && !fsp_present()) {
+	if (pd->slot_info && strlen(pd->slot_info->label) && !fsp_present())
 		blcode = pd->slot_info->label;
-	} else {
-		/* Look for a parent with a slot-location-code */
-		while (p && !blcode) {
-			blcode = dt_prop_get_def(p, "ibm,slot-location-code", NULL);
-			p = p->parent;
-		}
-	}
 	if (!blcode)
 		return;
 
 	/* ethernet devices get port codes */
-	class_code = dt_prop_get_u32(np, "class-code");
 	class = class_code >> 16;
 	sub = (class_code >> 8) & 0xff;
 
@@ -1310,11 +1328,12 @@ static void pci_print_summary_line(struct phb *phb, struct pci_device *pd,
 
 static void pci_add_one_node(struct phb *phb, struct pci_device *pd,
 			     struct dt_node *parent_node,
-			     struct pci_lsi_state *lstate, uint8_t swizzle)
+			     struct pci_lsi_state *lstate, uint8_t swizzle,
+			     const char *slot_loc)
 {
 	struct pci_device *child;
 	struct dt_node *np;
-	const char *cname;
+	const char *cname, *own_loc = NULL;
 #define MAX_NAME 256
 	char name[MAX_NAME];
 	char compat[MAX_NAME];
@@ -1355,11 +1374,15 @@ static void pci_add_one_node(struct phb *phb, struct pci_device *pd,
 		dt_add_property_cells(np, "ibm,pci-config-space-type", 0);
 	}
 	dt_add_property_cells(np, "class-code", rev_class >> 8);
-	dt_add_property_cells(np, "revision-id", rev_class & 0xff);
 	dt_add_property_cells(np, "vendor-id", vdid & 0xffff);
 	dt_add_property_cells(np, "device-id", vdid >> 16);
-	if (intpin)
-		dt_add_property_cells(np, "interrupts", intpin);
+
+	/* Linux finds these in config space if they aren't there */
+	if (!pci_compact_nodes) {
+		dt_add_property_cells(np, "revision-id", rev_class & 0xff);
+		if (intpin)
+			dt_add_property_cells(np, "interrupts", intpin);
+	}
 
 	/* XXX FIXME: Add a few missing ones such as
 	 *
@@ -1373,10 +1396,10 @@ static void pci_add_one_node(struct phb *phb, struct pci_device *pd,
 
 	/* Add slot properties if needed and iff this is a bridge */
 	if (pd->slot_info && pd->is_bridge)
-		pci_add_slot_properties(phb, pd->slot_info, np);
+		own_loc = pci_add_slot_properties(phb, pd->slot_info, np);
 
 	/* Make up location code */
-	pci_add_loc_code(np, pd);
+	pci_add_loc_code(np, pd, rev_class >> 8, slot_loc);
 
 	/* XXX FIXME: We don't look for BARs, we only put the config space
 	 * entry in the "reg" property. That's enough for Linux and we might
@@ -1421,22 +1444,39 @@ static void pci_add_one_node(struct phb *phb, struct pci_device *pd,
 	 */
 	dt_add_property(np, "ranges", NULL, 0);
 
+	/* Our children inherit our slot's location code, if we have one */
+	if (own_loc)
+		slot_loc = own_loc;
 	list_for_each(&pd->children, child, link)
-		pci_add_one_node(phb, child, np, lstate, swizzle);
+		pci_add_one_node(phb, child, np, lstate, swizzle, slot_loc);
 }
 
 static void pci_add_nodes(struct phb *phb)
 {
 	struct pci_lsi_state *lstate = &phb->lstate;
 	struct pci_device *pd;
+	const char *slot_loc;
 
 	/* If the PHB has its own slot info, add them */
 	if (phb->slot_info)
 		pci_add_slot_properties(phb, phb->slot_info, NULL);
 
 	/* Add all child devices */
+	slot_loc = pci_phb_loc_code(phb);
 	list_for_each(&phb->devices, pd, link)
-		pci_add_one_node(phb, pd, phb->dt_node, lstate, 0);
+		pci_add_one_node(phb, pd, phb->dt_node, lstate, 0, slot_loc);
+}
+
+/*
+ * Each PHB has its own subtree, so the device nodes are added by the
+ * same job that scanned it, in parallel with the other PHBs.
+ */
+static void pci_probe_phb(void *data)
+{
+	struct phb *phb = data;
+
+	pci_scan_phb(phb);
+	pci_add_nodes(phb);
 }
 
 static void pci_fixup_nodes(struct phb *phb)
@@ -1514,23 +1554,18 @@ void pci_init_slots(void)
 {
 	unsigned int i;
 
+	pci_compact_nodes = dt_has_node_property(dt_chosen,
+					"sapphire,pci-compact-nodes", NULL);
+
 	prlog(PR_NOTICE, "PCI: Resetting PHBs...\n");
 	pci_do_jobs(pci_reset_phb);
 
 	prlog(PR_NOTICE, "PCI: Probing slots...\n");
-	pci_do_jobs(pci_scan_phb);
+	pci_do_jobs(pci_probe_phb);
 
 	if (platform.pci_probe_complete)
 		platform.pci_probe_complete();
 
-	prlog(PR_DEBUG, "PCI Summary:\n");
-
-	for (i = 0; i < ARRAY_SIZE(phbs); i++) {
-		if (!phbs[i])
-			continue;
-		pci_add_nodes(phbs[i]);
-	}
-
 	/* Do device node fixups now that all the devices have been
 	 * added to the device tree. */
 	for (i = 0; i < ARRAY_SIZE(phbs); i++) {
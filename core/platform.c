@@ -38,6 +38,7 @@ static int64_t opal_cec_power_down(uint64_t request)
 	printf("OPAL: Shutdown request type 0x%llx...\n", request);
 
 	flush_console_driver();
+	nvram_flush();
 
 	if (platform.cec_power_down)
 		return platform.cec_power_down(request);
@@ -51,6 +52,7 @@ static int64_t opal_cec_reboot(void)
 	printf("OPAL: Reboot request...\n");
 
 	flush_console_driver();
+	nvram_flush();
 
 #ifdef ENABLE_FAST_RESET
 	/* Try a fast reset first */
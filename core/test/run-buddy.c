@@ -0,0 +1,95 @@
+/* Copyright 2016 IBM Corp.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <buddy.h>
+#include <stdlib.h>
+#include <ccan/array_size/array_size.h>
+
+#define zalloc(size) calloc(1, (size))
+
+#include "../buddy.c"
+
+#define POOL_ORDER	20
+#define MIN_ORDER	12
+
+static void *all[1 << (POOL_ORDER - MIN_ORDER)];
+
+int main(void)
+{
+	void *base, *a, *b, *c, *d;
+	struct buddy *bd;
+	unsigned int i;
+
+	assert(buddy_order(1) == 0);
+	assert(buddy_order(0x1000) == 12);
+	assert(buddy_order(0x1001) == 13);
+
+	base = aligned_alloc(1ul << POOL_ORDER, 1ul << POOL_ORDER);
+	assert(base);
+	bd = buddy_create(base, POOL_ORDER, MIN_ORDER);
+	assert(bd);
+	assert(bd->free_bytes == 1ul << POOL_ORDER);
+
+	/* Too big */
+	assert(!buddy_alloc(bd, POOL_ORDER + 1));
+
+	/* Allocations are naturally aligned and packed */
+	a = buddy_alloc(bd, 17);
+	assert(a == base);
+	b = buddy_alloc(bd, 12);
+	assert(b == base + 0x20000);
+	c = buddy_alloc(bd, 18);
+	assert(c == base + 0x40000);
+	d = buddy_alloc(bd, 13);
+	assert(d == base + 0x22000);
+	assert(((unsigned long)c & ((1ul << 18) - 1)) == 0);
+
+	/* Small orders are rounded up to the minimum */
+	assert(buddy_alloc(bd, 3) == base + 0x21000);
+
+	/* Freeing coalesces everything back to a single block */
+	buddy_free(bd, base + 0x21000);
+	buddy_free(bd, b);
+	buddy_free(bd, d);
+	buddy_free(bd, a);
+	buddy_free(bd, c);
+	assert(bd->free_bytes == 1ul << POOL_ORDER);
+	assert(buddy_alloc(bd, POOL_ORDER) == base);
+	assert(!buddy_alloc(bd, MIN_ORDER));
+	buddy_free(bd, base);
+
+	/* Fill it with minimum blocks, free every other one, then the rest */
+	for (i = 0; i < ARRAY_SIZE(all); i++) {
+		all[i] = buddy_alloc(bd, MIN_ORDER);
+		assert(all[i] == base + (i << MIN_ORDER));
+	}
+	assert(!buddy_alloc(bd, MIN_ORDER));
+	for (i = 0; i < ARRAY_SIZE(all); i += 2)
+		buddy_free(bd, all[i]);
+	assert(!buddy_alloc(bd, MIN_ORDER + 1));
+	for (i = 1; i < ARRAY_SIZE(all); i += 2)
+		buddy_free(bd, all[i]);
+	assert(buddy_alloc(bd, POOL_ORDER) == base);
+	buddy_free(bd, base);
+
+	assert(buddy_contains(bd, base));
+	assert(!buddy_contains(bd, base + (1ul << POOL_ORDER)));
+
+	buddy_destroy(bd);
+	free(base);
+
+	return 0;
+}
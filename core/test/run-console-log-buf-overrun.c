@@ -51,6 +51,12 @@ static inline unsigned long mftb(void)
 char console_buffer[4096];
 struct debug_descriptor debug_descriptor;
 
+bool trace_prlog(int log_level, const char *fmt, va_list ap)
+{
+	(void)log_level; (void)fmt; (void)ap;
+	return false;
+}
+
 bool flushed_to_drivers;
 
 ssize_t console_write(bool flush_to_drivers, const void *buf, size_t count)
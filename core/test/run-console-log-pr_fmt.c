@@ -35,6 +35,12 @@ static inline unsigned long mftb(void)
 
 struct debug_descriptor debug_descriptor;
 
+bool trace_prlog(int log_level, const char *fmt, va_list ap)
+{
+	(void)log_level; (void)fmt; (void)ap;
+	return false;
+}
+
 bool flushed_to_drivers;
 char console_buffer[4096];
 
@@ -35,6 +35,16 @@ int _printf(const char* fmt, ...);
 
 struct debug_descriptor debug_descriptor;
 
+int prlog_traced;
+
+bool trace_prlog(int log_level, const char *fmt, va_list ap)
+{
+	(void)fmt; (void)ap;
+	assert(log_level > (debug_descriptor.console_log_levels & 0x0f));
+	prlog_traced++;
+	return true;
+}
+
 bool flushed_to_drivers;
 char console_buffer[4096];
 
@@ -68,5 +78,18 @@ int main(void)
 	assert(memcmp(console_buffer, "[42,5] Hello World", strlen("[42,5] Hello World")) == 0);
 	assert(flushed_to_drivers==true);
 
+	// Memory only messages go to the trace buffer unformatted
+	debug_descriptor.trace_mask = 1ul << TRACE_PRLOG;
+	memset(console_buffer, 0, sizeof(console_buffer));
+	prlog(PR_DEBUG, "Hello World");
+	assert(prlog_traced == 1);
+	assert(console_buffer[0] == 0);
+
+	// ...but anything for the drivers is still formatted
+	prlog(PR_NOTICE, "Hello World");
+	assert(prlog_traced == 1);
+	assert(memcmp(console_buffer, "[42,5] Hello World", strlen("[42,5] Hello World")) == 0);
+	assert(flushed_to_drivers==true);
+
 	return 0;
 }
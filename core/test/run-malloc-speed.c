@@ -43,6 +43,7 @@ static inline void real_free(void *p)
 #define is_rodata(p) true
 #include "../malloc.c"
 #include "../mem_region.c"
+#include "../buddy.c"
 #include "../device.c"
 
 #undef malloc
@@ -25,6 +25,7 @@ struct cpu_thread {
 };
 
 #include <stdlib.h>
+#include <string.h>
 
 static void *real_malloc(size_t size)
 {
@@ -46,6 +47,7 @@ static void real_free(void *p)
 /* We need mem_region to accept __location__ */
 #define is_rodata(p) true
 #include "../mem_region.c"
+#include "../buddy.c"
 #include "../malloc.c"
 
 /* But we need device tree to make copies of names. */
@@ -56,6 +58,7 @@ static void real_free(void *p)
 #include "../device.c"
 #include <assert.h>
 #include <stdio.h>
+#include <time.h>
 
 void lock(struct lock *l)
 {
@@ -185,15 +188,108 @@ static void run_test(struct test *test)
 	}
 }
 
+/* The list walk we had before the region index, as a reference */
+static bool naive_range_is_reserved(uint64_t start, uint64_t size)
+{
+	uint64_t end = start + size;
+	struct mem_region *region;
+
+	for (;;) {
+		bool found = false;
+
+		list_for_each(&regions, region, list) {
+			if (!region_is_reserved(region))
+				continue;
+			if (region->start <= start &&
+					region->start + region->len > start &&
+					region->len) {
+				start = region->start + region->len;
+				found = true;
+			}
+		}
+		if (start >= end)
+			return true;
+		if (!found)
+			return false;
+	}
+}
+
+/* With -b, many more regions (on a bigger heap) and timings */
+#define CHECK_REGIONS	32
+#define BENCH_REGIONS	4096
+#define BENCH_HEAP_ORDER 22
+#define BENCH_STRIDE	0x100
+#define BENCH_LOOKUPS	100000
+
+static bool bench;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Lots of reservations carved out of one memory node */
+static void run_many_regions(uint64_t base)
+{
+	unsigned int nr = bench ? BENCH_REGIONS : CHECK_REGIONS;
+	unsigned int lookups = bench ? BENCH_LOOKUPS : nr * 4;
+	uint64_t start, size;
+	unsigned int i, hits = 0;
+	double t;
 
-int main(void)
+	list_head_init(&regions);
+	mem_region_init();
+
+	t = now();
+	for (i = 0; i < nr; i++) {
+		/* Pairs of adjacent reservations, then a gap */
+		start = base + i * BENCH_STRIDE;
+		if (i & 1)
+			start -= BENCH_STRIDE / 2;
+		mem_reserve_hw("bench", start, BENCH_STRIDE / 2);
+	}
+	if (bench)
+		printf("%u reservations added in %.3fs\n", nr, now() - t);
+
+	srandom(1);
+	for (i = 0; i < 1000; i++) {
+		start = base + random() % (nr * BENCH_STRIDE);
+		size = 1 + random() % (BENCH_STRIDE * 2);
+		assert(mem_range_is_reserved(start, size) ==
+		       naive_range_is_reserved(start, size));
+	}
+
+	t = now();
+	for (i = 0; i < lookups; i++) {
+		start = base + (i % nr) * BENCH_STRIDE;
+		if (mem_range_is_reserved(start, BENCH_STRIDE))
+			hits++;
+	}
+	t = now() - t;
+	/* Only the even strides are covered, by a pair each */
+	assert(hits == lookups / 2);
+	if (bench)
+		printf("%u lookups in %.3fs (%.0f ns each)\n", lookups, t,
+		       t * 1e9 / lookups);
+}
+
+int main(int argc, char *argv[])
 {
+	uint64_t heap_size = TEST_HEAP_SIZE;
 	unsigned int i;
 	void *buf;
 
+	if (argc > 1 && strcmp(argv[1], "-b") == 0) {
+		bench = true;
+		heap_size = 1ULL << BENCH_HEAP_ORDER;
+	}
+
 	/* Use malloc for the heap, so valgrind can find issues. */
-	skiboot_heap.start = (long)real_malloc(TEST_HEAP_SIZE);
-	skiboot_heap.len = TEST_HEAP_SIZE;
+	skiboot_heap.start = (long)real_malloc(heap_size);
+	skiboot_heap.len = heap_size;
 
 	/* shift the OS reserve area out of the way of our playground */
 	skiboot_os_reserve.start = 0x100000;
@@ -209,6 +305,8 @@ int main(void)
 	for (i = 0; i < ARRAY_SIZE(tests); i++)
 		run_test(&tests[i]);
 
+	run_many_regions((unsigned long)buf);
+
 	dt_free(dt_root);
 	real_free(buf);
 	real_free((void *)(long)skiboot_heap.start);
@@ -43,6 +43,7 @@ static inline void real_free(void *p)
 /* We need mem_region to accept __location__ */
 #define is_rodata(p) true
 #include "../mem_region.c"
+#include "../buddy.c"
 
 /* But we need device tree to make copies of names. */
 #undef is_rodata
@@ -46,6 +46,7 @@ static void real_free(void *p)
 #define is_rodata(p) true
 
 #include "../mem_region.c"
+#include "../buddy.c"
 #include "../malloc.c"
 #include "../device.c"
 
@@ -51,6 +51,7 @@ static inline void __free(void *p, const char *location __attribute__((unused)))
 /* We need mem_region to accept __location__ */
 #define is_rodata(p) true
 #include "../mem_region.c"
+#include "../buddy.c"
 
 /* But we need device tree to make copies of names. */
 #undef is_rodata
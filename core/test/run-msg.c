@@ -19,6 +19,12 @@
 #include <assert.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
 
 static bool zalloc_should_fail = false;
 static int zalloc_should_fail_after = 0;
@@ -35,25 +41,101 @@ static void *zalloc(size_t size)
         return calloc(size, 1);
 }
 
+static void *memalign(size_t boundary, size_t size)
+{
+	void *p;
+
+	if (posix_memalign(&p, boundary, size))
+		return NULL;
+	return p;
+}
+
+/* Don't include these, they're PPC-specific */
+#define __PROCESSOR_H
+#define __CPU_H
+#if defined(__i386__) || defined(__x86_64__)
+static void full_barrier(void)
+{
+	asm volatile("mfence" : : : "memory");
+}
+#define lwsync full_barrier
+#define sync full_barrier
+#elif defined(__powerpc__) || defined(__powerpc64__)
+static inline void lwsync(void)
+{
+	asm volatile("lwsync" : : : "memory");
+}
+static inline void sync(void)
+{
+	asm volatile("sync" : : : "memory");
+}
+#else
+#error "Define lwsync for this arch"
+#endif
+
+struct cpu_thread {
+	struct opal_msg_entry *msg_cache;
+	uint32_t msg_cache_len;
+};
+
+/* Thread 0 is main(), the others are test_parallel() producers */
+#define PAR_PRODUCERS	4
+
+static struct cpu_thread fake_cpus[PAR_PRODUCERS + 1];
+static __thread struct cpu_thread *my_fake_cpu = &fake_cpus[0];
+
+static struct cpu_thread *this_cpu(void)
+{
+	return my_fake_cpu;
+}
+
 #include "../opal-msg.c"
 #include <skiboot.h>
 
+struct dt_node *opal_node;
+
+struct dt_property *__dt_add_property_u64s(struct dt_node *node __unused,
+					   const char *name __unused,
+					   int count __unused, ...)
+{
+	return NULL;
+}
+
+void opal_add_poller(void (*poller)(void *data) __unused,
+		     void *data __unused)
+{
+}
+
+void opal_add_host_sync_notifier(bool (*notify)(void *data) __unused,
+				 void *data __unused)
+{
+}
+
+bool try_lock(struct lock *l)
+{
+	return !__sync_lock_test_and_set(&l->lock_val, 1);
+}
+
 void lock(struct lock *l)
 {
-        assert(!l->lock_val);
-        l->lock_val = 1;
+	while (!try_lock(l))
+		sched_yield();
 }
 
 void unlock(struct lock *l)
 {
         assert(l->lock_val);
-        l->lock_val = 0;
+	__sync_lock_release(&l->lock_val);
 }
 
+uint64_t opal_pending_events;
+static struct lock evt_lock;
+
 void opal_update_pending_evt(uint64_t evt_mask, uint64_t evt_values)
 {
-        (void)evt_mask;
-        (void)evt_values;
+	lock(&evt_lock);
+	opal_pending_events = (opal_pending_events & ~evt_mask) | evt_values;
+	unlock(&evt_lock);
 }
 
 static long magic = 8097883813087437089UL;
@@ -72,7 +154,373 @@ static size_t list_count(struct list_head *list)
         return count;
 }
 
-int main(void)
+/* Free entries: the pool and what's cached on our CPU */
+static size_t free_count(void)
+{
+	struct opal_msg_entry *entry;
+	size_t count = list_count(&msg_free_list);
+
+	for (entry = this_cpu()->msg_cache; entry; entry = entry->next)
+		count++;
+	return count;
+}
+
+static int ring_callbacks;
+static void ring_callback(void *data)
+{
+	assert(*(uint64_t *)data == magic);
+	ring_callbacks++;
+}
+
+static void test_ring(void)
+{
+	static struct opal_msg m;
+	uint64_t *m_ptr = (uint64_t *)&m;
+	uint64_t i;
+	int r;
+
+	assert(msg_ring);
+	assert(be32_to_cpu(msg_ring->magic) == OPAL_MSG_RING_MAGIC);
+	assert(be32_to_cpu(msg_ring->nr_entries) == OPAL_MSG_RING_ENTRIES);
+
+	/* The host opts in */
+	msg_ring->flags = cpu_to_be32(OPAL_MSG_RING_HOST_ACTIVE);
+
+	r = opal_queue_msg(OPAL_MSG_ASYNC_COMP, &magic, ring_callback,
+			   (u64)0, (u64)1, (u64)2);
+	assert(r == 0);
+	assert(be64_to_cpu(msg_ring->head) == 1);
+	assert(list_empty(&msg_pending_list));
+	assert(msg_ring->msgs[0].params[2] == 2);
+
+	/* Not consumed by the host yet, nothing to get */
+	r = opal_get_msg(m_ptr, sizeof(m));
+	assert(r == OPAL_RESOURCE);
+	assert(ring_callbacks == 0);
+
+	/* Host consumes it, the callback runs on the next poll */
+	msg_ring->tail = cpu_to_be64(1);
+	opal_msg_ring_poll(NULL);
+	assert(ring_callbacks == 1);
+
+	/* A bogus tail from the host is ignored */
+	msg_ring->tail = cpu_to_be64(1000);
+	opal_msg_ring_poll(NULL);
+	assert(msg_ring_reclaimed == 1);
+	msg_ring->tail = cpu_to_be64(1);
+
+	/* Fill the ring, then spill over to the pending list */
+	for (i = 0; i <= OPAL_MSG_RING_ENTRIES; i++) {
+		r = opal_queue_msg(OPAL_MSG_ASYNC_COMP, &magic, ring_callback,
+				   i);
+		assert(r == 0);
+	}
+	assert(list_count(&msg_pending_list) == 1);
+	assert(be64_to_cpu(msg_ring->full_count) == 1);
+
+	/* Ordering: nothing goes to the ring while the list is non-empty */
+	msg_ring->tail = msg_ring->head;
+	r = opal_queue_msg(OPAL_MSG_ASYNC_COMP, NULL, NULL);
+	assert(r == 0);
+	assert(list_count(&msg_pending_list) == 2);
+
+	/* Draining the list also reclaims the ring */
+	r = opal_get_msg(m_ptr, sizeof(m));
+	assert(r == 0);
+	assert(m.params[0] == OPAL_MSG_RING_ENTRIES);
+	r = opal_get_msg(m_ptr, sizeof(m));
+	assert(r == 0);
+	r = opal_get_msg(m_ptr, sizeof(m));
+	assert(r == OPAL_RESOURCE);
+	assert(ring_callbacks == OPAL_MSG_RING_ENTRIES + 2);
+
+	/* kexec: the ring is handed back to OPAL_GET_MSG */
+	r = opal_queue_msg(OPAL_MSG_ASYNC_COMP, &magic, ring_callback);
+	assert(r == 0);
+	opal_msg_ring_host_sync(NULL);
+	assert(ring_callbacks == OPAL_MSG_RING_ENTRIES + 3);
+	assert(msg_ring->flags == 0 && msg_ring->head == 0);
+
+	r = opal_queue_msg(OPAL_MSG_ASYNC_COMP, NULL, NULL);
+	assert(r == 0);
+	assert(list_count(&msg_pending_list) == 1);
+	r = opal_get_msg(m_ptr, sizeof(m));
+	assert(r == 0);
+
+	free(msg_ring);
+}
+
+static void test_async_comp(void)
+{
+	static struct opal_msg m;
+	uint64_t *m_ptr = (uint64_t *)&m;
+	struct opal_async_comp_slot *slot;
+	int r;
+
+	assert(async_comp);
+	assert(be32_to_cpu(async_comp->magic) == OPAL_ASYNC_COMP_MAGIC);
+	assert(be32_to_cpu(async_comp->nr_slots) == OPAL_ASYNC_COMP_SLOTS);
+
+	/* Not opted in, completions go through messages */
+	r = opal_queue_msg(OPAL_MSG_ASYNC_COMP, NULL, NULL, (u64)3);
+	assert(r == 0);
+	assert(list_count(&msg_pending_list) == 1);
+	r = opal_get_msg(m_ptr, sizeof(m));
+	assert(r == 0);
+	assert(list_empty(&msg_pending_list));
+
+	/* The host opts in */
+	async_comp->flags = cpu_to_be32(OPAL_ASYNC_COMP_HOST_ACTIVE);
+
+	r = opal_queue_msg(OPAL_MSG_ASYNC_COMP, NULL, NULL, (u64)3, (u64)42);
+	assert(r == 0);
+	assert(list_empty(&msg_pending_list));
+	slot = &async_comp->slots[3];
+	assert(be64_to_cpu(slot->state) == OPAL_ASYNC_SLOT_COMPLETE);
+	assert(slot->msg.params[1] == 42);
+	assert(async_comp_evt);
+
+	/* Nothing for other tokens */
+	r = opal_check_completion(m_ptr, sizeof(m), 4);
+	assert(r == OPAL_BUSY);
+
+	r = opal_check_completion(m_ptr, sizeof(m), 3);
+	assert(r == OPAL_SUCCESS);
+	assert(m.params[0] == 3 && m.params[1] == 42);
+	assert(be64_to_cpu(slot->state) == OPAL_ASYNC_SLOT_EMPTY);
+	r = opal_check_completion(m_ptr, sizeof(m), 3);
+	assert(r == OPAL_BUSY);
+
+	/* The event is lowered once the slots are empty */
+	opal_msg_ring_poll(NULL);
+	assert(!async_comp_evt);
+
+	/* Out of range tokens and callbacks fall back to messages */
+	r = opal_queue_msg(OPAL_MSG_ASYNC_COMP, NULL, NULL,
+			   (u64)OPAL_ASYNC_COMP_SLOTS);
+	assert(r == 0);
+	r = opal_queue_msg(OPAL_MSG_ASYNC_COMP, &magic, callback, (u64)5);
+	assert(r == 0);
+	assert(list_count(&msg_pending_list) == 2);
+	assert(be64_to_cpu(async_comp->overflow_count) == 2);
+
+	/* So does a completion for a slot the host hasn't read yet */
+	r = opal_queue_msg(OPAL_MSG_ASYNC_COMP, NULL, NULL, (u64)7);
+	assert(r == 0);
+	r = opal_queue_msg(OPAL_MSG_ASYNC_COMP, NULL, NULL, (u64)7);
+	assert(r == 0);
+	assert(list_count(&msg_pending_list) == 3);
+	assert(be64_to_cpu(async_comp->overflow_count) == 3);
+
+	while (!list_empty(&msg_pending_list)) {
+		r = opal_get_msg(m_ptr, sizeof(m));
+		assert(r == 0);
+	}
+
+	/* kexec: the slots are dropped and the table disabled */
+	opal_msg_ring_host_sync(NULL);
+	assert(async_comp->flags == 0);
+	assert(be64_to_cpu(async_comp->slots[7].state) ==
+	       OPAL_ASYNC_SLOT_EMPTY);
+	assert(!async_comp_evt);
+
+	r = opal_queue_msg(OPAL_MSG_ASYNC_COMP, NULL, NULL, (u64)3);
+	assert(r == 0);
+	assert(list_count(&msg_pending_list) == 1);
+	r = opal_get_msg(m_ptr, sizeof(m));
+	assert(r == 0);
+
+	free(async_comp);
+	async_comp = NULL;
+}
+
+#define PAR_INFLIGHT	4
+
+/* More messages and a report of the throughput with -b */
+static bool bench;
+static unsigned long par_msgs = 5000;
+
+static unsigned long par_inflight[PAR_PRODUCERS];
+static double par_enqueue_ns[PAR_PRODUCERS];
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void *par_producer(void *arg)
+{
+	unsigned long id = (unsigned long)arg;
+	unsigned long seq;
+	double start;
+	int r;
+
+	my_fake_cpu = &fake_cpus[id + 1];
+	for (seq = 0; seq < par_msgs; seq++) {
+		/* Don't outrun the consumer by more than the pool */
+		while (par_inflight[id] >= PAR_INFLIGHT)
+			sched_yield();
+		__sync_fetch_and_add(&par_inflight[id], 1);
+
+		start = now_ns();
+		r = opal_queue_msg(0, NULL, NULL, (u64)id, (u64)seq);
+		par_enqueue_ns[id] += now_ns() - start;
+		assert(r == 0);
+	}
+
+	return NULL;
+}
+
+/* Producers on several CPUs against a single consumer */
+static void test_parallel(void)
+{
+	static struct opal_msg m;
+	uint64_t *m_ptr = (uint64_t *)&m;
+	pthread_t threads[PAR_PRODUCERS];
+	unsigned long next_seq[PAR_PRODUCERS] = { 0 };
+	unsigned long i, id, got = 0, empty = 0;
+	double start, elapsed, enqueue_ns = 0, dequeue_ns = 0, t;
+	int r;
+
+	/* Enough in the pool for everyone's working set */
+	zalloc_should_fail = false;
+	for (i = 0; i < PAR_PRODUCERS * PAR_INFLIGHT; i++) {
+		list_add_tail(&msg_free_list,
+			      &((struct opal_msg_entry *)
+				zalloc(sizeof(struct opal_msg_entry)))->link);
+		msg_free_count++;
+	}
+
+	start = now_ns();
+	for (i = 0; i < PAR_PRODUCERS; i++)
+		assert(!pthread_create(&threads[i], NULL, par_producer,
+				       (void *)i));
+
+	while (got < PAR_PRODUCERS * par_msgs) {
+		t = now_ns();
+		r = opal_get_msg(m_ptr, sizeof(m));
+		if (r == OPAL_RESOURCE) {
+			empty++;
+			sched_yield();
+			continue;
+		}
+		dequeue_ns += now_ns() - t;
+		assert(r == OPAL_SUCCESS);
+
+		/* Each producer's messages come out in order */
+		id = m.params[0];
+		assert(id < PAR_PRODUCERS);
+		assert(m.params[1] == next_seq[id]);
+		next_seq[id]++;
+		__sync_fetch_and_sub(&par_inflight[id], 1);
+		got++;
+	}
+	elapsed = now_ns() - start;
+
+	for (i = 0; i < PAR_PRODUCERS; i++) {
+		assert(!pthread_join(threads[i], NULL));
+		enqueue_ns += par_enqueue_ns[i];
+	}
+
+	r = opal_get_msg(m_ptr, sizeof(m));
+	assert(r == OPAL_RESOURCE);
+	assert(!msg_queue && list_empty(&msg_pending_list));
+
+	if (!bench)
+		return;
+	printf("%d producers, %lu messages in %.1fms: "
+	       "enqueue %.0fns/msg, dequeue %.0fns/msg, "
+	       "%.2fM msgs/s (%lu empty polls)\n",
+	       PAR_PRODUCERS, got, elapsed / 1e6, enqueue_ns / got,
+	       dequeue_ns / got, got * 1e3 / elapsed, empty);
+}
+
+/* Many CPUs sending their first message don't drain the pool */
+static void test_many_cpus(void)
+{
+	static struct cpu_thread cpus[OPAL_MAX_MSGS * 2];
+	static struct opal_msg m;
+	uint64_t *m_ptr = (uint64_t *)&m;
+	struct opal_msg_entry *entry;
+	unsigned int i, cached = 0;
+	int r;
+
+	zalloc_should_fail = true;
+	for (i = 0; i < ARRAY_SIZE(cpus); i++) {
+		my_fake_cpu = &cpus[i];
+		r = opal_queue_msg(0, NULL, NULL, (u64)i);
+		assert(r == 0);
+		r = opal_get_msg(m_ptr, sizeof(m));
+		assert(r == 0 && m.params[0] == i);
+		assert(cpus[i].msg_cache_len <= OPAL_MSG_CPU_CACHE);
+		cached += cpus[i].msg_cache_len;
+	}
+	zalloc_should_fail = false;
+	my_fake_cpu = &fake_cpus[0];
+
+	assert(msg_free_count >= OPAL_MAX_MSGS / 2);
+	assert(msg_free_count + cached + fake_cpus[0].msg_cache_len >=
+	       OPAL_MAX_MSGS);
+
+	/* Give them back to the pool for the rest of the tests */
+	for (i = 0; i < ARRAY_SIZE(cpus); i++) {
+		while ((entry = cpus[i].msg_cache)) {
+			cpus[i].msg_cache = entry->next;
+			list_add_tail(&msg_free_list, &entry->link);
+			msg_free_count++;
+		}
+		cpus[i].msg_cache_len = 0;
+	}
+}
+
+/*
+ * Kept out of main() and split in two: at -O0 each opal_queue_msg()
+ * gets its own array on the stack.
+ */
+static void test_queue_wide(void)
+{
+        static struct opal_msg m;
+        uint64_t *m_ptr = (uint64_t *)&m;
+        int r;
+
+#define test_queue_num(type, val) \
+        r = opal_queue_msg(0, NULL, NULL, \
+                (type)val, (type)val, (type)val, (type)val, \
+                (type)val, (type)val, (type)val, (type)val); \
+        assert(r == 0); \
+        opal_get_msg(m_ptr, sizeof(m)); \
+        assert(r == OPAL_SUCCESS); \
+        assert(m.params[0] == (type)val); \
+        assert(m.params[1] == (type)val); \
+        assert(m.params[2] == (type)val); \
+        assert(m.params[3] == (type)val); \
+        assert(m.params[4] == (type)val); \
+        assert(m.params[5] == (type)val); \
+        assert(m.params[6] == (type)val); \
+        assert(m.params[7] == (type)val)
+
+        test_queue_num(u64, -1);
+        test_queue_num(s64, -1);
+        test_queue_num(u32, -1);
+        test_queue_num(s32, -1);
+}
+
+static void test_queue_narrow(void)
+{
+        static struct opal_msg m;
+        uint64_t *m_ptr = (uint64_t *)&m;
+        int r;
+
+        test_queue_num(u16, -1);
+        test_queue_num(s16, -1);
+        test_queue_num(u8, -1);
+        test_queue_num(s8, -1);
+}
+
+int main(int argc, char *argv[])
 {
         struct opal_msg_entry* entry;
         int free_size = OPAL_MAX_MSGS;
@@ -82,6 +530,11 @@ int main(void)
         static struct opal_msg m;
         uint64_t *m_ptr = (uint64_t *)&m;
 
+	if (argc > 1 && strcmp(argv[1], "-b") == 0) {
+		bench = true;
+		par_msgs = 50000;
+	}
+
 	zalloc_should_fail = true;
 	zalloc_should_fail_after = 3;
 	opal_init_msg();
@@ -90,14 +543,14 @@ int main(void)
 	opal_init_msg();
 
         assert(list_count(&msg_pending_list) == npending);
-        assert(list_count(&msg_free_list) == nfree);
+        assert(free_count() == nfree);
 
         /* Callback. */
         r = opal_queue_msg(0, &magic, callback, (u64)0, (u64)1, (u64)2);
         assert(r == 0);
 
         assert(list_count(&msg_pending_list) == ++npending);
-        assert(list_count(&msg_free_list) == --nfree);
+        assert(free_count() == --nfree);
 
         r = opal_get_msg(m_ptr, sizeof(m));
         assert(r == 0);
@@ -107,33 +560,33 @@ int main(void)
         assert(m.params[2] == 2);
 
         assert(list_count(&msg_pending_list) == --npending);
-        assert(list_count(&msg_free_list) == ++nfree);
+        assert(free_count() == ++nfree);
 
         /* No params. */
         r = opal_queue_msg(0, NULL, NULL);
         assert(r == 0);
 
         assert(list_count(&msg_pending_list) == ++npending);
-        assert(list_count(&msg_free_list) == --nfree);
+        assert(free_count() == --nfree);
 
         r = opal_get_msg(m_ptr, sizeof(m));
         assert(r == 0);
 
         assert(list_count(&msg_pending_list) == --npending);
-        assert(list_count(&msg_free_list) == ++nfree);
+        assert(free_count() == ++nfree);
 
         /* > 8 params (ARRAY_SIZE(entry->msg.params) */
         r = opal_queue_msg(0, NULL, NULL, 0, 1, 2, 3, 4, 5, 6, 7, 0xBADDA7A);
         assert(r == 0);
 
         assert(list_count(&msg_pending_list) == ++npending);
-        assert(list_count(&msg_free_list) == --nfree);
+        assert(free_count() == --nfree);
 
         r = opal_get_msg(m_ptr, sizeof(m));
         assert(r == 0);
 
         assert(list_count(&msg_pending_list) == --npending);
-        assert(list_count(&msg_free_list) == ++nfree);
+        assert(free_count() == ++nfree);
 
         assert(m.params[0] == 0);
         assert(m.params[1] == 1);
@@ -149,13 +602,13 @@ int main(void)
         assert(r == 0);
 
         assert(list_count(&msg_pending_list) == ++npending);
-        assert(list_count(&msg_free_list) == --nfree);
+        assert(free_count() == --nfree);
 
         r = opal_get_msg(m_ptr, sizeof(m));
         assert(r == 0);
 
         assert(list_count(&msg_pending_list) == --npending);
-        assert(list_count(&msg_free_list) == ++nfree);
+        assert(free_count() == ++nfree);
 
         assert(m.params[0] == 0);
         assert(m.params[1] == 10);
@@ -171,9 +624,9 @@ int main(void)
                 r = opal_queue_msg(OPAL_MSG_ASYNC_COMP, NULL, NULL);
                 assert(r == 0);
                 assert(list_count(&msg_pending_list) == ++npending);
-                assert(list_count(&msg_free_list) == --nfree);
+                assert(free_count() == --nfree);
         }
-        assert(list_count(&msg_free_list) == 0);
+        assert(free_count() == 0);
         assert(nfree == 0);
         assert(npending == OPAL_MAX_MSGS);
 
@@ -182,7 +635,7 @@ int main(void)
 
         assert(list_count(&msg_pending_list) == OPAL_MAX_MSGS+1);
         assert(list_count(&msg_pending_list) == ++npending);
-        assert(list_count(&msg_free_list) == nfree);
+        assert(free_count() == nfree);
 
         /* Make zalloc fail to test error handling. */
         zalloc_should_fail = true;
@@ -191,7 +644,7 @@ int main(void)
 
         assert(list_count(&msg_pending_list) == OPAL_MAX_MSGS+1);
         assert(list_count(&msg_pending_list) == npending);
-        assert(list_count(&msg_free_list) == nfree);
+        assert(free_count() == nfree);
 
         /* Empty list (no nodes). */
         while(!list_empty(&msg_pending_list)) {
@@ -201,7 +654,7 @@ int main(void)
                 nfree++;
         }
         assert(list_count(&msg_pending_list) == npending);
-        assert(list_count(&msg_free_list) == nfree);
+        assert(free_count() == nfree);
         assert(npending == 0);
         assert(nfree == OPAL_MAX_MSGS+1);
 
@@ -209,7 +662,7 @@ int main(void)
         assert(r == 0);
 
         assert(list_count(&msg_pending_list) == ++npending);
-        assert(list_count(&msg_free_list) == --nfree);
+        assert(free_count() == --nfree);
 
         /* Request invalid size. */
         r = opal_get_msg(m_ptr, sizeof(m) - 1);
@@ -226,31 +679,14 @@ int main(void)
         r = opal_get_msg(m_ptr, sizeof(m));
         assert(r == OPAL_RESOURCE);
 
-#define test_queue_num(type, val) \
-        r = opal_queue_msg(0, NULL, NULL, \
-                (type)val, (type)val, (type)val, (type)val, \
-                (type)val, (type)val, (type)val, (type)val); \
-        assert(r == 0); \
-        opal_get_msg(m_ptr, sizeof(m)); \
-        assert(r == OPAL_SUCCESS); \
-        assert(m.params[0] == (type)val); \
-        assert(m.params[1] == (type)val); \
-        assert(m.params[2] == (type)val); \
-        assert(m.params[3] == (type)val); \
-        assert(m.params[4] == (type)val); \
-        assert(m.params[5] == (type)val); \
-        assert(m.params[6] == (type)val); \
-        assert(m.params[7] == (type)val)
-
         /* Test types of various widths */
-        test_queue_num(u64, -1);
-        test_queue_num(s64, -1);
-        test_queue_num(u32, -1);
-        test_queue_num(s32, -1);
-        test_queue_num(u16, -1);
-        test_queue_num(s16, -1);
-        test_queue_num(u8, -1);
-        test_queue_num(s8, -1);
+        test_queue_wide();
+        test_queue_narrow();
+
+        test_many_cpus();
+        test_parallel();
+        test_async_comp();
+        test_ring();
 
         /* Clean up the list to keep valgrind happy. */
         while(!list_empty(&msg_free_list)) {
@@ -265,5 +701,12 @@ int main(void)
                 free(entry);
         }
 
+	for (r = 0; r < ARRAY_SIZE(fake_cpus); r++) {
+		while ((entry = fake_cpus[r].msg_cache)) {
+			fake_cpus[r].msg_cache = entry->next;
+			free(entry);
+		}
+	}
+
         return 0;
 }
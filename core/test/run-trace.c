@@ -23,6 +23,8 @@
 #include <unistd.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdarg.h>
+#include <string.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 
@@ -98,6 +100,19 @@ static void *local_alloc(unsigned int chip_id,
 struct dt_node;
 extern struct dt_node *opal_node;
 
+#include <skiboot.h>
+
+/* Override this for testing. */
+#define is_rodata(p) fake_is_rodata(p)
+
+char __rodata_start[64];
+#define __rodata_end (__rodata_start + sizeof(__rodata_start))
+
+static inline bool fake_is_rodata(const void *p)
+{
+	return ((char *)p >= __rodata_start && (char *)p < __rodata_end);
+}
+
 #include "../trace.c"
 
 #define rmb() lwsync()
@@ -105,7 +120,6 @@ extern struct dt_node *opal_node;
 #include "../external/trace/trace.c"
 #include "../device.c"
 
-char __rodata_start[1], __rodata_end[1];
 struct dt_node *opal_node;
 struct debug_descriptor debug_descriptor = {
 	.trace_mask = -1
@@ -259,6 +273,60 @@ static void test_parallel(void)
 	 */
 }
 
+static bool prlog_args(int log_level, const char *fmt, ...)
+{
+	va_list ap;
+	bool ret;
+
+	va_start(ap, fmt);
+	ret = trace_prlog(log_level, fmt, ap);
+	va_end(ap);
+
+	return ret;
+}
+
+static void test_prlog(void)
+{
+	const char *fmt = __rodata_start, *str = __rodata_start + 32;
+	const char *fmt_s = __rodata_start + 40;
+	char big[TRACE_PRLOG_DATA];
+	union trace trace;
+	__be64 v;
+
+	strcpy(__rodata_start, "%s %08x %s 100%%");
+	strcpy(__rodata_start + 32, "chip");
+	strcpy(__rodata_start + 40, "%s");
+
+	/* The format string has to be found in the ELF by the reader */
+	assert(!prlog_args(PR_DEBUG, "%d", 1));
+
+	/* Strings that don't fit in the record are formatted as usual */
+	memset(big, 'x', sizeof(big) - 1);
+	big[sizeof(big) - 1] = '\0';
+	assert(!prlog_args(PR_DEBUG, fmt_s, big));
+
+	timestamp = 7;
+	assert(prlog_args(PR_DEBUG, fmt, str, 0x1234, "hello"));
+	assert(trace_get(&trace, &my_fake_cpu->trace->tb));
+	assert(trace.hdr.type == TRACE_PRLOG);
+	assert(be64_to_cpu(trace.hdr.timestamp) == 7);
+	assert(trace.hdr.len_div_8 * 8 ==
+	       offsetof(struct trace_prlog, data) + 4 * sizeof(v));
+	assert(be32_to_cpu(trace.prlog.fmt) == 0);
+	assert(trace.prlog.level == PR_DEBUG);
+
+	/* A .rodata string is an offset */
+	memcpy(&v, trace.prlog.data, sizeof(v));
+	assert(be64_to_cpu(v) == 32);
+	memcpy(&v, trace.prlog.data + 8, sizeof(v));
+	assert((u32)be64_to_cpu(v) == 0x1234);
+	/* Anything else is copied */
+	memcpy(&v, trace.prlog.data + 16, sizeof(v));
+	assert(be64_to_cpu(v) == (TRACE_PRLOG_INLINE | 5));
+	assert(memcmp(trace.prlog.data + 24, "hello\0\0\0", 8) == 0);
+	assert(!trace_get(&trace, &my_fake_cpu->trace->tb));
+}
+
 int main(void)
 {
 	union trace minimal;
@@ -385,6 +453,8 @@ int main(void)
 		assert(!trace_get(&trace, &my_fake_cpu->trace->tb));
 	}
 
+	test_prlog();
+
 	for (i = 0; i < CPUS; i++)
 		if (!fake_cpus[i].is_secondary)
 			free(fake_cpus[i].trace);
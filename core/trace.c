@@ -161,6 +161,72 @@ void trace_add(union trace *trace, u8 type, u16 len)
 	unlock(&ti->lock);
 }
 
+/* Is this a conversion character for our libc vsnprintf()? */
+static bool prlog_conv(char c)
+{
+	return c == 'd' || c == 'i' || c == 'u' || c == 'x' || c == 'X' ||
+		c == 'p' || c == 'c' || c == 's' || c == '%' ||
+		c == 'O' || c == 'o';
+}
+
+bool trace_prlog(int log_level, const char *fmt, va_list ap)
+{
+	union trace trace;
+	struct trace_prlog *t = &trace.prlog;
+	const char *p, *s;
+	unsigned int n = 0;
+	size_t len;
+	u64 v;
+
+	/* The reader needs to find the format string in the ELF */
+	if (!is_rodata(fmt) || !this_cpu()->trace)
+		return false;
+
+	for (p = fmt; *p; p++) {
+		if (*p != '%')
+			continue;
+		do {
+			p++;
+		} while (*p && !prlog_conv(*p));
+		if (!*p)
+			break;
+		if (*p == '%')
+			continue;
+
+		if (n + sizeof(v) > sizeof(t->data))
+			return false;
+		v = (unsigned long)va_arg(ap, void *);
+		len = 0;
+		if (*p == 's') {
+			s = (const char *)v;
+			if (s && is_rodata(s))
+				v = s - __rodata_start;
+			else {
+				if (!s)
+					s = "(null)";
+				len = strlen(s);
+				if (n + sizeof(v) + len > sizeof(t->data))
+					return false;
+				memcpy(t->data + n + sizeof(v), s, len);
+				memset(t->data + n + sizeof(v) + len, 0,
+				       ALIGN_UP(len, sizeof(v)) - len);
+				v = TRACE_PRLOG_INLINE | len;
+				len = ALIGN_UP(len, sizeof(v));
+			}
+		}
+		v = cpu_to_be64(v);
+		memcpy(t->data + n, &v, sizeof(v));
+		n += sizeof(v) + len;
+	}
+
+	t->fmt = cpu_to_be32(fmt - __rodata_start);
+	t->level = log_level;
+	memset(t->unused, 0, sizeof(t->unused));
+	trace_add(&trace, TRACE_PRLOG, offsetof(struct trace_prlog, data) + n);
+
+	return true;
+}
+
 static void trace_add_dt_props(void)
 {
 	unsigned int i;
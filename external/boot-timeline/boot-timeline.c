@@ -0,0 +1,377 @@
+/* Copyright 2016 IBM Corp.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Dump the skiboot boot timeline, either straight from a running system
+ * (device-tree + /dev/mem) or from a file saved with -o, as CSV or as a
+ * text Gantt chart.
+ */
+
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <string.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <unistd.h>
+
+#include "../../ccan/endian/endian.h"
+#include "../../ccan/short_types/short_types.h"
+#include <boot_timeline_types.h>
+
+#define DT_PROP "/proc/device-tree/ibm,opal/ibm,opal-boot-timeline"
+
+struct entry {
+	u64	start;
+	u64	end;
+	u16	pir;
+	u8	type;
+	u8	flags;
+	char	name[BOOT_TIMELINE_NAME_LEN + 1];
+};
+
+static u64 tb_hz;
+
+static void *read_all(int fd, size_t *len)
+{
+	size_t size = 0, alloc = 0x10000;
+	char *buf = malloc(alloc);
+	ssize_t r;
+
+	while (buf) {
+		if (size == alloc)
+			buf = realloc(buf, alloc *= 2);
+		if (!buf)
+			break;
+		r = read(fd, buf + size, alloc - size);
+		if (r < 0)
+			err(1, "read");
+		if (r == 0)
+			break;
+		size += r;
+	}
+	if (!buf)
+		errx(1, "Out of memory");
+	*len = size;
+	return buf;
+}
+
+/* Fetch the raw timeline from memory, as advertised by skiboot */
+static void *read_live(size_t *len)
+{
+	__be64 prop[2];
+	u64 addr, size;
+	void *buf;
+	int fd;
+
+	fd = open(DT_PROP, O_RDONLY);
+	if (fd < 0)
+		err(1, "Can't open %s", DT_PROP);
+	if (read(fd, prop, sizeof(prop)) != sizeof(prop))
+		errx(1, "Malformed %s", DT_PROP);
+	close(fd);
+
+	addr = be64_to_cpu(prop[0]);
+	size = be64_to_cpu(prop[1]);
+
+	fd = open("/dev/mem", O_RDONLY);
+	if (fd < 0)
+		err(1, "Can't open /dev/mem");
+	buf = malloc(size);
+	if (!buf)
+		errx(1, "Out of memory");
+	if (pread(fd, buf, size, addr) != size)
+		err(1, "Can't read timeline at 0x%" PRIx64, addr);
+	close(fd);
+
+	*len = size;
+	return buf;
+}
+
+static int cmp_entry(const void *a, const void *b)
+{
+	const struct entry *ea = a, *eb = b;
+
+	if (ea->start != eb->start)
+		return ea->start < eb->start ? -1 : 1;
+	return 0;
+}
+
+static struct entry *parse(const void *buf, size_t len, unsigned int *count)
+{
+	const struct boot_timeline *hdr = buf;
+	const struct boot_timeline_entry *be;
+	struct entry *entries;
+	unsigned int i, nr, esize;
+
+	if (len < sizeof(*hdr) ||
+	    be32_to_cpu(hdr->magic) != BOOT_TIMELINE_MAGIC)
+		errx(1, "Not a boot timeline");
+	if (be16_to_cpu(hdr->version) != BOOT_TIMELINE_VERSION)
+		errx(1, "Unsupported timeline version %d",
+		     be16_to_cpu(hdr->version));
+
+	esize = be16_to_cpu(hdr->entry_size);
+	nr = be32_to_cpu(hdr->nr_entries);
+	if (esize < sizeof(*be) || sizeof(*hdr) + (size_t)nr * esize > len)
+		errx(1, "Truncated boot timeline");
+	if (hdr->dropped)
+		fprintf(stderr, "warning: %u entries were dropped\n",
+			be32_to_cpu(hdr->dropped));
+
+	tb_hz = be64_to_cpu(hdr->tb_hz);
+	if (!tb_hz)
+		errx(1, "Bad timebase frequency");
+
+	entries = calloc(nr ? nr : 1, sizeof(*entries));
+	if (!entries)
+		errx(1, "Out of memory");
+
+	for (i = 0; i < nr; i++) {
+		be = (const void *)((const char *)hdr->entries + i * esize);
+		entries[i].start = be64_to_cpu(be->start);
+		entries[i].end = be64_to_cpu(be->end);
+		entries[i].pir = be16_to_cpu(be->pir);
+		entries[i].type = be->type;
+		entries[i].flags = be->flags;
+		memcpy(entries[i].name, be->name, BOOT_TIMELINE_NAME_LEN);
+	}
+	qsort(entries, nr, sizeof(*entries), cmp_entry);
+
+	*count = nr;
+	return entries;
+}
+
+static u64 tb_to_us(u64 tb)
+{
+	return tb / (tb_hz / 1000000);
+}
+
+static bool has_duration(const struct entry *e)
+{
+	return e->end && e->end >= e->start;
+}
+
+static void print_csv(const struct entry *e, unsigned int count)
+{
+	unsigned int i;
+
+	printf("pir,type,name,start_us,end_us,duration_us,synced\n");
+	for (i = 0; i < count; i++, e++) {
+		printf("0x%04x,%s,\"%s\",%" PRIu64 ",", e->pir,
+		       e->type == BOOT_TIMELINE_JOB ? "job" : "stage",
+		       e->name, tb_to_us(e->start));
+		if (has_duration(e))
+			printf("%" PRIu64 ",%" PRIu64 ",", tb_to_us(e->end),
+			       tb_to_us(e->end - e->start));
+		else
+			printf(",,");
+		printf("%d\n", !(e->flags & BOOT_TIMELINE_UNSYNCED));
+	}
+}
+
+static void fill_bar(char *bar, int width, u64 min, u64 max,
+		     const struct entry *e, char c)
+{
+	u64 span = max - min ? max - min : 1;
+	int from, to;
+
+	from = (e->start - min) * width / span;
+	to = (e->end - min) * width / span;
+	if (to >= width)
+		to = width - 1;
+	for (; from <= to; from++)
+		bar[from] = c;
+}
+
+/*
+ * One row per init stage on the boot CPU, then one occupancy row per
+ * CPU that ran jobs. Only entries on the synchronised timebase can be
+ * placed, the others are listed with their duration only.
+ */
+static void print_gantt(const struct entry *entries, unsigned int count,
+			int width)
+{
+	u64 min = UINT64_MAX, max = 0;
+	unsigned int i, j;
+	char bar[width + 1];
+	bool *done;
+
+	for (i = 0; i < count; i++) {
+		const struct entry *e = &entries[i];
+
+		if ((e->flags & BOOT_TIMELINE_UNSYNCED) || !has_duration(e))
+			continue;
+		if (e->start < min)
+			min = e->start;
+		if (e->end > max)
+			max = e->end;
+	}
+
+	printf("Before timebase sync:\n");
+	for (i = 0; i < count; i++) {
+		const struct entry *e = &entries[i];
+
+		if (!(e->flags & BOOT_TIMELINE_UNSYNCED) ||
+		    e->type != BOOT_TIMELINE_STAGE)
+			continue;
+		if (has_duration(e))
+			printf("  %-40s %10" PRIu64 " us\n", e->name,
+			       tb_to_us(e->end - e->start));
+		else
+			printf("  %-40s          ? us\n", e->name);
+	}
+
+	if (min > max)
+		return;
+
+	printf("\nAfter timebase sync (%" PRIu64 " us across):\n",
+	       tb_to_us(max - min));
+	for (i = 0; i < count; i++) {
+		const struct entry *e = &entries[i];
+
+		if ((e->flags & BOOT_TIMELINE_UNSYNCED) ||
+		    e->type != BOOT_TIMELINE_STAGE || !has_duration(e))
+			continue;
+		memset(bar, ' ', width);
+		bar[width] = 0;
+		fill_bar(bar, width, min, max, e, '#');
+		printf("  %-40s |%s| %8" PRIu64 " us\n", e->name, bar,
+		       tb_to_us(e->end - e->start));
+	}
+
+	printf("\nJobs per CPU:\n");
+	done = calloc(count ? count : 1, sizeof(bool));
+	if (!done)
+		errx(1, "Out of memory");
+	for (i = 0; i < count; i++) {
+		u64 busy = 0;
+		u16 pir = entries[i].pir;
+
+		if (done[i] || entries[i].type != BOOT_TIMELINE_JOB)
+			continue;
+
+		memset(bar, '.', width);
+		bar[width] = 0;
+		for (j = i; j < count; j++) {
+			const struct entry *e = &entries[j];
+
+			if (e->pir != pir || e->type != BOOT_TIMELINE_JOB)
+				continue;
+			done[j] = true;
+			if ((e->flags & BOOT_TIMELINE_UNSYNCED) ||
+			    !has_duration(e))
+				continue;
+			fill_bar(bar, width, min, max, e, '#');
+			busy += e->end - e->start;
+		}
+		printf("  cpu 0x%04x %29s |%s| %8" PRIu64 " us\n", pir, "",
+		       bar, tb_to_us(busy));
+	}
+	free(done);
+}
+
+static void usage(void)
+{
+	printf("usage: boot-timeline [-f|--file dump] [-o|--output dump]\n"
+	       "                     [-g|--gantt] [-w|--width cols]\n"
+	       "\n"
+	       "Without -f, reads the timeline of the running system.\n"
+	       "-o saves the raw timeline for later comparison.\n"
+	       "Prints CSV unless -g is given.\n");
+}
+
+int main(int argc, char *argv[])
+{
+	const char *in = NULL, *out = NULL;
+	struct entry *entries;
+	unsigned int count;
+	bool gantt = false;
+	int width = 60;
+	size_t len;
+	void *buf;
+	int fd;
+
+	while (1) {
+		static struct option long_opts[] = {
+			{"file",	required_argument,	NULL,	'f'},
+			{"output",	required_argument,	NULL,	'o'},
+			{"gantt",	no_argument,		NULL,	'g'},
+			{"width",	required_argument,	NULL,	'w'},
+			{"help",	no_argument,		NULL,	'h'},
+			{NULL,		0,			NULL,	0}
+		};
+		int c, oidx = 0;
+
+		c = getopt_long(argc, argv, "f:o:gw:h", long_opts, &oidx);
+		if (c == EOF)
+			break;
+		switch (c) {
+		case 'f':
+			in = optarg;
+			break;
+		case 'o':
+			out = optarg;
+			break;
+		case 'g':
+			gantt = true;
+			break;
+		case 'w':
+			width = atoi(optarg);
+			if (width < 10)
+				width = 10;
+			break;
+		case 'h':
+			usage();
+			return 0;
+		default:
+			usage();
+			return 1;
+		}
+	}
+
+	if (in) {
+		fd = open(in, O_RDONLY);
+		if (fd < 0)
+			err(1, "Can't open %s", in);
+		buf = read_all(fd, &len);
+		close(fd);
+	} else {
+		buf = read_live(&len);
+	}
+
+	if (out) {
+		fd = open(out, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0 || write(fd, buf, len) != len)
+			err(1, "Can't write %s", out);
+		close(fd);
+	}
+
+	entries = parse(buf, len, &count);
+	if (gantt)
+		print_gantt(entries, count, width);
+	else
+		print_csv(entries, count);
+
+	free(entries);
+	free(buf);
+	return 0;
+}
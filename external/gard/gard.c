@@ -25,6 +25,7 @@
 #include <sys/stat.h>
 #include <dirent.h>
 #include <limits.h>
+#include <time.h>
 
 #include <ccan/array_size/array_size.h>
 
@@ -59,6 +60,15 @@ struct gard_ctx {
 
 	struct blocklevel_device *bl;
 	struct ffs_handle *ffs;
+
+	/*
+	 * In memory copy of the partition, see gard_load(). Records up to
+	 * nr_records are in use, the rest are empty.
+	 */
+	struct gard_record *records;
+	unsigned int nr_records;
+	unsigned int max_records;
+	bool timing;
 };
 
 /*
@@ -226,50 +236,142 @@ static const char *path_type_to_str(enum path_type t)
 	return "Unknown";
 }
 
-static int do_iterate(struct gard_ctx *ctx,
-		int (*func)(struct gard_ctx *ctx, int pos,
-			struct gard_record *gard, void *priv),
-		void *priv)
+/* It isn't super clear what constitutes the end, this should do */
+static bool gard_is_null(struct gard_record *gard)
 {
-	int rc = 0;
-	unsigned int i;
-	struct gard_record gard, null_gard;
+	struct gard_record null_gard;
+
+	memset(&null_gard, UINT_MAX, sizeof(null_gard));
+	return memcmp(gard, &null_gard, sizeof(null_gard)) == 0;
+}
 
-	memset(&null_gard, UINT_MAX, sizeof(gard));
-	for (i = 0; i * sizeof_gard(ctx) < ctx->gard_data_len && rc == 0; i++) {
-		memset(&gard, 0, sizeof(gard));
+/*
+ * Read the records one at a time up to the first empty one, the way
+ * we always used to. Returns the number of records read.
+ */
+static int gard_read_per_record(struct gard_ctx *ctx,
+		struct gard_record *records)
+{
+	unsigned int i;
+	int rc;
 
+	for (i = 0; i < ctx->max_records; i++) {
 		rc = blocklevel_read(ctx->bl, ctx->gard_data_pos +
-				(i * sizeof_gard(ctx)), &gard, sizeof(gard));
-		/* It isn't super clear what constitutes the end, this should do */
-		if (rc || memcmp(&gard, &null_gard, sizeof(gard)) == 0)
+				(i * sizeof_gard(ctx)), &records[i],
+				sizeof(records[i]));
+		if (rc)
+			return rc > 0 ? -rc : rc;
+		if (gard_is_null(&records[i]))
 			break;
+	}
 
-		rc = func(ctx, i, &gard, priv);
+	return i;
+}
+
+/*
+ * Read the whole partition with a single raw read and do the ECC
+ * correction in memory. Like the per record path we stop at the first
+ * empty record, whatever lies beyond it (often erased flash that
+ * wouldn't pass ECC) is never looked at.
+ */
+static int gard_load(struct gard_ctx *ctx)
+{
+	uint32_t raw_len;
+	unsigned int i;
+	char *raw;
+	int rc;
+
+	ctx->max_records = ctx->gard_data_len / sizeof_gard(ctx);
+	raw_len = ctx->max_records * sizeof_gard(ctx);
+
+	free(ctx->records);
+	ctx->records = malloc(ctx->max_records * sizeof(struct gard_record));
+	raw = malloc(raw_len);
+	if (!ctx->records || !raw) {
+		free(raw);
+		return FLASH_ERR_MALLOC_FAILED;
 	}
+	memset(ctx->records, UINT_MAX,
+			ctx->max_records * sizeof(struct gard_record));
 
+	rc = ctx->bl->read(ctx->bl, ctx->gard_data_pos, raw, raw_len);
+	if (rc)
+		goto out;
+
+	for (i = 0; i < ctx->max_records; i++) {
+		if (!ctx->ecc) {
+			memcpy(&ctx->records[i], raw + i * sizeof_gard(ctx),
+					sizeof(struct gard_record));
+		} else if (memcpy_from_ecc((uint64_t *)&ctx->records[i],
+				(struct ecc64 *)(raw + i * sizeof_gard(ctx)),
+				sizeof(struct gard_record))) {
+			rc = FLASH_ERR_ECC_INVALID;
+			break;
+		}
+
+		if (gard_is_null(&ctx->records[i]))
+			break;
+	}
+	ctx->nr_records = i;
+
+out:
+	free(raw);
 	return rc;
 }
 
-static int get_largest_pos_i(struct gard_ctx *ctx, int pos, struct gard_record *gard, void *priv)
+static unsigned long elapsed_us(struct timespec *start)
 {
-	if (!priv)
-		return -1;
-
-	*(int *)priv = pos;
+	struct timespec now;
 
-	return 0;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1000000ul +
+		(now.tv_nsec - start->tv_nsec) / 1000;
 }
 
-static int get_largest_pos(struct gard_ctx *ctx)
+/* Load the records, reporting how long that took against the old way */
+static int gard_load_timed(struct gard_ctx *ctx)
 {
-	int rc, largest = -1;
+	struct gard_record *records;
+	struct timespec start;
+	unsigned long bulk_us;
+	int rc;
 
-	rc = do_iterate(ctx, &get_largest_pos_i, &largest);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	rc = gard_load(ctx);
+	bulk_us = elapsed_us(&start);
 	if (rc)
-		return -1;
+		return rc;
+
+	records = malloc(ctx->max_records * sizeof(*records));
+	if (!records)
+		return FLASH_ERR_MALLOC_FAILED;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	rc = gard_read_per_record(ctx, records);
+	fprintf(stderr, "Read %u records: bulk %lu us, per record %lu us\n",
+			ctx->nr_records, bulk_us, elapsed_us(&start));
+	free(records);
+
+	return rc < 0 ? -rc : 0;
+}
+
+static int do_iterate(struct gard_ctx *ctx,
+		int (*func)(struct gard_ctx *ctx, int pos,
+			struct gard_record *gard, void *priv),
+		void *priv)
+{
+	int rc = 0;
+	unsigned int i;
+
+	for (i = 0; i < ctx->nr_records && rc == 0; i++)
+		rc = func(ctx, i, &ctx->records[i], priv);
+
+	return rc;
+}
 
-	return largest;
+static int get_largest_pos(struct gard_ctx *ctx)
+{
+	return (int)ctx->nr_records - 1;
 }
 
 static int do_list_i(struct gard_ctx *ctx, int pos, struct gard_record *gard, void *priv)
@@ -345,105 +447,135 @@ static int do_show(struct gard_ctx *ctx, int argc, char **argv)
 	return rc;
 }
 
-static int do_clear_i(struct gard_ctx *ctx, int pos, struct gard_record *gard, void *priv)
+/*
+ * Drop the records in @ids from the index, shifting the remaining ones
+ * up, then write everything from the first dropped record onwards back
+ * with a single smart write.
+ */
+static int clear_records(struct gard_ctx *ctx, uint32_t *ids, int nr_ids)
 {
-	int largest, rc = 0;
-	char *buf;
-	struct gard_record null_gard;
-
-	if (!gard || !ctx || !priv)
-		return -1;
+	unsigned int i, j, first, old_nr = ctx->nr_records;
+	bool *found;
+	int k, rc;
+
+	found = calloc(nr_ids, sizeof(*found));
+	if (!found)
+		return -ENOMEM;
+
+	first = old_nr;
+	for (i = 0, j = 0; i < old_nr; i++) {
+		for (k = 0; k < nr_ids; k++)
+			if (be32toh(ctx->records[i].record_id) == ids[k])
+				break;
+		if (k < nr_ids) {
+			found[k] = true;
+			if (first == old_nr)
+				first = i;
+			continue;
+		}
+		if (i != j)
+			ctx->records[j] = ctx->records[i];
+		j++;
+	}
 
-	/* Not this one */
-	if (be32toh(gard->record_id) != *(uint32_t *)priv)
+	/* Nothing matched */
+	if (first == old_nr) {
+		free(found);
 		return 0;
-
-	memset(&null_gard, 0xFF, sizeof(null_gard));
-
-	largest = get_largest_pos(ctx);
-
-	printf("Clearing gard record 0x%08x...", be32toh(gard->record_id));
-
-	if (largest < 0 || pos > largest) {
-		/* Something went horribly wrong */
-		fprintf(stderr, "largest index out of range %d\n", largest);
-		return -1;
 	}
 
-	if (pos < largest) {
-		/* We're not clearing the last record, shift all the records up */
-		int buf_len = ((largest - pos) * sizeof(struct gard_record));
-		int buf_pos = ctx->gard_data_pos + ((pos + 1) * sizeof_gard(ctx));
-		buf = malloc(buf_len);
-		if (!buf)
-			return -ENOMEM;
-
-		rc = blocklevel_read(ctx->bl, buf_pos, buf, buf_len);
-		if (rc) {
-			free(buf);
-			fprintf(stderr, "Couldn't read from flash at 0x%08x for len 0x%08x\n", buf_pos, buf_len);
-			return rc;
-		}
+	ctx->nr_records = j;
+	memset(&ctx->records[j], UINT_MAX,
+			(old_nr - j) * sizeof(struct gard_record));
 
-		rc = blocklevel_smart_write(ctx->bl, buf_pos - sizeof_gard(ctx), buf, buf_len);
-		free(buf);
-		if (rc) {
-			fprintf(stderr, "Couldn't write to flash at 0x%08lx for len 0x%08x\n",
-			        buf_pos - sizeof_gard(ctx), buf_len);
-			return rc;
-		}
+	rc = blocklevel_smart_write(ctx->bl,
+			ctx->gard_data_pos + (first * sizeof_gard(ctx)),
+			&ctx->records[first],
+			(old_nr - first) * sizeof(struct gard_record));
+	if (rc) {
+		fprintf(stderr, "Couldn't write to flash at 0x%08lx for len 0x%08lx\n",
+				ctx->gard_data_pos + (first * sizeof_gard(ctx)),
+				(old_nr - first) * sizeof(struct gard_record));
+		free(found);
+		return rc;
 	}
 
-	/* Now wipe the last record */
-	rc = blocklevel_smart_write(ctx->bl, ctx->gard_data_pos + (largest * sizeof_gard(ctx)),
-	                            &null_gard, sizeof(null_gard));
-	printf("done\n");
+	for (k = 0; k < nr_ids; k++)
+		if (found[k])
+			printf("Clearing gard record 0x%08x...done\n", ids[k]);
 
-	return rc;
+	free(found);
+	return 0;
 }
 
 static int reset_partition(struct gard_ctx *ctx)
 {
-	int i, rc;
-	struct gard_record gard;
-	memset(&gard, 0xFF, sizeof(gard));
+	unsigned int nr = ctx->gard_data_len / sizeof_gard(ctx);
+	struct gard_record *null_gards;
+	int rc;
+
+	null_gards = malloc(nr * sizeof(*null_gards));
+	if (!null_gards)
+		return -ENOMEM;
+	memset(null_gards, 0xFF, nr * sizeof(*null_gards));
 
 	rc = blocklevel_erase(ctx->bl, ctx->gard_data_pos, ctx->gard_data_len);
 	if (rc) {
 		fprintf(stderr, "Couldn't erase the gard partition. Bailing out\n");
-		return rc;
-	}
-	for (i = 0; i + sizeof_gard(ctx) < ctx->gard_data_len; i += sizeof_gard(ctx)) {
-		rc = blocklevel_write(ctx->bl, ctx->gard_data_pos + i, &gard, sizeof(gard));
-		if (rc) {
-			fprintf(stderr, "Couldn't reset the entire gard partition. Bailing out\n");
-			return rc;
-		}
+		goto out;
 	}
 
+	/* Empty records, with their ECC, in one go */
+	rc = blocklevel_write(ctx->bl, ctx->gard_data_pos, null_gards,
+			nr * sizeof(*null_gards));
+	if (rc)
+		fprintf(stderr, "Couldn't reset the entire gard partition. Bailing out\n");
+
+out:
+	free(null_gards);
+	if (rc)
+		return rc;
+
+	ctx->nr_records = 0;
+	if (ctx->records)
+		memset(ctx->records, 0xFF,
+				ctx->max_records * sizeof(struct gard_record));
 	return 0;
 }
 
+static bool is_clear_all(int argc, char **argv)
+{
+	return argc >= 2 && strcmp(argv[0], "clear") == 0 &&
+		strncmp(argv[1], "all", strlen("all")) == 0;
+}
+
 static int do_clear(struct gard_ctx *ctx, int argc, char **argv)
 {
-	int rc;
-	uint32_t id;
+	uint32_t *ids;
+	int i, rc;
 
-	if (argc != 2) {
-		fprintf(stderr, "%s option requires a GARD record or 'all'\n", argv[0]);
+	if (argc < 2) {
+		fprintf(stderr, "%s option requires GARD records or 'all'\n", argv[0]);
 		return -1;
 	}
 
-	if (strncmp(argv[1], "all", strlen("all")) == 0) {
+	if (is_clear_all(argc, argv)) {
 		printf("Clearing the entire gard partition...");
 		fflush(stdout);
 		rc = reset_partition(ctx);
 		printf("done\n");
-	} else {
-		id = strtoul(argv[1], NULL, 16);
-		rc = do_iterate(ctx, do_clear_i, &id);
+		return rc;
 	}
 
+	ids = malloc((argc - 1) * sizeof(*ids));
+	if (!ids)
+		return -ENOMEM;
+	for (i = 1; i < argc; i++)
+		ids[i - 1] = strtoul(argv[i], NULL, 16);
+
+	rc = clear_records(ctx, ids, argc - 1);
+	free(ids);
+
 	return rc;
 }
 
@@ -514,7 +646,7 @@ static void usage(const char *progname)
 	unsigned int i;
 
 	print_version();
-	fprintf(stderr, "Usage: %s [-a -e -f <file> -p] <command> [<args>]\n\n",
+	fprintf(stderr, "Usage: %s [-a -e -f <file> -p -t] <command> [<args>]\n\n",
 			progname);
 	fprintf(stderr, "-e --ecc\n\tForce reading/writing with ECC bytes.\n\n");
 	fprintf(stderr, "-f --file <file>\n\tDon't search for MTD device,"
@@ -523,6 +655,9 @@ static void usage(const char *progname)
 	                "that just\n");
 	fprintf(stderr, "\tthe GUARD partition is in <file> and libffs\n");
 	fprintf(stderr, "\tshouldn't be used.\n\n");
+	fprintf(stderr, "-t --time\n\tReport how long reading the GARD records"
+			" took, against\n");
+	fprintf(stderr, "\treading them one at a time.\n\n");
 
 
 	fprintf(stderr, "Where <command> is one of:\n\n");
@@ -537,9 +672,10 @@ static struct option global_options[] = {
 	{ "file", required_argument, 0, 'f' },
 	{ "part", no_argument, 0, 'p' },
 	{ "ecc", no_argument, 0, 'e' },
+	{ "time", no_argument, 0, 't' },
 	{ 0 },
 };
-static const char *global_optstring = "+ef:p";
+static const char *global_optstring = "+ef:pt";
 
 int main(int argc, char **argv)
 {
@@ -580,6 +716,9 @@ int main(int argc, char **argv)
 		case 'p':
 			part = true;
 			break;
+		case 't':
+			ctx->timing = true;
+			break;
 		case '?':
 			usage(progname);
 			rc = EXIT_FAILURE;
@@ -649,6 +788,19 @@ int main(int argc, char **argv)
 		goto out;
 	}
 
+	/*
+	 * Clearing everything doesn't need the records, and has to work
+	 * when they can't be read: it's how a corrupted partition gets
+	 * fixed.
+	 */
+	if (!is_clear_all(argc, argv)) {
+		rc = ctx->timing ? gard_load_timed(ctx) : gard_load(ctx);
+		if (rc) {
+			fprintf(stderr, "Couldn't read the gard records\n");
+			goto out;
+		}
+	}
+
 	for (i = 0; i < ARRAY_SIZE(actions); i++) {
 		if (!strcmp(actions[i].name, action)) {
 			rc = actions[i].fn(ctx, argc, argv);
@@ -657,6 +809,7 @@ int main(int argc, char **argv)
 	}
 
 out:
+	free(ctx->records);
 	if (ctx->ffs)
 		ffs_close(ctx->ffs);
 
@@ -34,6 +34,8 @@
 #include <time.h>
 #include <poll.h>
 #include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
 
 #include <endian.h>
 
@@ -50,6 +52,8 @@
 #include <opal-api.h>
 #include <types.h>
 
+#include <ccan/array_size/array_size.h>
+
 #include "opal-prd.h"
 #include "hostboot-interface.h"
 #include "module.h"
@@ -90,6 +94,8 @@ enum control_msg_type {
 	CONTROL_MSG_TEMP_OCC_ERROR	= 0x03,
 	CONTROL_MSG_ATTR_OVERRIDE	= 0x04,
 	CONTROL_MSG_HTMGT_PASSTHRU	= 0x05,
+	CONTROL_MSG_PNOR_STATS		= 0x06,
+	CONTROL_MSG_STATS		= 0x07,
 	CONTROL_MSG_RUN_CMD		= 0x30,
 };
 
@@ -125,6 +131,48 @@ static const char *mem_offline_hard =
 
 #define ADDR_STRING_SZ 20 /* Hold %16lx */
 
+/*
+ * HBRT isn't reentrant, so every call into it is made with hbrt_lock
+ * held. The lock is priority inheriting so a control request can only
+ * hold off the attention thread for as long as its own HBRT call.
+ */
+static pthread_mutex_t hbrt_lock;
+
+/*
+ * The PNOR cache and its statistics, used from HBRT's callbacks with
+ * hbrt_lock held, but also read by stats requests which don't need HBRT.
+ * Nests inside hbrt_lock.
+ */
+static pthread_mutex_t pnor_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Per message type latency, from receiving a message to finishing it */
+struct prd_msg_stats {
+	const char	*name;
+	uint64_t	count;
+	uint64_t	total_us;
+	uint64_t	max_us;
+};
+
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct prd_msg_stats fw_msg_stats[] = {
+	[OPAL_PRD_MSG_TYPE_ATTN]	= { .name = "attn" },
+	[OPAL_PRD_MSG_TYPE_OCC_ERROR]	= { .name = "occ-error" },
+	[OPAL_PRD_MSG_TYPE_OCC_RESET]	= { .name = "occ-reset" },
+};
+
+static struct prd_msg_stats control_msg_stats[] = {
+	[CONTROL_MSG_ENABLE_OCCS]	= { .name = "ctrl occ-enable" },
+	[CONTROL_MSG_DISABLE_OCCS]	= { .name = "ctrl occ-disable" },
+	[CONTROL_MSG_TEMP_OCC_RESET]	= { .name = "ctrl occ-reset" },
+	[CONTROL_MSG_TEMP_OCC_ERROR]	= { .name = "ctrl occ-error" },
+	[CONTROL_MSG_ATTR_OVERRIDE]	= { .name = "ctrl override" },
+	[CONTROL_MSG_HTMGT_PASSTHRU]	= { .name = "ctrl htmgt-passthru" },
+	[CONTROL_MSG_PNOR_STATS]	= { .name = "ctrl pnor-stats" },
+	[CONTROL_MSG_STATS]		= { .name = "ctrl stats" },
+	[CONTROL_MSG_RUN_CMD]		= { .name = "ctrl run" },
+};
+
 /* This is the "real" HBRT call table for calling into HBRT as
  * provided by it. It will be used by the assembly thunk
  */
@@ -394,15 +442,35 @@ int hservice_clock_gettime(clockid_t i_clkId, struct timespec *o_tp)
 int hservice_pnor_read(uint32_t i_proc, const char* i_partitionName,
 		uint64_t i_offset, void* o_data, size_t i_sizeBytes)
 {
-	return pnor_operation(&ctx->pnor, i_partitionName, i_offset, o_data,
-			      i_sizeBytes, PNOR_OP_READ);
+	int rc;
+
+	pthread_mutex_lock(&pnor_lock);
+	rc = pnor_operation(&ctx->pnor, i_partitionName, i_offset, o_data,
+			    i_sizeBytes, PNOR_OP_READ);
+	pthread_mutex_unlock(&pnor_lock);
+
+	return rc;
 }
 
 int hservice_pnor_write(uint32_t i_proc, const char* i_partitionName,
 		uint64_t i_offset, void* o_data, size_t i_sizeBytes)
 {
-	return pnor_operation(&ctx->pnor, i_partitionName, i_offset, o_data,
-			      i_sizeBytes, PNOR_OP_WRITE);
+	int rc;
+
+	pthread_mutex_lock(&pnor_lock);
+	rc = pnor_operation(&ctx->pnor, i_partitionName, i_offset, o_data,
+			    i_sizeBytes, PNOR_OP_WRITE);
+	pthread_mutex_unlock(&pnor_lock);
+
+	return rc;
+}
+
+/* Don't trust cached PNOR data past a batch of HBRT work */
+static void prd_pnor_invalidate(struct opal_prd_ctx *ctx)
+{
+	pthread_mutex_lock(&pnor_lock);
+	pnor_invalidate(&ctx->pnor);
+	pthread_mutex_unlock(&pnor_lock);
 }
 
 int hservice_i2c_read(uint64_t i_master, uint16_t i_devAddr,
@@ -1061,6 +1129,85 @@ static int prd_init(struct opal_prd_ctx *ctx)
 	return 0;
 }
 
+static void hbrt_lock_init(void)
+{
+	pthread_mutexattr_t attr;
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
+	pthread_mutex_init(&hbrt_lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+}
+
+static uint64_t stats_now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000ull + ts.tv_nsec / 1000;
+}
+
+static void stats_update(struct prd_msg_stats *table, unsigned int n,
+			 unsigned int type, uint64_t start)
+{
+	struct prd_msg_stats *st;
+	uint64_t delta;
+
+	if (type >= n || !table[type].name)
+		return;
+
+	st = &table[type];
+	delta = stats_now_us() - start;
+
+	pthread_mutex_lock(&stats_lock);
+	st->count++;
+	st->total_us += delta;
+	if (delta > st->max_us)
+		st->max_us = delta;
+	pthread_mutex_unlock(&stats_lock);
+}
+
+static int stats_dump_table(struct prd_msg_stats *table, unsigned int n,
+			    char *buf, size_t len)
+{
+	struct prd_msg_stats *st;
+	unsigned int i;
+	int pos = 0;
+
+	for (i = 0; i < n && pos < len; i++) {
+		st = &table[i];
+		if (!st->name)
+			continue;
+		pos += snprintf(buf + pos, len - pos,
+				"%-20s %8lu %10lu %10lu\n", st->name,
+				st->count,
+				st->count ? st->total_us / st->count : 0,
+				st->max_us);
+	}
+
+	return pos;
+}
+
+/* Format the message statistics into @buf, returns the length written */
+static int stats_dump(char *buf, size_t len)
+{
+	int n;
+
+	pthread_mutex_lock(&stats_lock);
+	n = snprintf(buf, len, "%-20s %8s %10s %10s\n", "message", "count",
+			"avg us", "max us");
+	if (n < len)
+		n += stats_dump_table(fw_msg_stats, ARRAY_SIZE(fw_msg_stats),
+				buf + n, len - n);
+	if (n < len)
+		n += stats_dump_table(control_msg_stats,
+				ARRAY_SIZE(control_msg_stats),
+				buf + n, len - n);
+	pthread_mutex_unlock(&stats_lock);
+
+	return n < len ? n : len - 1;
+}
+
 static int handle_msg_attn(struct opal_prd_ctx *ctx, struct opal_prd_msg *msg)
 {
 	uint64_t proc, ipoll_mask, ipoll_status;
@@ -1132,6 +1279,7 @@ static int handle_msg_occ_reset(struct opal_prd_ctx *ctx,
 static int handle_prd_msg(struct opal_prd_ctx *ctx)
 {
 	struct opal_prd_msg msg;
+	uint64_t start;
 	int size;
 	int rc;
 
@@ -1139,6 +1287,8 @@ static int handle_prd_msg(struct opal_prd_ctx *ctx)
 	if (rc < 0 && errno == EAGAIN)
 		return -1;
 
+	start = stats_now_us();
+
 	if (rc != sizeof(msg)) {
 		pr_log(LOG_WARNING, "FW: Error reading events from OPAL: %m");
 		return -1;
@@ -1153,6 +1303,8 @@ static int handle_prd_msg(struct opal_prd_ctx *ctx)
 		return -1;
 	}
 
+	pthread_mutex_lock(&hbrt_lock);
+
 	switch (msg.hdr.type) {
 	case OPAL_PRD_MSG_TYPE_ATTN:
 		rc = handle_msg_attn(ctx, &msg);
@@ -1164,11 +1316,19 @@ static int handle_prd_msg(struct opal_prd_ctx *ctx)
 		rc = handle_msg_occ_error(ctx, &msg);
 		break;
 	default:
+		pthread_mutex_unlock(&hbrt_lock);
 		pr_log(LOG_WARNING, "Invalid incoming message type 0x%x",
 				msg.hdr.type);
 		return -1;
 	}
 
+	prd_pnor_invalidate(ctx);
+
+	pthread_mutex_unlock(&hbrt_lock);
+
+	stats_update(fw_msg_stats, ARRAY_SIZE(fw_msg_stats), msg.hdr.type,
+			start);
+
 	return 0;
 }
 
@@ -1254,7 +1414,7 @@ static void handle_prd_control_run_cmd(struct control_msg *send_msg,
 	char *runcmd_output, *s;
 	const char **argv;
 	int i, argc;
-	size_t size;
+	size_t size = 0;
 
 	if (!hservice_runtime->run_command) {
 		pr_log_nocall("run_command");
@@ -1299,10 +1459,30 @@ static void handle_prd_control_run_cmd(struct control_msg *send_msg,
 	}
 }
 
+static void handle_prd_control_pnor_stats(struct opal_prd_ctx *ctx,
+					  struct control_msg *send_msg)
+{
+	pthread_mutex_lock(&pnor_lock);
+	send_msg->data_len = pnor_dump_stats(&ctx->pnor,
+					     (char *)send_msg->data,
+					     MAX_CONTROL_MSG_BUF) + 1;
+	pthread_mutex_unlock(&pnor_lock);
+	send_msg->response = 0;
+}
+
+static void handle_prd_control_stats(struct control_msg *send_msg)
+{
+	send_msg->data_len = stats_dump((char *)send_msg->data,
+					MAX_CONTROL_MSG_BUF) + 1;
+	send_msg->response = 0;
+}
+
 static void handle_prd_control(struct opal_prd_ctx *ctx, int fd)
 {
 	struct control_msg msg, *recv_msg, *send_msg;
-	bool enabled = false;
+	uint64_t start = stats_now_us();
+	bool enabled = false, locked;
+	int type = -1;
 	int rc, size;
 
 	/* Default reply, in the error path */
@@ -1344,8 +1524,15 @@ static void handle_prd_control(struct opal_prd_ctx *ctx, int fd)
 		goto out_free_recv;
 	}
 
+	type = recv_msg->type;
 	send_msg->type = recv_msg->type;
 	send_msg->response = -1;
+
+	/* Statistics are read-only and have their own locks, leave HBRT be */
+	locked = type != CONTROL_MSG_STATS && type != CONTROL_MSG_PNOR_STATS;
+	if (locked)
+		pthread_mutex_lock(&hbrt_lock);
+
 	switch (recv_msg->type) {
 	case CONTROL_MSG_ENABLE_OCCS:
 		enabled = true;
@@ -1368,6 +1555,12 @@ static void handle_prd_control(struct opal_prd_ctx *ctx, int fd)
 	case CONTROL_MSG_RUN_CMD:
 		handle_prd_control_run_cmd(send_msg, recv_msg);
 		break;
+	case CONTROL_MSG_PNOR_STATS:
+		handle_prd_control_pnor_stats(ctx, send_msg);
+		break;
+	case CONTROL_MSG_STATS:
+		handle_prd_control_stats(send_msg);
+		break;
 	default:
 		pr_log(LOG_WARNING, "CTRL: Unknown control message action %d",
 				recv_msg->type);
@@ -1375,6 +1568,11 @@ static void handle_prd_control(struct opal_prd_ctx *ctx, int fd)
 		break;
 	}
 
+	if (locked) {
+		prd_pnor_invalidate(ctx);
+		pthread_mutex_unlock(&hbrt_lock);
+	}
+
 out_free_recv:
 	free(recv_msg);
 out_send:
@@ -1388,12 +1586,102 @@ out_send:
 
 	if (send_msg != &msg)
 		free(send_msg);
+
+	if (type >= 0)
+		stats_update(control_msg_stats, ARRAY_SIZE(control_msg_stats),
+				type, start);
+}
+
+static void *control_thread(void *data)
+{
+	int fd = (intptr_t)data;
+
+	handle_prd_control(ctx, fd);
+	close(fd);
+
+	return NULL;
+}
+
+/* Control connections each get a thread, so they run concurrently with
+ * attention handling and each other, serialised only on hbrt_lock */
+static void start_control_thread(struct opal_prd_ctx *ctx, int fd)
+{
+	pthread_attr_t attr;
+	pthread_t thread;
+	int rc;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	rc = pthread_create(&thread, &attr, control_thread,
+			(void *)(intptr_t)fd);
+	pthread_attr_destroy(&attr);
+
+	if (rc) {
+		pr_log(LOG_NOTICE, "CTRL: can't start control thread (%d), "
+				"handling request inline", rc);
+		handle_prd_control(ctx, fd);
+		close(fd);
+	}
+}
+
+static void *attn_thread(void *data)
+{
+	struct opal_prd_ctx *ctx = data;
+	struct pollfd pollfd;
+	int rc;
+
+	pollfd.fd = ctx->fd;
+	pollfd.events = POLLIN | POLLERR;
+
+	for (;;) {
+		rc = poll(&pollfd, 1, -1);
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			pr_log(LOG_ERR, "FW: event poll failed: %m");
+			exit(EXIT_FAILURE);
+		}
+
+		if (pollfd.revents & POLLIN)
+			handle_prd_msg(ctx);
+	}
+
+	return NULL;
+}
+
+/* Attentions get a realtime thread of their own, if we're allowed one */
+static int start_attn_thread(struct opal_prd_ctx *ctx, pthread_t *thread)
+{
+	struct sched_param param;
+	pthread_attr_t attr;
+	int rc;
+
+	memset(&param, 0, sizeof(param));
+	param.sched_priority = sched_get_priority_min(SCHED_FIFO);
+
+	pthread_attr_init(&attr);
+	pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+	pthread_attr_setschedparam(&attr, &param);
+	rc = pthread_create(thread, &attr, attn_thread, ctx);
+	pthread_attr_destroy(&attr);
+
+	if (rc == EPERM) {
+		pr_log(LOG_NOTICE, "FW: can't use realtime priority for "
+				"attention handling");
+		rc = pthread_create(thread, NULL, attn_thread, ctx);
+	}
+
+	if (rc)
+		pr_log(LOG_ERR, "FW: can't start attention thread (%d)", rc);
+
+	return rc;
 }
 
 static int run_attn_loop(struct opal_prd_ctx *ctx)
 {
-	struct pollfd pollfds[2];
 	struct opal_prd_msg msg;
+	pthread_t thread;
 	int rc, fd;
 
 	if (hservice_runtime->enable_attns) {
@@ -1419,33 +1707,18 @@ static int run_attn_loop(struct opal_prd_ctx *ctx)
 		return -1;
 	}
 
-	pollfds[0].fd = ctx->fd;
-	pollfds[0].events = POLLIN | POLLERR;
-	pollfds[1].fd = ctx->socket;
-	pollfds[1].events = POLLIN | POLLERR;
+	rc = start_attn_thread(ctx, &thread);
+	if (rc)
+		return -1;
 
 	for (;;) {
-		rc = poll(pollfds, 2, -1);
-		if (rc < 0) {
-			pr_log(LOG_ERR, "FW: event poll failed: %m");
-			exit(EXIT_FAILURE);
-		}
-
-		if (!rc)
-			continue;
-
-		if (pollfds[0].revents & POLLIN)
-			handle_prd_msg(ctx);
-
-		if (pollfds[1].revents & POLLIN) {
-			fd = accept(ctx->socket, NULL, NULL);
-			if (fd < 0) {
+		fd = accept(ctx->socket, NULL, NULL);
+		if (fd < 0) {
+			if (errno != EINTR)
 				pr_log(LOG_NOTICE, "CTRL: accept failed: %m");
-				continue;
-			}
-			handle_prd_control(ctx, fd);
-			close(fd);
+			continue;
 		}
+		start_control_thread(ctx, fd);
 	}
 
 	return 0;
@@ -1504,6 +1777,7 @@ static int run_prd_daemon(struct opal_prd_ctx *ctx)
 	ctx->fd = -1;
 	ctx->socket = -1;
 
+	hbrt_lock_init();
 	i2c_init();
 
 #ifdef DEBUG_I2C
@@ -1837,6 +2111,25 @@ static int send_run_command(struct opal_prd_ctx *ctx, int argc, char *argv[])
 	return rc;
 }
 
+/* Send a request with no arguments, and print the text that comes back */
+static int send_print_request(enum control_msg_type type)
+{
+	struct control_msg send_msg, *recv_msg = NULL;
+	int rc;
+
+	memset(&send_msg, 0, sizeof(send_msg));
+	send_msg.type = type;
+
+	rc = send_prd_control(&send_msg, &recv_msg);
+	if (recv_msg) {
+		if (!rc && recv_msg->data_len)
+			printf("%s", recv_msg->data);
+		free(recv_msg);
+	}
+
+	return rc;
+}
+
 static void usage(const char *progname)
 {
 	printf("Usage:\n");
@@ -1846,6 +2139,8 @@ static void usage(const char *progname)
 	printf("\t%s htmgt-passthru <bytes...>\n", progname);
 	printf("\t%s override <FILE>\n", progname);
 	printf("\t%s run [arg 0] [arg 1]..[arg n]\n", progname);
+	printf("\t%s pnor-stats\n", progname);
+	printf("\t%s stats\n", progname);
 	printf("\n");
 	printf("Options:\n"
 "\t--debug            verbose logging for debug information\n"
@@ -1878,6 +2173,8 @@ enum action {
 	ACTION_ATTR_OVERRIDE,
 	ACTION_HTMGT_PASSTHRU,
 	ACTION_RUN_COMMAND,
+	ACTION_PNOR_STATS,
+	ACTION_STATS,
 };
 
 static int parse_action(const char *str, enum action *action)
@@ -1899,6 +2196,12 @@ static int parse_action(const char *str, enum action *action)
 	} else if (!strcmp(str, "run")) {
 		*action = ACTION_RUN_COMMAND;
 		return 0;
+	} else if (!strcmp(str, "pnor-stats")) {
+		*action = ACTION_PNOR_STATS;
+		rc = 0;
+	} else if (!strcmp(str, "stats")) {
+		*action = ACTION_STATS;
+		rc = 0;
 	} else {
 		pr_log(LOG_ERR, "CTRL: unknown argument '%s'", str);
 		rc = -1;
@@ -2004,6 +2307,12 @@ int main(int argc, char *argv[])
 
 		rc = send_run_command(ctx, argc - optind - 1, &argv[optind + 1]);
 		break;
+	case ACTION_PNOR_STATS:
+		rc = send_print_request(CONTROL_MSG_PNOR_STATS);
+		break;
+	case ACTION_STATS:
+		rc = send_print_request(CONTROL_MSG_STATS);
+		break;
 	default:
 		break;
 	}
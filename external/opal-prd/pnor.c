@@ -30,6 +30,16 @@
 #include "pnor.h"
 #include "opal-prd.h"
 
+/*
+ * Maximum number of erase blocks cached per partition.
+ *
+ * Blocks are filled with read(2) on the MTD character device. mtdchar
+ * only supports mmap() of RAM and ROM devices, and O_DIRECT doesn't
+ * apply to character devices, so neither is available for the PNOR
+ * NOR flash. The cache is what saves us re-reading whole blocks.
+ */
+#define PNOR_CACHE_BLOCKS	32
+
 int pnor_init(struct pnor *pnor)
 {
 	int rc, fd;
@@ -68,8 +78,16 @@ int pnor_init(struct pnor *pnor)
 	       pnor->erasesize);
 
 	rc = ffs_open_image(fd, pnor->size, 0, &pnor->ffsh);
-	if (rc)
+	if (rc) {
 		pr_log(LOG_ERR, "PNOR: Failed to open pnor partition table");
+		goto out;
+	}
+
+	/* Keep the device open for the partition cache */
+	pnor->fd = fd;
+	list_head_init(&pnor->parts);
+
+	return 0;
 
 out:
 	close(fd);
@@ -77,13 +95,33 @@ out:
 	return rc;
 }
 
+static void pnor_free_parts(struct pnor *pnor)
+{
+	struct pnor_block *block, *nblock;
+	struct pnor_part *part, *npart;
+
+	list_for_each_safe(&pnor->parts, part, npart, link) {
+		list_for_each_safe(&part->blocks, block, nblock, link) {
+			list_del(&block->link);
+			free(block);
+		}
+		list_del(&part->link);
+		free(part->name);
+		free(part);
+	}
+}
+
 void pnor_close(struct pnor *pnor)
 {
 	if (!pnor)
 		return;
 
-	if (pnor->ffsh)
+	if (pnor->ffsh) {
+		pnor_free_parts(pnor);
 		ffs_close(pnor->ffsh);
+		pnor->ffsh = NULL;
+		close(pnor->fd);
+	}
 
 	if (pnor->path)
 		free(pnor->path);
@@ -129,7 +167,17 @@ static int mtd_write(struct pnor *pnor, int fd, void *data, uint64_t offset,
 		write_len += pnor->erasesize;
 	}
 
+	pnor->mtd_writes++;
+
+	/* Aligned writes go straight from the caller's buffer */
+	if (!start_waste && !end_waste) {
+		buf = data;
+		goto erase;
+	}
+
 	buf = malloc(write_len);
+	if (!buf)
+		return -ENOMEM;
 
 	if (start_waste) {
 		rc = lseek(fd, write_start, SEEK_SET);
@@ -170,6 +218,7 @@ static int mtd_write(struct pnor *pnor, int fd, void *data, uint64_t offset,
 	/* Put data in the correct spot */
 	memcpy(buf + start_waste, data, len);
 
+erase:
 	/* Not sure if this is required */
 	rc = lseek(fd, 0, SEEK_SET);
 	if (rc < 0) {
@@ -207,7 +256,8 @@ static int mtd_write(struct pnor *pnor, int fd, void *data, uint64_t offset,
 	rc = len;
 
 out:
-	free(buf);
+	if (buf != data)
+		free(buf);
 	return rc;
 }
 
@@ -237,7 +287,15 @@ static int mtd_read(struct pnor *pnor, int fd, void *data, uint64_t offset,
 		return -ERANGE;
 	}
 
-	buf = malloc(read_len);
+	pnor->mtd_reads++;
+
+	/* Aligned reads go straight into the caller's buffer */
+	if (!start_waste && read_len == len)
+		buf = data;
+	else
+		buf = malloc(read_len);
+	if (!buf)
+		return -ENOMEM;
 
 	rc = lseek(fd, read_start, SEEK_SET);
 	if (rc < 0) {
@@ -255,27 +313,27 @@ static int mtd_read(struct pnor *pnor, int fd, void *data, uint64_t offset,
 
 	/* Copy data into destination, carefully avoiding the extra data we
 	 * added to align to block size */
-	memcpy(data, buf + start_waste, len);
+	if (buf != data)
+		memcpy(data, buf + start_waste, len);
 	rc = len;
 out:
-	free(buf);
+	if (buf != data)
+		free(buf);
 	return rc;
 }
 
-/* Similar to read(2), this performs partial operations where the number of
- * bytes read/written may be less than size.
- *
- * Returns number of bytes written, or a negative value on failure. */
-int pnor_operation(struct pnor *pnor, const char *name, uint64_t offset,
-		   void *data, size_t requested_size, enum pnor_op op)
+static int pnor_get_part(struct pnor *pnor, const char *name,
+			 struct pnor_part **partp)
 {
-	int rc, fd;
+	struct pnor_part *part;
 	uint32_t pstart, psize, idx;
-	int size;
+	int rc;
 
-	if (!pnor->ffsh) {
-		pr_log(LOG_ERR, "PNOR: ffs not initialised");
-		return -EBUSY;
+	list_for_each(&pnor->parts, part, link) {
+		if (!strcmp(part->name, name)) {
+			*partp = part;
+			return 0;
+		}
 	}
 
 	rc = ffs_lookup_part(pnor->ffsh, name, &idx);
@@ -284,65 +342,284 @@ int pnor_operation(struct pnor *pnor, const char *name, uint64_t offset,
 		return -ENOENT;
 	}
 
-	ffs_part_info(pnor->ffsh, idx, NULL, &pstart, &psize, NULL, NULL);
+	rc = ffs_part_info(pnor->ffsh, idx, NULL, &pstart, &psize, NULL, NULL);
 	if (rc) {
 		pr_log(LOG_ERR, "PNOR: unable to fetch partition info for %s",
 				name);
 		return -ENOENT;
 	}
 
-	if (offset > psize) {
+	part = calloc(1, sizeof(*part));
+	if (!part)
+		return -ENOMEM;
+
+	part->name = strdup(name);
+	if (!part->name) {
+		free(part);
+		return -ENOMEM;
+	}
+
+	part->start = pstart;
+	part->size = psize;
+	list_head_init(&part->blocks);
+
+	/* Only cache partitions that don't share erase blocks with another */
+	part->cached = !(pstart % pnor->erasesize) &&
+		       !(psize % pnor->erasesize);
+	if (!part->cached)
+		pr_log(LOG_NOTICE, "PNOR: partition %s is not erase block "
+				"aligned, not caching", name);
+
+	list_add_tail(&pnor->parts, &part->link);
+	*partp = part;
+
+	return 0;
+}
+
+/*
+ * Find the erase block at @offset in the partition's cache, loading it
+ * from flash if it's not present. When the cache is full the least
+ * recently used block is reused.
+ */
+static struct pnor_block *pnor_get_block(struct pnor *pnor,
+					 struct pnor_part *part,
+					 uint32_t offset)
+{
+	struct pnor_block *block;
+	int rc;
+
+	list_for_each(&part->blocks, block, link) {
+		if (block->offset != offset)
+			continue;
+
+		list_del(&block->link);
+		list_add(&part->blocks, &block->link);
+		part->stats.hits++;
+		return block;
+	}
+
+	part->stats.misses++;
+
+	if (part->n_blocks >= PNOR_CACHE_BLOCKS) {
+		block = list_tail(&part->blocks, struct pnor_block, link);
+		list_del(&block->link);
+		part->n_blocks--;
+	} else {
+		block = malloc(sizeof(*block) + pnor->erasesize);
+		if (!block)
+			return NULL;
+	}
+
+	block->offset = offset;
+
+	rc = mtd_read(pnor, pnor->fd, block->data, offset, pnor->erasesize);
+	if (rc < 0) {
+		free(block);
+		return NULL;
+	}
+
+	list_add(&part->blocks, &block->link);
+	part->n_blocks++;
+
+	return block;
+}
+
+static int pnor_cached_read(struct pnor *pnor, struct pnor_part *part,
+			    uint32_t pos, void *data, int size)
+{
+	struct pnor_block *block;
+	uint32_t boff, chunk;
+	int done = 0;
+
+	while (done < size) {
+		boff = pos % pnor->erasesize;
+		chunk = pnor->erasesize - boff;
+		if (chunk > size - done)
+			chunk = size - done;
+
+		block = pnor_get_block(pnor, part, pos - boff);
+		if (!block)
+			return done ? done : -EIO;
+
+		memcpy(data + done, block->data + boff, chunk);
+
+		done += chunk;
+		pos += chunk;
+	}
+
+	return done;
+}
+
+/*
+ * Writes go straight to flash, the read-modify-write of partial erase
+ * blocks reads what is on flash now rather than what we have cached.
+ * Cached copies of the blocks written are then updated to match.
+ */
+static int pnor_cached_write(struct pnor *pnor, struct pnor_part *part,
+			     uint32_t pos, void *data, int size)
+{
+	struct pnor_block *block;
+	uint32_t start, end;
+	int rc;
+
+	rc = mtd_write(pnor, pnor->fd, data, pos, size);
+	if (rc < 0)
+		return rc;
+
+	list_for_each(&part->blocks, block, link) {
+		if (block->offset + pnor->erasesize <= pos ||
+		    block->offset >= pos + size)
+			continue;
+		start = block->offset > pos ? block->offset : pos;
+		end = block->offset + pnor->erasesize;
+		if (end > pos + size)
+			end = pos + size;
+		memcpy(block->data + start - block->offset,
+		       data + start - pos, end - start);
+	}
+
+	return rc;
+}
+
+/*
+ * Drop all cached blocks. Other tools (opal-gard, pflash) may write the
+ * same flash while we're not looking, so this is called once HBRT is done
+ * with each batch of work and the next batch reads the flash afresh.
+ */
+void pnor_invalidate(struct pnor *pnor)
+{
+	struct pnor_block *block, *nblock;
+	struct pnor_part *part;
+
+	if (!pnor->ffsh)
+		return;
+
+	list_for_each(&pnor->parts, part, link) {
+		list_for_each_safe(&part->blocks, block, nblock, link) {
+			list_del(&block->link);
+			free(block);
+		}
+		if (part->n_blocks)
+			part->stats.invalidations++;
+		part->n_blocks = 0;
+	}
+}
+
+/* Format the access statistics into @buf, returns the length written */
+int pnor_dump_stats(struct pnor *pnor, char *buf, size_t len)
+{
+	struct pnor_part *part;
+	int n;
+
+	if (!pnor->ffsh)
+		return snprintf(buf, len, "PNOR not initialised\n");
+
+	n = snprintf(buf, len, "mtd reads: %lu, mtd writes: %lu\n"
+			"%-16s %8s %8s %10s %10s %8s %8s %8s\n",
+			pnor->mtd_reads, pnor->mtd_writes, "partition",
+			"reads", "writes", "rd bytes", "wr bytes",
+			"hits", "misses", "invals");
+
+	list_for_each(&pnor->parts, part, link) {
+		if (n >= len)
+			break;
+		n += snprintf(buf + n, len - n,
+				"%-16s %8lu %8lu %10lu %10lu %8lu %8lu %8lu\n",
+				part->name, part->stats.reads,
+				part->stats.writes, part->stats.read_bytes,
+				part->stats.write_bytes, part->stats.hits,
+				part->stats.misses,
+				part->stats.invalidations);
+	}
+
+	return n < len ? n : len - 1;
+}
+
+/* Similar to read(2), this performs partial operations where the number of
+ * bytes read/written may be less than size.
+ *
+ * Reads are served from the partition's cache until pnor_invalidate(),
+ * writes always go through to flash.
+ *
+ * Returns number of bytes written, or a negative value on failure. */
+int pnor_operation(struct pnor *pnor, const char *name, uint64_t offset,
+		   void *data, size_t requested_size, enum pnor_op op)
+{
+	struct pnor_part *part;
+	int rc, size;
+
+	if (!pnor->ffsh) {
+		pr_log(LOG_ERR, "PNOR: ffs not initialised");
+		return -EBUSY;
+	}
+
+	rc = pnor_get_part(pnor, name, &part);
+	if (rc)
+		return rc;
+
+	if (offset > part->size) {
 		pr_log(LOG_WARNING, "PNOR: partition %s(size 0x%x) "
 				"offset (0x%lx) out of bounds",
-				name, psize, offset);
+				name, part->size, offset);
 		return -ERANGE;
 	}
 
 	/* Large requests are trimmed */
-	if (requested_size > psize)
-		size = psize;
+	if (requested_size > part->size)
+		size = part->size;
 	else
 		size = requested_size;
 
-	if (size + offset > psize)
-		size = psize - offset;
+	if (size + offset > part->size)
+		size = part->size - offset;
 
 	if (size < 0) {
 		pr_log(LOG_WARNING, "PNOR: partition %s(size 0x%x) "
 				"read size (0x%zx) and offset (0x%lx) "
 				"out of bounds",
-				name, psize, requested_size, offset);
+				name, part->size, requested_size, offset);
 		return -ERANGE;
 	}
 
-	fd = open(pnor->path, O_RDWR);
-	if (fd < 0) {
-		perror(pnor->path);
-		return fd;
-	}
-
 	switch (op) {
 	case PNOR_OP_READ:
-		rc = mtd_read(pnor, fd, data, pstart + offset, size);
+		part->stats.reads++;
+		if (part->cached)
+			rc = pnor_cached_read(pnor, part,
+					      part->start + offset, data, size);
+		else
+			rc = mtd_read(pnor, pnor->fd, data,
+				      part->start + offset, size);
 		break;
 	case PNOR_OP_WRITE:
-		rc = mtd_write(pnor, fd, data, pstart + offset, size);
+		part->stats.writes++;
+		if (part->cached)
+			rc = pnor_cached_write(pnor, part,
+					       part->start + offset, data, size);
+		else
+			rc = mtd_write(pnor, pnor->fd, data,
+				       part->start + offset, size);
 		break;
 	default:
 		rc  = -EIO;
 		pr_log(LOG_ERR, "PNOR: Invalid operation");
-		goto out;
+		return rc;
 	}
 
-	if (rc < 0)
+	if (rc < 0) {
 		pr_log(LOG_ERR, "PNOR: MTD operation failed");
-	else if (rc != size)
+		return rc;
+	}
+
+	if (op == PNOR_OP_READ)
+		part->stats.read_bytes += rc;
+	else
+		part->stats.write_bytes += rc;
+
+	if (rc != size)
 		pr_log(LOG_WARNING, "PNOR: mtd operation "
 				"returned %d, expected %d",
 				rc, size);
 
-out:
-	close(fd);
-
 	return rc;
 }
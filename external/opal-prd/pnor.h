@@ -1,13 +1,47 @@
 #ifndef PNOR_H
 #define PNOR_H
 
+#include <stdbool.h>
 #include <libflash/libffs.h>
+#include <ccan/list/list.h>
+
+struct pnor_stats {
+	uint64_t		reads;
+	uint64_t		writes;
+	uint64_t		read_bytes;
+	uint64_t		write_bytes;
+	uint64_t		hits;
+	uint64_t		misses;
+	uint64_t		invalidations;
+};
+
+/* A cached erase block, kept on its partition's list in LRU order */
+struct pnor_block {
+	struct list_node	link;
+	uint32_t		offset;
+	uint8_t			data[];
+};
+
+struct pnor_part {
+	struct list_node	link;
+	char			*name;
+	uint32_t		start;
+	uint32_t		size;
+	bool			cached;
+	struct list_head	blocks;
+	unsigned int		n_blocks;
+	struct pnor_stats	stats;
+};
 
 struct pnor {
 	char			*path;
 	struct ffs_handle	*ffsh;
 	uint32_t		size;
 	uint32_t		erasesize;
+	int			fd;
+	struct list_head	parts;
+	uint64_t		mtd_reads;
+	uint64_t		mtd_writes;
 };
 
 enum pnor_op {
@@ -19,6 +53,9 @@ extern int pnor_operation(struct pnor *pnor, const char *name,
 			  uint64_t offset, void *data, size_t size,
 			  enum pnor_op);
 
+extern void pnor_invalidate(struct pnor *pnor);
+extern int pnor_dump_stats(struct pnor *pnor, char *buf, size_t len);
+
 extern int pnor_init(struct pnor *pnor);
 extern void pnor_close(struct pnor *pnor);
 
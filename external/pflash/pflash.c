@@ -24,11 +24,14 @@
 #include <unistd.h>
 #include <byteswap.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <stdbool.h>
 #include <getopt.h>
 #include <limits.h>
 #include <arpa/inet.h>
 #include <assert.h>
+#include <pthread.h>
+#include <time.h>
 
 #include <libflash/libflash.h>
 #include <libflash/libffs.h>
@@ -49,7 +52,158 @@ static uint32_t ffs_toc = 0;
 static int flash_side = 0;
 
 #define FILE_BUF_SIZE	0x10000
-static uint8_t file_buf[FILE_BUF_SIZE] __aligned(0x1000);
+#define FILE_BUF_COUNT	4
+static uint8_t file_buf[FILE_BUF_COUNT][FILE_BUF_SIZE] __aligned(0x1000);
+static uint8_t verify_buf[FILE_BUF_SIZE] __aligned(0x1000);
+
+static bool do_verify;
+static bool do_bench;
+
+/*
+ * Programming and reading are split in two stages, file I/O in a helper
+ * thread and flash I/O in the main thread, passing the chunks in file_buf
+ * between them so that neither side sits idle waiting for the other.
+ */
+struct pipeline {
+	pthread_mutex_t	lock;
+	pthread_cond_t	cond;
+	ssize_t		len[FILE_BUF_COUNT];
+	uint32_t	pos[FILE_BUF_COUNT];
+	unsigned int	head;	/* Next buffer to be filled */
+	unsigned int	tail;	/* Next buffer to be drained */
+	bool		done;
+	int		fd;
+	uint32_t	start;
+	uint32_t	size;
+};
+
+struct stage_stat {
+	const char	*name;
+	uint64_t	bytes;
+	struct timespec	time;
+};
+
+static struct stage_stat stat_file_read = { .name = "file read" };
+static struct stage_stat stat_file_write = { .name = "file write" };
+static struct stage_stat stat_flash_read = { .name = "flash read" };
+static struct stage_stat stat_flash_write = { .name = "flash write" };
+static struct stage_stat stat_flash_verify = { .name = "flash verify" };
+static struct stage_stat stat_erase = { .name = "flash erase" };
+
+static void stage_start(struct timespec *ts)
+{
+	if (do_bench)
+		clock_gettime(CLOCK_MONOTONIC, ts);
+}
+
+static void stage_end(struct stage_stat *stat, struct timespec *start,
+		      uint32_t bytes)
+{
+	struct timespec now;
+
+	if (!do_bench)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	stat->bytes += bytes;
+	stat->time.tv_sec += now.tv_sec - start->tv_sec;
+	stat->time.tv_nsec += now.tv_nsec - start->tv_nsec;
+	if (stat->time.tv_nsec < 0) {
+		stat->time.tv_sec--;
+		stat->time.tv_nsec += 1000000000;
+	} else if (stat->time.tv_nsec >= 1000000000) {
+		stat->time.tv_sec++;
+		stat->time.tv_nsec -= 1000000000;
+	}
+}
+
+static void print_stage_stat(struct stage_stat *stat)
+{
+	double secs;
+
+	if (!stat->bytes)
+		return;
+
+	secs = stat->time.tv_sec + stat->time.tv_nsec / 1e9;
+	printf("%-14s %10"PRIu64" bytes in %8.3fs: %8.2f MB/s\n",
+	       stat->name, stat->bytes, secs,
+	       secs ? stat->bytes / secs / (1024 * 1024) : 0.0);
+}
+
+static void print_bench(void)
+{
+	printf("Benchmark:\n");
+	print_stage_stat(&stat_erase);
+	print_stage_stat(&stat_file_read);
+	print_stage_stat(&stat_flash_write);
+	print_stage_stat(&stat_flash_verify);
+	print_stage_stat(&stat_flash_read);
+	print_stage_stat(&stat_file_write);
+}
+
+static void pipeline_init(struct pipeline *p, int fd, uint32_t start,
+			  uint32_t size)
+{
+	memset(p, 0, sizeof(*p));
+	pthread_mutex_init(&p->lock, NULL);
+	pthread_cond_init(&p->cond, NULL);
+	p->fd = fd;
+	p->start = start;
+	p->size = size;
+}
+
+/* Get the next empty buffer, waiting for the consumer if they're all full */
+static unsigned int pipeline_get_empty(struct pipeline *p)
+{
+	unsigned int idx;
+
+	pthread_mutex_lock(&p->lock);
+	while (p->head - p->tail == FILE_BUF_COUNT)
+		pthread_cond_wait(&p->cond, &p->lock);
+	idx = p->head % FILE_BUF_COUNT;
+	pthread_mutex_unlock(&p->lock);
+
+	return idx;
+}
+
+/* Hand a filled buffer over to the consumer, a zero length ends the stream */
+static void pipeline_put_full(struct pipeline *p, unsigned int idx,
+			      uint32_t pos, ssize_t len)
+{
+	pthread_mutex_lock(&p->lock);
+	if (len) {
+		p->len[idx] = len;
+		p->pos[idx] = pos;
+		p->head++;
+	} else {
+		p->done = true;
+	}
+	pthread_cond_broadcast(&p->cond);
+	pthread_mutex_unlock(&p->lock);
+}
+
+/* Get the next filled buffer, returns -1 once the stream has ended */
+static int pipeline_get_full(struct pipeline *p)
+{
+	int idx = -1;
+
+	pthread_mutex_lock(&p->lock);
+	while (p->head == p->tail && !p->done)
+		pthread_cond_wait(&p->cond, &p->lock);
+	if (p->head != p->tail)
+		idx = p->tail % FILE_BUF_COUNT;
+	pthread_mutex_unlock(&p->lock);
+
+	return idx;
+}
+
+static void pipeline_put_empty(struct pipeline *p)
+{
+	pthread_mutex_lock(&p->lock);
+	p->tail++;
+	pthread_cond_broadcast(&p->cond);
+	pthread_mutex_unlock(&p->lock);
+}
 
 static struct blocklevel_device *bl;
 static struct ffs_handle	*ffsh;
@@ -232,7 +386,8 @@ static void erase_chip(void)
 
 static void erase_range(uint32_t start, uint32_t size, bool will_program)
 {
-	uint32_t done = 0;
+	uint32_t done = 0, total;
+	struct timespec ts;
 	int rc;
 
 	printf("About to erase 0x%08x..0x%08x !\n", start, start + size);
@@ -244,6 +399,8 @@ static void erase_range(uint32_t start, uint32_t size, bool will_program)
 	}
 
 	printf("Erasing...\n");
+	stage_start(&ts);
+	total = size;
 	progress_init(size >> 8);
 	while(size) {
 		/* If aligned to 64k and at least 64k, use 64k erase */
@@ -271,6 +428,7 @@ static void erase_range(uint32_t start, uint32_t size, bool will_program)
 		progress_tick(done >> 8);
 	}
 	progress_end();
+	stage_end(&stat_erase, &ts, total);
 
 	/* If this is a flash partition, mark it empty if we aren't
 	 * going to program over it as well
@@ -300,11 +458,46 @@ static void set_ecc(uint32_t start, uint32_t size)
 	progress_end();
 }
 
-static void program_file(const char *file, uint32_t start, uint32_t size)
+static void *file_reader(void *arg)
 {
-	int fd, rc;
+	struct pipeline *p = arg;
+	uint32_t pos = p->start, size = p->size;
+	struct timespec ts;
+	unsigned int idx;
 	ssize_t len;
+
+	while (size) {
+		idx = pipeline_get_empty(p);
+
+		stage_start(&ts);
+		len = read(p->fd, file_buf[idx], FILE_BUF_SIZE);
+		if (len < 0) {
+			perror("Error reading file");
+			exit(1);
+		}
+		if (len == 0)
+			break;
+		if (len > size)
+			len = size;
+		stage_end(&stat_file_read, &ts, len);
+
+		pipeline_put_full(p, idx, pos, len);
+		pos += len;
+		size -= len;
+	}
+	pipeline_put_full(p, 0, pos, 0);
+
+	return NULL;
+}
+
+static void program_file(const char *file, uint32_t start, uint32_t size)
+{
+	int fd, rc, idx;
 	uint32_t actual_size = 0;
+	struct pipeline pipe;
+	struct timespec ts;
+	pthread_t reader;
+	ssize_t len;
 
 	fd = open(file, O_RDONLY);
 	if (fd == -1) {
@@ -320,21 +513,22 @@ static void program_file(const char *file, uint32_t start, uint32_t size)
 		return;
 	}
 
-	printf("Programming & Verifying...\n");
+	pipeline_init(&pipe, fd, start, size);
+	rc = pthread_create(&reader, NULL, file_reader, &pipe);
+	if (rc) {
+		fprintf(stderr, "Failed to start file reader: %s\n",
+			strerror(rc));
+		exit(1);
+	}
+
+	printf("Programming%s...\n", do_verify ? " & Verifying" : "");
 	progress_init(size >> 8);
-	while(size) {
-		len = read(fd, file_buf, FILE_BUF_SIZE);
-		if (len < 0) {
-			perror("Error reading file");
-			exit(1);
-		}
-		if (len == 0)
-			break;
-		if (len > size)
-			len = size;
-		size -= len;
-		actual_size += len;
-		rc = blocklevel_write(bl, start, file_buf, len);
+	while ((idx = pipeline_get_full(&pipe)) >= 0) {
+		len = pipe.len[idx];
+		start = pipe.pos[idx];
+
+		stage_start(&ts);
+		rc = blocklevel_write(bl, start, file_buf[idx], len);
 		if (rc) {
 			if (rc == FLASH_ERR_VERIFY_FAILURE)
 				fprintf(stderr, "Verification failed for"
@@ -344,10 +538,32 @@ static void program_file(const char *file, uint32_t start, uint32_t size)
 					" chunk at 0x%08x\n", rc, start);
 			exit(1);
 		}
-		start += len;
+		stage_end(&stat_flash_write, &ts, len);
+
+		/* The chunk we just wrote is still in file_buf, compare
+		 * against that rather than going back to the file */
+		if (do_verify) {
+			stage_start(&ts);
+			rc = blocklevel_read(bl, start, verify_buf, len);
+			if (rc) {
+				fprintf(stderr, "Flash read error %d for"
+					" chunk at 0x%08x\n", rc, start);
+				exit(1);
+			}
+			if (memcmp(verify_buf, file_buf[idx], len)) {
+				fprintf(stderr, "Verification failed for"
+					" chunk at 0x%08x\n", start);
+				exit(1);
+			}
+			stage_end(&stat_flash_verify, &ts, len);
+		}
+
+		pipeline_put_empty(&pipe);
+		actual_size += len;
 		progress_tick(actual_size >> 8);
 	}
 	progress_end();
+	pthread_join(reader, NULL);
 	close(fd);
 
 	/* If this is a flash partition, adjust its size */
@@ -357,11 +573,36 @@ static void program_file(const char *file, uint32_t start, uint32_t size)
 	}
 }
 
+static void *file_writer(void *arg)
+{
+	struct pipeline *p = arg;
+	struct timespec ts;
+	ssize_t rc;
+	int idx;
+
+	while ((idx = pipeline_get_full(p)) >= 0) {
+		stage_start(&ts);
+		rc = write(p->fd, file_buf[idx], p->len[idx]);
+		if (rc < 0) {
+			perror("Error writing file");
+			exit(1);
+		}
+		stage_end(&stat_file_write, &ts, p->len[idx]);
+		pipeline_put_empty(p);
+	}
+
+	return NULL;
+}
+
 static void do_read_file(const char *file, uint32_t start, uint32_t size)
 {
 	int fd, rc;
 	ssize_t len;
 	uint32_t done = 0;
+	struct pipeline pipe;
+	struct timespec ts;
+	pthread_t writer;
+	unsigned int idx;
 
 	fd = open(file, O_WRONLY | O_TRUNC | O_CREAT, 00666);
 	if (fd == -1) {
@@ -371,25 +612,36 @@ static void do_read_file(const char *file, uint32_t start, uint32_t size)
 	printf("Reading to \"%s\" from 0x%08x..0x%08x !\n",
 	       file, start, start + size);
 
+	pipeline_init(&pipe, fd, start, size);
+	rc = pthread_create(&writer, NULL, file_writer, &pipe);
+	if (rc) {
+		fprintf(stderr, "Failed to start file writer: %s\n",
+			strerror(rc));
+		exit(1);
+	}
+
 	progress_init(size >> 8);
 	while(size) {
 		len = size > FILE_BUF_SIZE ? FILE_BUF_SIZE : size;
-		rc = blocklevel_read(bl, start, file_buf, len);
+		idx = pipeline_get_empty(&pipe);
+
+		stage_start(&ts);
+		rc = blocklevel_read(bl, start, file_buf[idx], len);
 		if (rc) {
 			fprintf(stderr, "Flash read error %d for"
 				" chunk at 0x%08x\n", rc, start);
 			exit(1);
 		}
-		rc = write(fd, file_buf, len);
-		if (rc < 0) {
-			perror("Error writing file");
-			exit(1);
-		}
+		stage_end(&stat_flash_read, &ts, len);
+
+		pipeline_put_full(&pipe, idx, start, len);
 		start += len;
 		size -= len;
 		done += len;
 		progress_tick(done >> 8);
 	}
+	pipeline_put_full(&pipe, 0, start, 0);
+	pthread_join(writer, NULL);
 	progress_end();
 	close(fd);
 }
@@ -491,6 +743,11 @@ static void print_help(const char *pname)
 	printf("\t\tthe specified size (whatever is smaller). If used in\n");
 	printf("\t\tconjunction with any erase command, the erase will\n");
 	printf("\t\ttake place first.\n\n");
+	printf("\t-V, --verify\n");
+	printf("\t\tRead back and compare each chunk after programming it\n\n");
+	printf("\t-B, --bench\n");
+	printf("\t\tReport the throughput of each stage of erasing,\n");
+	printf("\t\tprogramming and reading\n\n");
 	printf("\t-t, --tune\n");
 	printf("\t\tJust tune the flash controller & access size\n");
 	printf("\t\t(Implicit for all other operations)\n\n");
@@ -546,11 +803,14 @@ int main(int argc, char *argv[])
 			{"debug",	no_argument,		NULL,	'g'},
 			{"side",	required_argument,	NULL,	'S'},
 			{"toc",		required_argument,	NULL,	'T'},
-			{"clear",   no_argument,        NULL,   'c'}
+			{"clear",   no_argument,        NULL,   'c'},
+			{"verify",	no_argument,		NULL,	'V'},
+			{"bench",	no_argument,		NULL,	'B'},
+			{NULL,		0,			NULL,	0}
 		};
 		int c, oidx = 0;
 
-		c = getopt_long(argc, argv, "a:s:P:r:43Eep:fdihvbtgS:T:c",
+		c = getopt_long(argc, argv, "a:s:P:r:43Eep:fdihvbtgS:T:cVB",
 				long_opts, &oidx);
 		if (c == EOF)
 			break;
@@ -619,6 +879,12 @@ int main(int argc, char *argv[])
 		case 'c':
 			do_clear = true;
 			break;
+		case 'V':
+			do_verify = true;
+			break;
+		case 'B':
+			do_bench = true;
+			break;
 		default:
 			exit(1);
 		}
@@ -844,5 +1110,7 @@ int main(int argc, char *argv[])
 		program_file(write_file, address, write_size);
 	if (do_clear)
 		set_ecc(address, write_size);
+	if (do_bench)
+		print_bench();
 	return 0;
 }
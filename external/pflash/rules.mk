@@ -25,5 +25,5 @@ $(LIBFLASH_OBJS): libflash-%.o : libflash/%.c
 	$(CC) $(CFLAGS) -c $< -o $@
 
 $(EXE): $(OBJS)
-	$(CC) $(CFLAGS) $^ -lrt -o $@
+	$(CC) $(CFLAGS) $^ -lrt -lpthread -o $@
 
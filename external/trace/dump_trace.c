@@ -24,6 +24,9 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <unistd.h>
+#include <stdlib.h>
+#include <elf.h>
+#include <sys/mman.h>
 
 #include "../../ccan/endian/endian.h"
 #include "../../ccan/short_types/short_types.h"
@@ -150,14 +153,208 @@ static void dump_uart(struct trace_uart *t)
 	}
 }
 
+/* The skiboot .rodata section, for TRACE_PRLOG format strings */
+static const char *rodata;
+static size_t rodata_size;
+
+static void load_rodata(const char *path)
+{
+	const struct elf64_hdr *eh;
+	const struct elf64_shdr *sh;
+	const char *strtab, *image;
+	struct stat st;
+	bool be;
+	int fd, i;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) < 0)
+		err(1, "Opening %s", path);
+	image = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (image == MAP_FAILED)
+		err(1, "Mapping %s", path);
+	close(fd);
+
+	eh = (const struct elf64_hdr *)image;
+	if (st.st_size < sizeof(*eh) || be32_to_cpu(eh->ei_ident) != ELF_IDENT ||
+	    eh->ei_class != ELF_CLASS_64)
+		errx(1, "%s is not a 64-bit ELF file", path);
+	be = eh->ei_data == ELF_DATA_MSB;
+
+#define E16(x) (be ? be16_to_cpu(x) : le16_to_cpu(x))
+#define E32(x) (be ? be32_to_cpu(x) : le32_to_cpu(x))
+#define E64(x) (be ? be64_to_cpu(x) : le64_to_cpu(x))
+	sh = (const struct elf64_shdr *)(image + E64(eh->e_shoff));
+	strtab = image + E64(sh[E16(eh->e_shstrndx)].sh_offset);
+	for (i = 0; i < E16(eh->e_shnum); i++) {
+		if (strcmp(strtab + E32(sh[i].sh_name), ".rodata"))
+			continue;
+		rodata = image + E64(sh[i].sh_offset);
+		rodata_size = E64(sh[i].sh_size);
+		return;
+	}
+#undef E16
+#undef E32
+#undef E64
+	errx(1, "No .rodata section in %s", path);
+}
+
+static const char *rodata_str(u64 off)
+{
+	if (!rodata || off >= rodata_size ||
+	    !memchr(rodata + off, '\0', rodata_size - off))
+		return NULL;
+	return rodata + off;
+}
+
+/* Format one conversion the way skiboot's libc vsnprintf() does */
+static void prlog_conv(const char *spec, size_t slen, u64 v,
+		       const char *str, int strlen)
+{
+	unsigned int i, length_mod = sizeof(int), width = 0;
+	bool zero = false;
+	char c = spec[slen - 1];
+
+	for (i = 1; i < slen - 1; i++) {
+		switch (spec[i]) {
+		case 'l':
+			length_mod = spec[i + 1] == 'l' ?
+				sizeof(long long) : sizeof(long);
+			if (spec[i + 1] == 'l')
+				i++;
+			break;
+		case 'h':
+			length_mod = spec[i + 1] == 'h' ?
+				sizeof(char) : sizeof(short);
+			if (spec[i + 1] == 'h')
+				i++;
+			break;
+		case 'z':
+			length_mod = sizeof(size_t);
+			break;
+		default:
+			if (i == 1 && (spec[i] == '0' || spec[i] == '.'))
+				zero = true;
+			else if (spec[i] >= '0' && spec[i] <= '9')
+				width = width * 10 + spec[i] - '0';
+		}
+	}
+
+	if (length_mod < sizeof(v))
+		v &= (1ull << (length_mod * 8)) - 1;
+
+	switch (c) {
+	case 'd':
+	case 'i':
+		if (length_mod < sizeof(v) && (v >> (length_mod * 8 - 1)))
+			v |= ~0ull << (length_mod * 8);
+		printf(zero ? "%0*lld" : "%*lld", width, (long long)v);
+		break;
+	case 'u':
+		printf(zero ? "%0*llu" : "%*llu", width, (unsigned long long)v);
+		break;
+	case 'x':
+		printf(zero ? "%0*llx" : "%*llx", width, (unsigned long long)v);
+		break;
+	case 'X':
+		printf(zero ? "%0*llX" : "%*llX", width, (unsigned long long)v);
+		break;
+	case 'o':
+	case 'O':
+		printf(zero ? "%0*llo" : "%*llo", width, (unsigned long long)v);
+		break;
+	case 'p':
+		printf("0x%llx", (unsigned long long)v);
+		break;
+	case 'c':
+		printf("%*c", width, (int)(v & 0xff));
+		break;
+	case 's':
+		printf("%*.*s", width, strlen, str);
+		break;
+	}
+}
+
+static void dump_prlog(struct trace_prlog *t)
+{
+	unsigned int n = t->hdr.len_div_8 * 8 - offsetof(struct trace_prlog, data);
+	unsigned int pos = 0;
+	const char *fmt, *spec, *str;
+	bool nl = false;
+	int slen;
+	__be64 bv;
+	u64 v;
+
+	printf("PRLOG %u: ", t->level);
+
+	fmt = rodata_str(be32_to_cpu(t->fmt));
+	if (!fmt) {
+		printf("fmt=0x%08x [", be32_to_cpu(t->fmt));
+		for (; pos + sizeof(bv) <= n; pos += sizeof(bv)) {
+			memcpy(&bv, t->data + pos, sizeof(bv));
+			printf("%s%016"PRIx64, pos ? " " : "", be64_to_cpu(bv));
+		}
+		printf("]\n");
+		return;
+	}
+
+	for (; *fmt; fmt++) {
+		if (*fmt != '%') {
+			putchar(*fmt);
+			nl = *fmt == '\n';
+			continue;
+		}
+		nl = false;
+		spec = fmt;
+		fmt += strcspn(fmt + 1, "diuxXpcsOo%") + 1;
+		if (!*fmt)
+			break;
+		if (*fmt == '%') {
+			putchar('%');
+			continue;
+		}
+		if (pos + sizeof(bv) > n) {
+			printf("<missing>");
+			continue;
+		}
+		memcpy(&bv, t->data + pos, sizeof(bv));
+		v = be64_to_cpu(bv);
+		pos += sizeof(bv);
+
+		str = NULL;
+		slen = -1;
+		if (*fmt == 's') {
+			if (v & TRACE_PRLOG_INLINE) {
+				slen = v & ~TRACE_PRLOG_INLINE;
+				if (pos + slen > n)
+					slen = n - pos;
+				str = (const char *)t->data + pos;
+				pos += (slen + 7) & ~7;
+			} else
+				str = rodata_str(v);
+			if (!str)
+				str = "<bad string>";
+		}
+		prlog_conv(spec, fmt - spec + 1, v, str, slen);
+	}
+	/* Messages normally end in a newline, but don't rely on it */
+	if (!nl)
+		putchar('\n');
+}
+
 int main(int argc, char *argv[])
 {
 	int fd, len = 0;
 	union trace t;
 	const char *in = "/sys/kernel/debug/powerpc/opal-trace";
 
+	if (argc > 2 && !strcmp(argv[1], "-e")) {
+		load_rodata(argv[2]);
+		argc -= 2;
+		argv += 2;
+	}
+
 	if (argc > 2)
-		errx(1, "Usage: dump_trace [file]");
+		errx(1, "Usage: dump_trace [-e skiboot.elf] [file]");
 
 	if (argv[1])
 		in = argv[1];
@@ -188,6 +385,9 @@ int main(int argc, char *argv[])
 		case TRACE_UART:
 			dump_uart(&t.uart);
 			break;
+		case TRACE_PRLOG:
+			dump_prlog(&t.prlog);
+			break;
 		default:
 			printf("UNKNOWN(%u) CPU %u length %u\n",
 			       t.hdr.type, be16_to_cpu(t.hdr.cpu),
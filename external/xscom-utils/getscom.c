@@ -10,6 +10,8 @@
 static void print_usage(void)
 {
 	printf("usage: getscom [-c|--chip chip-id] addr\n");
+	printf("       getscom [-c|--chip chip-id] -b|--batch < list\n");
+	printf("         list: one \"[chip-id] addr\" per line\n");
 	printf("       getscom -l|--list-chips\n");
 	printf("       getscom -v|--version\n");
 }
@@ -54,6 +56,30 @@ static void print_chip_info(uint32_t chip_id)
 	
 }
 
+static int do_batch(uint32_t chip_id)
+{
+	struct xscom_batch_op *ops;
+	int i, count, failed;
+
+	count = xscom_batch_parse(stdin, chip_id, false, &ops);
+	if (count < 0)
+		return 1;
+
+	failed = xscom_batch(ops, count);
+	for (i = 0; i < count; i++) {
+		if (ops[i].rc)
+			fprintf(stderr, "Error %d reading XSCOM %08x %016"
+				PRIx64 "\n", ops[i].rc, ops[i].chip_id,
+				ops[i].addr);
+		else
+			printf("%08x %016" PRIx64 " %016" PRIx64 "\n",
+			       ops[i].chip_id, ops[i].addr, ops[i].val);
+	}
+	free(ops);
+
+	return failed ? 1 : 0;
+}
+
 #define VERSION_STR _str(VERSION)
 #define _str(s) __str(s)
 #define __str(s) #s
@@ -66,6 +92,7 @@ int main(int argc, char *argv[])
 	bool list_chips = false;
 	bool show_version = false;
 	bool no_work = false;
+	bool batch = false;
 	int rc;
 
 	while(1) {
@@ -74,10 +101,12 @@ int main(int argc, char *argv[])
 			{"list-chips",	no_argument,		NULL,	'l'},
 			{"help",	no_argument,		NULL,	'h'},
 			{"version",	no_argument,		NULL,	'v'},
+			{"batch",	no_argument,		NULL,	'b'},
+			{NULL,		0,			NULL,	0}
 		};
 		int c, oidx = 0;
 
-		c = getopt_long(argc, argv, "-c:hlv", long_opts, &oidx);
+		c = getopt_long(argc, argv, "-c:hlvb", long_opts, &oidx);
 		if (c == EOF)
 			break;
 		switch(c) {
@@ -96,12 +125,15 @@ int main(int argc, char *argv[])
 		case 'v':
 			show_version = true;
 			break;
+		case 'b':
+			batch = true;
+			break;
 		default:
 			exit(1);
 		}
 	}
 	
-	if (addr == -1ull)
+	if (addr == -1ull && !batch)
 		no_work = true;
 	if (no_work && !list_chips && !show_version && !show_help) {
 		fprintf(stderr, "Invalid or missing address\n");
@@ -129,6 +161,9 @@ int main(int argc, char *argv[])
 	if (chip_id == 0xffffffff)
 		chip_id = def_chip;
 
+	if (batch)
+		return do_batch(chip_id);
+
 	rc = xscom_read(chip_id, addr, &val);
 	if (rc) {
 		fprintf(stderr,"Error %d reading XSCOM\n", rc);
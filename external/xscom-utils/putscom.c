@@ -10,9 +10,32 @@
 static void print_usage(void)
 {
 	printf("usage: putscom [-c|--chip chip-id] addr value\n");
+	printf("       putscom [-c|--chip chip-id] -b|--batch < list\n");
+	printf("         list: one \"[chip-id] addr value\" per line\n");
 	printf("       putscom -v|--version\n");
 }
 
+static int do_batch(uint32_t chip_id)
+{
+	struct xscom_batch_op *ops;
+	int i, count, failed;
+
+	count = xscom_batch_parse(stdin, chip_id, true, &ops);
+	if (count < 0)
+		return 1;
+
+	/* Unlike a single putscom, don't read back: that'd halve the rate */
+	failed = xscom_batch(ops, count);
+	for (i = 0; i < count; i++)
+		if (ops[i].rc)
+			fprintf(stderr, "Error %d writing XSCOM %08x %016"
+				PRIx64 "\n", ops[i].rc, ops[i].chip_id,
+				ops[i].addr);
+	free(ops);
+
+	return failed ? 1 : 0;
+}
+
 #define VERSION_STR _str(VERSION)
 #define _str(s) __str(s)
 #define __str(s) #s
@@ -24,6 +47,7 @@ int main(int argc, char *argv[])
 	bool show_help = false, got_addr = false, got_val = false;
 	bool show_version = false;
 	bool no_work = false;
+	bool batch = false;
 	int rc;
 
 	while(1) {
@@ -31,10 +55,12 @@ int main(int argc, char *argv[])
 			{"chip",	required_argument,	NULL,	'c'},
 			{"help",	no_argument,		NULL,	'h'},
 			{"version",	no_argument,		NULL,	'v'},
+			{"batch",	no_argument,		NULL,	'b'},
+			{NULL,		0,			NULL,	0}
 		};
 		int c, oidx = 0;
 
-		c = getopt_long(argc, argv, "-c:hv", long_opts, &oidx);
+		c = getopt_long(argc, argv, "-c:hvb", long_opts, &oidx);
 		if (c == EOF)
 			break;
 		switch(c) {
@@ -56,12 +82,15 @@ int main(int argc, char *argv[])
 		case 'h':
 			show_help = true;
 			break;
+		case 'b':
+			batch = true;
+			break;
 		default:
 			exit(1);
 		}
 	}
 	
-	if (!got_addr || !got_val)
+	if ((!got_addr || !got_val) && !batch)
 		no_work = true;
 	if (no_work && !show_version && !show_help) {
 		fprintf(stderr, "Invalid or missing address/value\n");
@@ -82,6 +111,9 @@ int main(int argc, char *argv[])
 	if (chip_id == 0xffffffff)
 		chip_id = def_chip;
 
+	if (batch)
+		return do_batch(chip_id);
+
 	rc = xscom_write(chip_id, addr, val);
 	if (rc) {
 		fprintf(stderr,"Error %d writing XSCOM\n", rc);
@@ -120,16 +120,11 @@ static uint64_t xscom_mangle_addr(uint64_t addr)
 	return addr << 3;
 }
 
-int xscom_read(uint32_t chip_id, uint64_t addr, uint64_t *val)
+static int xscom_chip_read(struct xscom_chip *c, uint64_t addr, uint64_t *val)
 {
-	struct xscom_chip *c = xscom_find_chip(chip_id);
 	int rc;
 
-	if (!c)
-		return -ENODEV;
-	addr = xscom_mangle_addr(addr);
-	lseek64(c->fd, addr, SEEK_SET);
-	rc = read(c->fd, val, 8);
+	rc = pread64(c->fd, val, 8, xscom_mangle_addr(addr));
 	if (rc < 0)
 		return -errno;
 	if (rc != 8)
@@ -137,16 +132,11 @@ int xscom_read(uint32_t chip_id, uint64_t addr, uint64_t *val)
 	return 0;
 }
 
-int xscom_write(uint32_t chip_id, uint64_t addr, uint64_t val)
+static int xscom_chip_write(struct xscom_chip *c, uint64_t addr, uint64_t val)
 {
-	struct xscom_chip *c = xscom_find_chip(chip_id);
 	int rc;
 
-	if (!c)
-		return -ENODEV;
-	addr = xscom_mangle_addr(addr);
-	lseek64(c->fd, addr, SEEK_SET);
-	rc = write(c->fd, &val, 8);
+	rc = pwrite64(c->fd, &val, 8, xscom_mangle_addr(addr));
 	if (rc < 0)
 		return -errno;
 	if (rc != 8)
@@ -154,6 +144,105 @@ int xscom_write(uint32_t chip_id, uint64_t addr, uint64_t val)
 	return 0;
 }
 
+int xscom_read(uint32_t chip_id, uint64_t addr, uint64_t *val)
+{
+	struct xscom_chip *c = xscom_find_chip(chip_id);
+
+	if (!c)
+		return -ENODEV;
+	return xscom_chip_read(c, addr, val);
+}
+
+int xscom_write(uint32_t chip_id, uint64_t addr, uint64_t val)
+{
+	struct xscom_chip *c = xscom_find_chip(chip_id);
+
+	if (!c)
+		return -ENODEV;
+	return xscom_chip_write(c, addr, val);
+}
+
+/*
+ * Run a list of accesses, each one gets its own rc and a failure doesn't
+ * stop the rest. Returns the number of failed accesses.
+ */
+int xscom_batch(struct xscom_batch_op *ops, unsigned int count)
+{
+	struct xscom_chip *c = NULL;
+	unsigned int i;
+	int failed = 0;
+
+	for (i = 0; i < count; i++) {
+		struct xscom_batch_op *op = &ops[i];
+
+		/* Lists tend to target one chip, skip the lookup */
+		if (!c || c->chip_id != op->chip_id)
+			c = xscom_find_chip(op->chip_id);
+		if (!c)
+			op->rc = -ENODEV;
+		else if (op->write)
+			op->rc = xscom_chip_write(c, op->addr, op->val);
+		else
+			op->rc = xscom_chip_read(c, op->addr, &op->val);
+		if (op->rc)
+			failed++;
+	}
+	return failed;
+}
+
+/*
+ * Parse a batch from @f, one access per line:
+ *
+ *   reads:  [chip-id] addr
+ *   writes: [chip-id] addr value
+ *
+ * chip-id defaults to @def_chip, addr and value are hex. Empty lines and
+ * lines starting with '#' are skipped. Returns the number of ops, or -1
+ * on a malformed line.
+ */
+int xscom_batch_parse(FILE *f, uint32_t def_chip, bool write,
+		      struct xscom_batch_op **opsp)
+{
+	struct xscom_batch_op *ops = NULL, *op;
+	unsigned int count = 0, alloc = 0, line = 0;
+	char buf[256], f1[64], f2[64], f3[64];
+	int n;
+
+	while (fgets(buf, sizeof(buf), f)) {
+		line++;
+		n = sscanf(buf, "%63s %63s %63s", f1, f2, f3);
+		if (n <= 0 || f1[0] == '#')
+			continue;
+
+		if (count == alloc) {
+			alloc = alloc ? alloc * 2 : 64;
+			ops = realloc(ops, alloc * sizeof(*ops));
+			assert(ops);
+		}
+		op = &ops[count];
+		memset(op, 0, sizeof(*op));
+		op->write = write;
+		op->chip_id = def_chip;
+
+		if (n == (write ? 3 : 2)) {
+			op->chip_id = strtoul(f1, NULL, 0);
+			memmove(f1, f2, sizeof(f1));
+			memmove(f2, f3, sizeof(f2));
+		} else if (n != (write ? 2 : 1)) {
+			fprintf(stderr, "Malformed batch line %u\n", line);
+			free(ops);
+			return -1;
+		}
+		op->addr = strtoull(f1, NULL, 16);
+		if (write)
+			op->val = strtoull(f2, NULL, 16);
+		count++;
+	}
+
+	*opsp = ops;
+	return count;
+}
+
 int xscom_read_ex(uint32_t ex_target_id, uint64_t addr, uint64_t *val)
 {
 	uint32_t chip_id = ex_target_id >> 4;;
@@ -2,6 +2,8 @@
 #define __XSCOM_H
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
 
 extern int xscom_read(uint32_t chip_id, uint64_t addr, uint64_t *val);
 extern int xscom_write(uint32_t chip_id, uint64_t addr, uint64_t val);
@@ -9,6 +11,18 @@ extern int xscom_write(uint32_t chip_id, uint64_t addr, uint64_t val);
 extern int xscom_read_ex(uint32_t ex_target_id, uint64_t addr, uint64_t *val);
 extern int xscom_write_ex(uint32_t ex_target_id, uint64_t addr, uint64_t val);
 
+struct xscom_batch_op {
+	uint32_t	chip_id;
+	bool		write;
+	uint64_t	addr;
+	uint64_t	val;
+	int		rc;
+};
+
+extern int xscom_batch(struct xscom_batch_op *ops, unsigned int count);
+extern int xscom_batch_parse(FILE *f, uint32_t def_chip, bool write,
+			     struct xscom_batch_op **opsp);
+
 extern void xscom_for_each_chip(void (*cb)(uint32_t chip_id));
 
 extern uint32_t xscom_init(void);
@@ -22,6 +22,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <stdint.h>
+#include <time.h>
 
 #include <interrupts.h>
 
@@ -162,10 +163,19 @@ static void dump_dt(const struct dt_node *root, unsigned indent)
 		dump_dt(i, indent + 2);
 }
 
+static uint64_t now_usecs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
 int main(int argc, char *argv[])
 {
 	int fd, r;
-	bool verbose = false, quiet = false;
+	bool verbose = false, quiet = false, bench = false;
+	uint64_t t0, t1, t2, t3;
 
 	while (argv[1]) {
 		if (strcmp(argv[1], "-v") == 0) {
@@ -176,12 +186,16 @@ int main(int argc, char *argv[])
 			quiet = true;
 			argv++;
 			argc--;
+		} else if (strcmp(argv[1], "-b") == 0) {
+			bench = true;
+			argv++;
+			argc--;
 		} else
 			break;
 	}
 
 	if (argc != 3)
-		errx(1, "Usage: hdata [-v|-q] <spira-dump> <heap-dump>");
+		errx(1, "Usage: hdata [-v|-q|-b] <spira-dump> <heap-dump>");
 
 	/* Copy in spira dump (assumes little has changed!). */
 	fd = open(argv[1], O_RDONLY);
@@ -221,9 +235,26 @@ int main(int argc, char *argv[])
 		fclose(stderr);
 	}
 
+	/*
+	 * Same sequence as main_cpu_entry(), except that the FRU VPD is
+	 * parsed inline rather than on a secondary.
+	 */
+	t0 = now_usecs();
 	parse_hdat(false, 0);
-
-	if (!quiet)
+	t1 = now_usecs();
+	parse_hdat_fru_vpd();
+	t2 = now_usecs();
+	attach_hdat_fru_vpd();
+	t3 = now_usecs();
+
+	if (bench) {
+		printf("parse_hdat:          %8llu us\n",
+		       (unsigned long long)(t1 - t0));
+		printf("parse_hdat_fru_vpd:  %8llu us (off the boot CPU)\n",
+		       (unsigned long long)(t2 - t1));
+		printf("attach_hdat_fru_vpd: %8llu us\n",
+		       (unsigned long long)(t3 - t2));
+	} else if (!quiet)
 		dump_dt(dt_root, 0);
 
 	dt_free(dt_root);
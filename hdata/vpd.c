@@ -517,6 +517,19 @@ static struct dt_node *dt_create_vpd_node(struct dt_node *parent,
 	return node;
 }
 
+/*
+ * While the FRU VPD is being parsed, the children of /vpd live under
+ * this detached root so the parsing doesn't touch the live tree.
+ */
+static struct dt_node *vpd_detached;
+
+static struct dt_node *vpd_parent_node(void)
+{
+	if (vpd_detached)
+		return vpd_detached;
+	return dt_find_by_path(dt_root, "/vpd");
+}
+
 struct dt_node *dt_add_vpd_node(const struct HDIF_common_hdr *hdr,
 				int indx_fru, int indx_vpd)
 {
@@ -539,7 +552,7 @@ struct dt_node *dt_add_vpd_node(const struct HDIF_common_hdr *hdr,
 	if (!CHECK_SPPTR(fruvpd))
 		return NULL;
 
-	dt_vpd = dt_find_by_path(dt_root, "/vpd");
+	dt_vpd = vpd_parent_node();
 	if (!dt_vpd)
 		return NULL;
 
@@ -756,18 +769,39 @@ static void _vpd_parse(struct spira_ntuple tuple)
 }
 
 void vpd_parse(void)
+{
+	struct dt_node *dt_vpd;
+
+	/* System VPD uses the VSYS record, so its special */
+	sysvpd_parse();
+
+	/*
+	 * The FRU VPD is the bulk of the HDAT parsing and only ends up
+	 * in /vpd, which nothing looks at until the FDT is built. Detach
+	 * what /vpd has so far so parse_hdat_fru_vpd() can fill it in on
+	 * a secondary once CPUs are up.
+	 */
+	dt_vpd = dt_find_by_path(dt_root, "/vpd");
+	if (!dt_vpd)
+		return;
+	vpd_detached = dt_new_root("vpd");
+	dt_move_children(dt_vpd, vpd_detached);
+}
+
+void parse_hdat_fru_vpd(void)
 {
 	const struct HDIF_common_hdr *fruvpd_hdr;
 
+	/* Nothing deferred, we didn't boot from HDAT */
+	if (!vpd_detached)
+		return;
+
 	/* Enclosure */
 	_vpd_parse(spira.ntuples.nt_enclosure_vpd);
 
 	/* Backplane */
 	_vpd_parse(spira.ntuples.backplane_vpd);
 
-	/* System VPD uses the VSYS record, so its special */
-	sysvpd_parse();
-
 	/* clock card -- does this use the FRUVPD sig? */
 	_vpd_parse(spira.ntuples.clock_vpd);
 
@@ -796,3 +830,17 @@ void vpd_parse(void)
 		dt_add_vpd_node(fruvpd_hdr,
 				FRUVPD_IDATA_FRU_ID, FRUVPD_IDATA_KW_VPD);
 }
+
+void attach_hdat_fru_vpd(void)
+{
+	struct dt_node *dt_vpd;
+
+	if (!vpd_detached)
+		return;
+
+	dt_vpd = dt_find_by_path(dt_root, "/vpd");
+	if (!dt_vpd || !dt_move_children(vpd_detached, dt_vpd))
+		prerror("VPD: Failed to attach FRU VPD\n");
+	dt_free(vpd_detached);
+	vpd_detached = NULL;
+}
@@ -39,9 +39,22 @@
 #define   BT_INTMASK_B2H_IRQ		0x02
 #define   BT_INTMASK_BMC_HWRST		0x80
 
-/* Default poll interval before interrupts are working */
+/*
+ * Poll interval while nothing is in flight or, once interrupts are
+ * working, as a backstop for a lost interrupt. While we wait for a
+ * response without interrupts we poll on every opal poller run.
+ */
 #define BT_DEFAULT_POLL_MS	200
 
+/* Backstop polls finding a response the interrupt missed before we give up */
+#define BT_MAX_IRQ_MISSED	3
+
+/* Print the statistics every this many responses */
+#define BT_STATS_INTERVAL	256
+
+/* The netfn is 6 bits */
+#define BT_NETFN_COUNT		64
+
 /*
  * Minimum size of an IPMI request/response including
  * mandatory headers.
@@ -84,11 +97,30 @@ enum bt_states {
 struct bt_msg {
 	struct list_node link;
 	unsigned long tb;
+	unsigned long queued_tb;
 	uint8_t seq;
 	uint8_t retry_count;
+	uint8_t resp_netfn;
+	uint8_t resp_cmd;
+	uint8_t resp_cc;
 	struct ipmi_msg ipmi_msg;
 };
 
+struct bt_netfn_stats {
+	uint64_t count;
+	uint64_t tb_total;
+	uint64_t tb_max;
+};
+
+struct bt_stats {
+	struct bt_netfn_stats netfn[BT_NETFN_COUNT];
+	uint64_t responses;
+	uint64_t queued;
+	uint64_t depth_total;
+	int depth_max;
+	uint64_t irq_missed;
+};
+
 struct bt {
 	uint32_t base_addr;
 	enum bt_states state;
@@ -96,7 +128,10 @@ struct bt {
 	struct list_head msgq;
 	struct timer poller;
 	bool irq_ok;
+	int irq_missed;
 	int queue_len;
+	unsigned long send_tb;
+	struct bt_stats stats;
 };
 static struct bt bt;
 
@@ -193,6 +228,7 @@ static void bt_send_msg(struct bt_msg *bt_msg)
 
 	bt_outb(BT_CTRL_H2B_ATN, BT_CTRL);
 	bt_set_state(BT_STATE_RESP_WAIT);
+	bt.send_tb = mftb();
 
 	return;
 }
@@ -203,7 +239,49 @@ static void bt_flush_msg(void)
 	bt_set_h_busy(false);
 }
 
-static void bt_get_resp(void)
+static void bt_print_stats(void)
+{
+	struct bt_stats *st = &bt.stats;
+	struct bt_netfn_stats *ns;
+	unsigned int i;
+
+	prlog(PR_DEBUG, "BT: %llu responses, queue depth avg %llu max %d,"
+	      " %llu missed interrupts\n", st->responses,
+	      st->queued ? st->depth_total / st->queued : 0, st->depth_max,
+	      st->irq_missed);
+
+	for (i = 0; i < BT_NETFN_COUNT; i++) {
+		ns = &st->netfn[i];
+		if (!ns->count)
+			continue;
+		prlog(PR_DEBUG, "BT:   netfn 0x%02x: %llu msgs, avg %lu us,"
+		      " max %lu us\n", i, ns->count,
+		      tb_to_usecs(ns->tb_total / ns->count),
+		      tb_to_usecs(ns->tb_max));
+	}
+}
+
+/* Latency is from queueing the request to receiving its response */
+static void bt_update_stats(struct bt_msg *bt_msg)
+{
+	struct bt_netfn_stats *ns;
+	uint64_t delta = mftb() - bt_msg->queued_tb;
+
+	ns = &bt.stats.netfn[bt_msg->ipmi_msg.netfn >> 2];
+	ns->count++;
+	ns->tb_total += delta;
+	if (delta > ns->tb_max)
+		ns->tb_max = delta;
+
+	if (++bt.stats.responses % BT_STATS_INTERVAL == 0)
+		bt_print_stats();
+}
+
+/*
+ * Read a response and take its message off the queue. The caller
+ * completes it with bt_complete_msg() once it has dropped bt.lock.
+ */
+static struct bt_msg *bt_get_resp(void)
 {
 	int i;
 	struct bt_msg *tmp_bt_msg, *bt_msg = NULL;
@@ -247,7 +325,7 @@ static void bt_get_resp(void)
 		prlog(PR_INFO, "BT: Nobody cared about a response to an BT/IPMI message\n");
 		bt_flush_msg();
 		bt_set_state(BT_STATE_IDLE);
-		return;
+		return NULL;
 	}
 
 	ipmi_msg = &bt_msg->ipmi_msg;
@@ -273,19 +351,24 @@ static void bt_get_resp(void)
 
 	list_del(&bt_msg->link);
 	bt.queue_len--;
-	unlock(&bt.lock);
+	bt_update_stats(bt_msg);
 
-	/*
-	 * Call the IPMI layer to finish processing the message.
-	 */
+	bt_msg->resp_netfn = netfn;
+	bt_msg->resp_cmd = cmd;
+	bt_msg->resp_cc = cc;
+
+	return bt_msg;
+}
+
+/* Call the IPMI layer to finish processing the message */
+static void bt_complete_msg(struct bt_msg *bt_msg)
+{
 #if BT_QUEUE_DEBUG
-	prlog(PR_DEBUG, "cmd 0x%02x done\n", seq);
+	prlog(PR_DEBUG, "cmd 0x%02x done\n", bt_msg->seq);
 #endif
 
-	ipmi_cmd_done(cmd, netfn, cc, ipmi_msg);
-	lock(&bt.lock);
-
-	return;
+	ipmi_cmd_done(bt_msg->resp_cmd, bt_msg->resp_netfn, bt_msg->resp_cc,
+		      &bt_msg->ipmi_msg);
 }
 
 static void bt_expire_old_msg(uint64_t tb)
@@ -339,7 +422,8 @@ static void print_debug_queue_info(void)
 static void print_debug_queue_info(void) {}
 #endif
 
-static void bt_send_and_unlock(void)
+/* Caller must hold bt.lock */
+static void bt_send_next(void)
 {
 	if (lpc_ok() && !list_empty(&bt.msgq)) {
 		struct bt_msg *bt_msg;
@@ -357,14 +441,53 @@ static void bt_send_and_unlock(void)
 		if (bt_idle() && bt.state == BT_STATE_IDLE)
 			bt_send_msg(bt_msg);
 	}
+}
+
+/* Caller must hold bt.lock */
+static void bt_schedule_poll(void)
+{
+	/*
+	 * Without a working interrupt, poll hard for as long as a
+	 * response is outstanding rather than let it sit for a whole
+	 * BT_DEFAULT_POLL_MS.
+	 */
+	if (!bt.irq_ok && bt.state == BT_STATE_RESP_WAIT)
+		schedule_timer(&bt.poller, TIMER_POLL);
+	else
+		schedule_timer(&bt.poller, msecs_to_tb(BT_DEFAULT_POLL_MS));
+}
+
+static void bt_send_and_unlock(void)
+{
+	enum bt_states old_state = bt.state;
+
+	bt_send_next();
+	if (bt.state != old_state)
+		bt_schedule_poll();
 
 	unlock(&bt.lock);
 	return;
 }
 
-static void bt_poll(struct timer *t __unused, void *data __unused,
-		    uint64_t now)
+/* Called with bt.lock held from a poll that found a response waiting */
+static void bt_check_missed_irq(uint64_t now)
 {
+	if (!bt.irq_ok ||
+	    tb_compare(now, bt.send_tb + msecs_to_tb(BT_DEFAULT_POLL_MS)) ==
+	    TB_ABEFOREB)
+		return;
+
+	bt.stats.irq_missed++;
+	if (++bt.irq_missed < BT_MAX_IRQ_MISSED)
+		return;
+
+	prerror("BT: Interrupts are being lost, falling back to polling\n");
+	bt.irq_ok = false;
+}
+
+static void bt_poll(struct timer *t, void *data __unused, uint64_t now)
+{
+	struct bt_msg *done = NULL;
 	uint8_t bt_ctrl;
 
 	/* Don't do anything if the LPC bus is offline */
@@ -381,8 +504,13 @@ static void bt_poll(struct timer *t __unused, void *data __unused,
 
 	/* Is there a response waiting for us? */
 	if (bt.state == BT_STATE_RESP_WAIT &&
-	    (bt_ctrl & BT_CTRL_B2H_ATN))
-		bt_get_resp();
+	    (bt_ctrl & BT_CTRL_B2H_ATN)) {
+		if (t)
+			bt_check_missed_irq(now);
+		else
+			bt.irq_missed = 0;
+		done = bt_get_resp();
+	}
 
 	bt_expire_old_msg(now);
 
@@ -394,23 +522,33 @@ static void bt_poll(struct timer *t __unused, void *data __unused,
 		lock(&bt.lock);
 	}
 
-	/* Send messages if we can. If the BMC was really quick we
-	   could loop back to the start and check for a response
-	   instead of unlocking, but testing shows the BMC isn't that
-	   fast so we will wait for the IRQ or a call to the pollers
-	   instead. */
-	bt_send_and_unlock();
+	/* Send the next message before completing the previous one,
+	   so the BMC works on it while the completion runs. If the
+	   BMC was really quick we could loop back to the start and
+	   check for a response instead of unlocking, but testing
+	   shows the BMC isn't that fast so we will wait for the IRQ
+	   or a call to the pollers instead. */
+	bt_send_next();
+	bt_schedule_poll();
+	unlock(&bt.lock);
 
-	schedule_timer(&bt.poller,
-		       bt.irq_ok ? TIMER_POLL : msecs_to_tb(BT_DEFAULT_POLL_MS));
+	if (done)
+		bt_complete_msg(done);
 }
 
 static void bt_add_msg(struct bt_msg *bt_msg)
 {
 	bt_msg->tb = 0;
+	bt_msg->queued_tb = mftb();
 	bt_msg->seq = ipmi_seq++;
 	bt_msg->retry_count = 0;
 	bt.queue_len++;
+
+	bt.stats.queued++;
+	bt.stats.depth_total += bt.queue_len;
+	if (bt.queue_len > bt.stats.depth_max)
+		bt.stats.depth_max = bt.queue_len;
+
 	if (bt.queue_len > BT_MAX_QUEUE_LEN) {
 		/* Maximum queue length exceeded - remove the oldest message
 		   from the queue. */
@@ -452,8 +590,12 @@ static void bt_irq(uint32_t chip_id __unused, uint32_t irq_mask __unused)
 
 	ireg = bt_inb(BT_INTMASK);
 
-	bt.irq_ok = true;
+	/*
+	 * Shared SerIRQ lines get us called for other devices' interrupts
+	 * too, so only trust the interrupt once it really was ours.
+	 */
 	if (ireg & BT_INTMASK_B2H_IRQ) {
+		bt.irq_ok = true;
 		bt_outb(BT_INTMASK_B2H_IRQ | BT_INTMASK_B2H_IRQEN, BT_INTMASK);
 		bt_poll(NULL, NULL, mftb());
 	}
@@ -556,9 +698,10 @@ void bt_init(void)
 
 	ipmi_register_backend(&bt_backend);
 
-	/* We initially schedule the poller as a relatively fast timer, at
-	 * least until we have at least one interrupt occurring at which
-	 * point we turn it into a background poller
+	/* We initially schedule the poller as a relatively slow timer
+	 * that speeds up while a response is outstanding, at least until
+	 * we have at least one interrupt occurring at which point it only
+	 * catches lost interrupts and timeouts
 	 */
 	schedule_timer(&bt.poller, msecs_to_tb(BT_DEFAULT_POLL_MS));
 
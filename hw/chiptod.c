@@ -862,6 +862,7 @@ static void chiptod_sync_master(void *data)
 static void chiptod_sync_slave(void *data)
 {
 	bool *result = data;
+	bool rc;
 
 	/* Only get primaries, not threads */
 	if (this_cpu()->is_secondary) {
@@ -900,8 +901,15 @@ static void chiptod_sync_slave(void *data)
 		goto error;
 	prlog(PR_INSANE, "SYNC SLAVE Step 4 TFMR=0x%016lx\n", mfspr(SPR_TFMR));
 
-	/* Move chiptod value to core TB */
-	if (!chiptod_to_tb())
+	/*
+	 * Move chiptod value to core TB. The slaves of a chip share its
+	 * PIB_MASTER register, which says which core the TOD is sent to,
+	 * so only one of them may do this at a time.
+	 */
+	lock(&chiptod_lock);
+	rc = chiptod_to_tb();
+	unlock(&chiptod_lock);
+	if (!rc)
 		goto error;
 	prlog(PR_INSANE, "SYNC SLAVE Step 5 TFMR=0x%016lx\n", mfspr(SPR_TFMR));
 
@@ -1698,9 +1706,126 @@ static void chiptod_init_topology_info(void)
 	print_topology_info();
 }
 
+struct chiptod_slave_job {
+	struct cpu_job	*job;
+	bool		result;
+};
+
+static void chiptod_slave_failed(struct cpu_thread *cpu)
+{
+	op_display(OP_WARN, OP_MOD_CHIPTOD, 3|(cpu->pir << 8));
+
+	/* Disable threads */
+	cpu_disable_all_threads(cpu);
+}
+
+static struct cpu_job *chiptod_queue_slave(struct cpu_thread *cpu,
+					   struct chiptod_slave_job *jobs)
+{
+	struct chiptod_slave_job *j = &jobs[cpu->pir];
+
+	j->result = false;
+	j->job = cpu_queue_job(cpu, "chiptod_sync_slave",
+			       chiptod_sync_slave, &j->result);
+	return j->job;
+}
+
+/*
+ * Sync every core against the master chip TOD concurrently.
+ *
+ * The primary thread of each core moves the TOD into the core TB, and
+ * only once that's done are the other threads of the core told to clean
+ * up their TFMR, as the serial version used to do. All primaries are
+ * started at once, but the TOD to TB transfer itself goes through the
+ * chip's PIB_MASTER, so chiptod_sync_slave() does that step under
+ * chiptod_lock. Each core's secondaries are started as soon as its
+ * primary completes.
+ */
+static void chiptod_sync_all_slaves(struct cpu_thread *cpu0)
+{
+	struct chiptod_slave_job *jobs;
+	struct cpu_thread *cpu, *t;
+	unsigned int i, cores = 0;
+	unsigned long start;
+
+	jobs = zalloc((cpu_max_pir + 1) * sizeof(*jobs));
+	assert(jobs);
+
+	start = mftb();
+
+	/*
+	 * Jobs queued to ourselves run synchronously, so do ours last to
+	 * not hold up everybody else.
+	 */
+	for_each_available_cpu(cpu) {
+		if (cpu->is_secondary || cpu == cpu0 || cpu == this_cpu())
+			continue;
+		chiptod_queue_slave(cpu, jobs);
+	}
+	cpu = this_cpu();
+	if (!cpu->is_secondary && cpu != cpu0) {
+		chiptod_queue_slave(cpu, jobs);
+		/* Our own TB was just reloaded, restart the clock */
+		start = mftb();
+	}
+
+	for_each_available_cpu(cpu) {
+		if (cpu->is_secondary)
+			continue;
+
+		if (cpu != cpu0) {
+			cpu_wait_job(jobs[cpu->pir].job, true);
+			jobs[cpu->pir].job = NULL;
+			if (!jobs[cpu->pir].result) {
+				chiptod_slave_failed(cpu);
+				continue;
+			}
+			op_display(OP_LOG, OP_MOD_CHIPTOD, 3|(cpu->pir << 8));
+			cores++;
+		}
+
+		/* The core TB is good, now on to the other threads */
+		for (i = 1; i < cpu_thread_count; i++) {
+			t = find_cpu_by_pir(cpu->pir + i);
+			if (!t || t->primary != cpu ||
+			    !cpu_is_available(t))
+				continue;
+			chiptod_queue_slave(t, jobs);
+		}
+	}
+
+	/* Single barrier for all the secondaries */
+	for (i = 0; i <= cpu_max_pir; i++) {
+		if (!jobs[i].job)
+			continue;
+		cpu = find_cpu_by_pir(i);
+		cpu_wait_job(jobs[i].job, true);
+		jobs[i].job = NULL;
+		if (!jobs[i].result)
+			chiptod_slave_failed(cpu);
+		op_display(OP_LOG, OP_MOD_CHIPTOD, 3|(cpu->pir << 8));
+	}
+
+	prlog(PR_INFO, "Slave sync of %u cores took %lu us\n",
+	      cores, tb_to_usecs(mftb() - start));
+
+	/* Display TBs, all at once so they can be compared */
+	for_each_available_cpu(cpu) {
+		/* Only do primaries, not threads */
+		if (cpu->is_secondary)
+			continue;
+		jobs[cpu->pir].job = cpu_queue_job(cpu, "chiptod_print_tb",
+						   chiptod_print_tb, NULL);
+	}
+	for (i = 0; i <= cpu_max_pir; i++)
+		cpu_wait_job(jobs[i].job, true);
+
+	free(jobs);
+}
+
 void chiptod_init(void)
 {
-	struct cpu_thread *cpu0, *cpu;
+	struct cpu_thread *cpu0;
 	bool sres;
 
 	/* Mambo and qemu doesn't simulate the chiptod */
@@ -1736,34 +1861,7 @@ void chiptod_init(void)
 
 	op_display(OP_LOG, OP_MOD_CHIPTOD, 2);
 
-	/* Schedule slave sync */
-	for_each_available_cpu(cpu) {
-		/* Skip master */
-		if (cpu == cpu0)
-			continue;
-
-		/* Queue job */
-		sres = false;
-		cpu_wait_job(cpu_queue_job(cpu, "chiptod_sync_slave",
-					   chiptod_sync_slave, &sres),
-			     true);
-		if (!sres) {
-			op_display(OP_WARN, OP_MOD_CHIPTOD, 3|(cpu->pir << 8));
-
-			/* Disable threads */
-			cpu_disable_all_threads(cpu);
-		}
-		op_display(OP_LOG, OP_MOD_CHIPTOD, 3|(cpu->pir << 8));
-	}
-
-	/* Display TBs */
-	for_each_available_cpu(cpu) {
-		/* Only do primaries, not threads */
-		if (cpu->is_secondary)
-			continue;
-		cpu_wait_job(cpu_queue_job(cpu, "chiptod_print_tb",
-					   chiptod_print_tb, NULL), true);
-	}
+	chiptod_sync_all_slaves(cpu0);
 
 	chiptod_init_topology_info();
 	op_display(OP_LOG, OP_MOD_CHIPTOD, 4);
@@ -338,6 +338,133 @@ static void occ_msg_consumed(void *data __unused)
 	unlock(&occ_lock);
 }
 
+/*
+ * Throttle status vector shared with the host. Entries are in
+ * for_each_chip() order. Protected by occ_lock.
+ */
+static struct opal_occ_throttle_vector *occ_throttle_vec;
+static bool occ_throttle_vec_pending;
+static bool occ_throttle_enabled;
+
+static bool occ_throttle_vec_active(void)
+{
+	return occ_throttle_vec &&
+		(be32_to_cpu(occ_throttle_vec->flags) &
+		 OCC_THROTTLE_VECTOR_HOST_ACTIVE);
+}
+
+static void occ_throttle_vec_publish(void)
+{
+	/* Entries must be visible before the new generation */
+	lwsync();
+	occ_throttle_vec->generation =
+		cpu_to_be32(be32_to_cpu(occ_throttle_vec->generation) + 1);
+	occ_throttle_vec_pending = true;
+}
+
+static void occ_throttle_vec_reset(void)
+{
+	unsigned int i;
+
+	if (!occ_throttle_vec)
+		return;
+	for (i = 0; i < be32_to_cpu(occ_throttle_vec->nr_chips); i++)
+		occ_throttle_vec->chips[i].throttle_status = 0;
+	occ_throttle_vec_publish();
+}
+
+/*
+ * The next kernel (after kexec) hasn't seen the vector yet, so go back
+ * to per-chip messages until it sets the flag again.
+ */
+static bool occ_throttle_vec_host_sync(void *data __unused)
+{
+	lock(&occ_lock);
+	occ_throttle_vec->flags = 0;
+	occ_throttle_vec_pending = false;
+	unlock(&occ_lock);
+
+	return true;
+}
+
+static void occ_throttle_vec_init(void)
+{
+	struct proc_chip *chip;
+	struct dt_node *power_mgt;
+	unsigned int nr_chips = 0;
+	size_t size;
+
+	power_mgt = dt_find_by_path(dt_root, "/ibm,opal/power-mgt");
+	if (!power_mgt)
+		return;
+
+	for_each_chip(chip)
+		nr_chips++;
+
+	size = sizeof(*occ_throttle_vec) +
+		nr_chips * sizeof(struct opal_occ_throttle_entry);
+	occ_throttle_vec = zalloc(size);
+	if (!occ_throttle_vec) {
+		prerror("OCC: Failed to allocate throttle vector\n");
+		return;
+	}
+
+	occ_throttle_vec->magic = cpu_to_be32(OCC_THROTTLE_VECTOR_MAGIC);
+	occ_throttle_vec->nr_chips = cpu_to_be32(nr_chips);
+	nr_chips = 0;
+	for_each_chip(chip)
+		occ_throttle_vec->chips[nr_chips++].chip = cpu_to_be32(chip->id);
+
+	dt_add_property_u64s(power_mgt, "ibm,occ-throttle-vector",
+			     (u64)occ_throttle_vec, size);
+	opal_add_host_sync_notifier(occ_throttle_vec_host_sync, NULL);
+}
+
+/*
+ * Fold every chip's throttle change into the shared vector and tell the
+ * host with a single message. Further changes made while that message
+ * is outstanding are folded into the same vector and notified once the
+ * host has consumed it.
+ */
+static void occ_throttle_update_vec(void)
+{
+	struct proc_chip *chip;
+	struct occ_pstate_table *occ_data;
+	struct opal_occ_msg occ_msg;
+	unsigned int i = 0;
+	bool changed = false;
+	int rc;
+
+	for_each_chip(chip) {
+		occ_data = chip_occ_data(chip);
+		if ((occ_data->valid == 1) &&
+		    (chip->throttle != occ_data->throttle) &&
+		    (occ_data->throttle <= OCC_MAX_THROTTLE_STATUS)) {
+			chip->throttle = occ_data->throttle;
+			occ_throttle_vec->chips[i].throttle_status =
+				chip->throttle;
+			changed = true;
+		}
+		i++;
+	}
+	if (changed)
+		occ_throttle_vec_publish();
+
+	if (!occ_throttle_vec_pending || occ_opal_msg_outstanding)
+		return;
+
+	occ_msg.type = cpu_to_be64(OCC_THROTTLE_ALL);
+	occ_msg.chip = 0;
+	occ_msg.throttle_status =
+		cpu_to_be64(be32_to_cpu(occ_throttle_vec->generation));
+	rc = _opal_queue_msg(OPAL_MSG_OCC, NULL, occ_msg_consumed, 3,
+			     (uint64_t *)&occ_msg);
+	if (!rc) {
+		occ_throttle_vec_pending = false;
+		occ_opal_msg_outstanding = true;
+	}
+}
+
 static void occ_throttle_poll(void *data __unused)
 {
 	struct proc_chip *chip;
@@ -370,6 +497,8 @@ static void occ_throttle_poll(void *data __unused)
 			if (!rc)
 				occ_reset = false;
 		}
+	} else if (occ_throttle_vec_active()) {
+		occ_throttle_update_vec();
 	} else {
 		if (occ_opal_msg_outstanding)
 			goto done;
@@ -440,9 +569,14 @@ void occ_pstates_init(void)
 		}
 	}
 
-	/* Add opal_poller to poll OCC throttle status of each chip */
+	/*
+	 * Throttle changes are picked up from the OCC interrupt, the
+	 * poller catches those the OCC doesn't raise an interrupt for.
+	 */
 	for_each_chip(chip)
 		chip->throttle = 0;
+	occ_throttle_vec_init();
+	occ_throttle_enabled = true;
 	opal_add_poller(occ_throttle_poll, NULL);
 }
 
@@ -691,6 +825,7 @@ static void occ_do_reset(u8 scope, u32 dbob_id, u32 seq_id)
 			occ_data->valid = 0;
 			chip->throttle = 0;
 		}
+		occ_throttle_vec_reset();
 		occ_reset = true;
 		unlock(&occ_lock);
 	} else {
@@ -855,6 +990,10 @@ void occ_interrupt(uint32_t chip_id)
 	rc = xscom_read(chip_id, OCB_OCI_OCCMISC, &ireg);
 	if (!rc && (ireg & OCB_OCI_OCIMISC_MASK))
 		xscom_write(chip_id, OCB_OCI_OCCMISC_OR, OCB_OCI_OCIMISC_IRQ);
+
+	/* Pick up any throttle change now rather than on the next poll */
+	if (occ_throttle_enabled)
+		occ_throttle_poll(NULL);
 }
 
 void occ_fsp_init(void)
@@ -685,6 +685,7 @@ static int64_t phb3_ioda_reset(struct phb *phb, bool purge)
 	struct phb3 *p = phb_to_phb3(phb);
 	uint64_t server, prio;
 	uint64_t *pdata64, data64;
+	bool need_unlock;
 	uint32_t i;
 
 	if (purge) {
@@ -730,12 +731,24 @@ static int64_t phb3_ioda_reset(struct phb *phb, bool purge)
 	if (p->tbl_peltv)
 		memcpy((void *)p->tbl_peltv, p->peltv_cache, PELTV_TABLE_SIZE);
 
-	/* Load IVT */
+	/*
+	 * Load IVT, the cached IVEs all have a zero generation count.
+	 * EOIs don't take the PHB lock, so keep them out while the IVT
+	 * and the gen count shadow are reset. We may already hold the
+	 * EOI lock when called from a complete reset.
+	 */
 	if (p->tbl_ivt) {
+		need_unlock = lock_recursive(&p->eoi_lock);
 		pdata64 = (uint64_t *)p->tbl_ivt;
 		for (i = 0; i < IVT_TABLE_ENTRIES; i++)
 			pdata64[i * IVT_TABLE_STRIDE] = p->ive_cache[i];
+		memset(p->ive_gen, 0, sizeof(p->ive_gen));
+		if (need_unlock)
+			unlock(&p->eoi_lock);
 	}
+	if (p->msi_eoi_count)
+		PHBDBG(p, "MSI EOIs: %lld, Q flushes: %lld, Q resends: %lld\n",
+		       p->msi_eoi_count, p->msi_q_flush, p->msi_q_resend);
 
 	/* Invalidate RTE, IVE, TCE cache */
 	out_be64(p->regs + PHB_RTC_INVALIDATE, PHB_RTC_INVALIDATE_ALL);
@@ -985,15 +998,15 @@ static int64_t phb3_map_pe_mmio_window(struct phb *phb,
 	return OPAL_SUCCESS;
 }
 
-static int64_t phb3_map_pe_dma_window(struct phb *phb,
-				      uint16_t pe_num,
-				      uint16_t window_id,
-				      uint16_t tce_levels,
-				      uint64_t tce_table_addr,
-				      uint64_t tce_table_size,
-				      uint64_t tce_page_size)
+/* Work out the TVE for a TCE table, without touching the hardware */
+static int64_t phb3_tve_encode(uint16_t pe_num,
+			       uint16_t window_id,
+			       uint16_t tce_levels,
+			       uint64_t tce_table_addr,
+			       uint64_t tce_table_size,
+			       uint64_t tce_page_size,
+			       uint64_t *tve)
 {
-	struct phb3 *p = phb_to_phb3(phb);
 	uint64_t tts_encoded;
 	uint64_t data64 = 0;
 
@@ -1010,9 +1023,7 @@ static int64_t phb3_map_pe_dma_window(struct phb *phb,
 	 * we ignore other arguments
 	 */
 	if (tce_table_size == 0) {
-		phb3_ioda_sel(p, IODA2_TBL_TVT, window_id, false);
-		out_be64(p->regs + PHB_IODA_DATA0, 0);
-		p->tve_cache[window_id] = 0;
+		*tve = 0;
 		return OPAL_SUCCESS;
 	}
 
@@ -1049,21 +1060,42 @@ static int64_t phb3_map_pe_dma_window(struct phb *phb,
 
 	/* Encode number of levels */
 	data64 = SETFIELD(IODA2_TVT_NUM_LEVELS, data64, tce_levels - 1);
+	*tve = data64;
+
+	return OPAL_SUCCESS;
+}
+
+static int64_t phb3_map_pe_dma_window(struct phb *phb,
+				      uint16_t pe_num,
+				      uint16_t window_id,
+				      uint16_t tce_levels,
+				      uint64_t tce_table_addr,
+				      uint64_t tce_table_size,
+				      uint64_t tce_page_size)
+{
+	struct phb3 *p = phb_to_phb3(phb);
+	uint64_t tve;
+	int64_t rc;
+
+	rc = phb3_tve_encode(pe_num, window_id, tce_levels, tce_table_addr,
+			     tce_table_size, tce_page_size, &tve);
+	if (rc)
+		return rc;
 
 	phb3_ioda_sel(p, IODA2_TBL_TVT, window_id, false);
-	out_be64(p->regs + PHB_IODA_DATA0, data64);
-	p->tve_cache[window_id] = data64;
+	out_be64(p->regs + PHB_IODA_DATA0, tve);
+	p->tve_cache[window_id] = tve;
 
 	return OPAL_SUCCESS;
 }
 
-static int64_t phb3_map_pe_dma_window_real(struct phb *phb,
-					   uint16_t pe_num,
-					   uint16_t window_id,
-					   uint64_t pci_start_addr,
-					   uint64_t pci_mem_size)
+/* Work out the TVE for a direct (untranslated) window */
+static int64_t phb3_tve_real_encode(uint16_t pe_num,
+				    uint16_t window_id,
+				    uint64_t pci_start_addr,
+				    uint64_t pci_mem_size,
+				    uint64_t *ptve)
 {
-	struct phb3 *p = phb_to_phb3(phb);
 	uint64_t end;
 	uint64_t tve;
 
@@ -1112,6 +1144,25 @@ static int64_t phb3_map_pe_dma_window_real(struct phb *phb,
 		/* Disable */
 		tve = 0;
 	}
+	*ptve = tve;
+
+	return OPAL_SUCCESS;
+}
+
+static int64_t phb3_map_pe_dma_window_real(struct phb *phb,
+					   uint16_t pe_num,
+					   uint16_t window_id,
+					   uint64_t pci_start_addr,
+					   uint64_t pci_mem_size)
+{
+	struct phb3 *p = phb_to_phb3(phb);
+	uint64_t tve;
+	int64_t rc;
+
+	rc = phb3_tve_real_encode(pe_num, window_id, pci_start_addr,
+				  pci_mem_size, &tve);
+	if (rc)
+		return rc;
 
 	phb3_ioda_sel(p, IODA2_TBL_TVT, window_id, false);
 	out_be64(p->regs + PHB_IODA_DATA0, tve);
@@ -1134,7 +1185,12 @@ static void phb3_pci_msi_check_q(struct phb3 *p, uint32_t ive_num)
 	 * we would have CI load to make that.
 	 */
 	if (!(*q_byte & 0x1)) {
-		/* Read from random PHB reg to force flush */
+		/*
+		 * Read from random PHB reg to force flush. This can't be
+		 * skipped: the PHB sets Q in memory behind our back, so
+		 * there is nothing we could keep a copy of.
+		 */
+		p->msi_q_flush++;
 		in_be64(p->regs + PHB_IVC_UPDATE);
 
 		/* Order with subsequent read of Q */
@@ -1155,6 +1211,7 @@ static void phb3_pci_msi_check_q(struct phb3 *p, uint32_t ive_num)
 	}
 
 	/* Clear Q bit and update IVC */
+	p->msi_q_resend++;
 	*q_byte = 0;
 	ivc = SETFIELD(PHB_IVC_UPDATE_SID, 0ul, ive_num) |
 		PHB_IVC_UPDATE_ENABLE_Q;
@@ -1169,28 +1226,50 @@ static void phb3_pci_msi_check_q(struct phb3 *p, uint32_t ive_num)
 	out_be64(p->regs + PHB_FFI_REQUEST, ffi);
 }
 
+/*
+ * Called without the PHB lock (see pci_msi_eoi_nolock): an EOI doesn't
+ * use the IODA select/data registers, the IVC update is a single store
+ * and the FFI is serialized by the PHB's own FFI lock. The interrupt
+ * isn't presented again until we clear P, so nobody else EOIs the same
+ * IVE concurrently.
+ *
+ * The per-PHB EOI lock still keeps us away from an IODA reset, which
+ * reloads the IVT and the gen count shadow, and from the complete reset
+ * steps, which must not see IVC updates or FFI requests. EOIs of
+ * different IVEs do contend on it, but only for a few stores.
+ */
 static int64_t phb3_pci_msi_eoi(struct phb *phb,
 				uint32_t hwirq)
 {
 	struct phb3 *p = phb_to_phb3(phb);
 	uint32_t ive_num = PHB3_IRQ_NUM(hwirq);
 	uint64_t ive, ivc;
-	uint8_t *p_byte, gp, gen;
+	uint8_t *p_byte, gen, new_gen;
 
 	/* OS might not configure IVT yet */
 	if (!p->tbl_ivt)
 		return OPAL_HARDWARE;
 
-	/* Each IVE has 16-bytes or 128-bytes */
+	lock(&p->eoi_lock);
+
+	/*
+	 * Each IVE has 16-bytes or 128-bytes. PHB3_IRQ_NUM() keeps 11
+	 * bits, so ive_num is always inside the IVT and the shadow.
+	 */
 	ive = p->tbl_ivt + (ive_num * IVT_TABLE_STRIDE * 8);
 	p_byte = (uint8_t *)(ive + 4);
 
-	/* Read generation and P */
-	gp = *p_byte;
-	gen = gp >> 1;
+	/*
+	 * Only we change the generation count, so take it from the
+	 * shadow rather than reading back the byte the PHB has just
+	 * written P into.
+	 */
+	gen = p->ive_gen[ive_num];
+	new_gen = (gen + 1) & 0x3;
+	p->ive_gen[ive_num] = new_gen;
 
 	/* Increment generation count and clear P */
-	*p_byte = ((gen + 1) << 1) & 0x7;
+	*p_byte = new_gen << 1;
 
 	/* Update the IVC with a match against the old gen count */
 	ivc = SETFIELD(PHB_IVC_UPDATE_SID, 0ul, ive_num) |
@@ -1198,10 +1277,13 @@ static int64_t phb3_pci_msi_eoi(struct phb *phb,
 		PHB_IVC_UPDATE_ENABLE_GEN |
 		SETFIELD(PHB_IVC_UPDATE_GEN_MATCH, 0ul, gen);
 	out_be64(p->regs + PHB_IVC_UPDATE, ivc);
+	p->msi_eoi_count++;
 
 	/* Handle Q bit */
 	phb3_pci_msi_check_q(p, ive_num);
 
+	unlock(&p->eoi_lock);
+
 	return OPAL_SUCCESS;
 }
 
@@ -1827,15 +1909,15 @@ static const struct irq_source_ops phb3_err_lsi_irq_ops = {
 	.interrupt = phb3_err_interrupt,
 };
 
-static int64_t phb3_set_pe(struct phb *phb,
-			   uint64_t pe_num,
-                           uint64_t bdfn,
-			   uint8_t bcompare,
-			   uint8_t dcompare,
-			   uint8_t fcompare,
-			   uint8_t action)
+/* Update the RTT, the caller invalidates the RTC */
+static int64_t __phb3_set_pe(struct phb3 *p,
+			     uint64_t pe_num,
+			     uint64_t bdfn,
+			     uint8_t bcompare,
+			     uint8_t dcompare,
+			     uint8_t fcompare,
+			     uint8_t action)
 {
-	struct phb3 *p = phb_to_phb3(phb);
 	uint64_t mask, val, tmp, idx;
 	int32_t all = 0;
 	uint16_t *rte;
@@ -1899,6 +1981,25 @@ static int64_t phb3_set_pe(struct phb *phb,
 		}
 	}
 
+	return OPAL_SUCCESS;
+}
+
+static int64_t phb3_set_pe(struct phb *phb,
+			   uint64_t pe_num,
+			   uint64_t bdfn,
+			   uint8_t bcompare,
+			   uint8_t dcompare,
+			   uint8_t fcompare,
+			   uint8_t action)
+{
+	struct phb3 *p = phb_to_phb3(phb);
+	int64_t rc;
+
+	rc = __phb3_set_pe(p, pe_num, bdfn, bcompare, dcompare, fcompare,
+			   action);
+	if (rc)
+		return rc;
+
 	/* Invalidate the entire RTC */
 	out_be64(p->regs + PHB_RTC_INVALIDATE, PHB_RTC_INVALIDATE_ALL);
 
@@ -1938,6 +2039,84 @@ static int64_t phb3_set_peltv(struct phb *phb,
 	return OPAL_SUCCESS;
 }
 
+/*
+ * The RTT and PELTV live in memory; what costs is the RTC invalidation
+ * after each RTT update and the select + data MMIO pair per TVE. So
+ * the RTC is invalidated once for the whole batch, and the TVEs are
+ * updated in tve_cache and then written out in runs with auto-increment.
+ */
+static int64_t phb3_set_pe_batch(struct phb *phb, struct pci_pe_config *cfg,
+				 unsigned int count)
+{
+	struct phb3 *p = phb_to_phb3(phb);
+	uint64_t tve_dirty[ARRAY_SIZE(p->tve_cache) / 64] = { 0 };
+	struct pci_pe_config *c;
+	bool rtt_dirty = false;
+	int64_t rc = OPAL_SUCCESS;
+	unsigned int i, w;
+	uint64_t tve;
+
+	for (i = 0; i < count; i++) {
+		c = &cfg[i];
+		if (c->rc)
+			continue;
+
+		if (c->flags & OPAL_PCI_PE_CONFIG_RID) {
+			c->rc = __phb3_set_pe(p, c->pe_number, c->bus_dev_func,
+					      c->bus_compare, c->dev_compare,
+					      c->func_compare, c->pe_action);
+			if (c->rc)
+				goto next;
+			rtt_dirty = true;
+		}
+		if (c->flags & OPAL_PCI_PE_CONFIG_PELTV) {
+			c->rc = phb3_set_peltv(phb, c->parent_pe, c->pe_number,
+					       c->peltv_state);
+			if (c->rc)
+				goto next;
+		}
+		if (c->flags & OPAL_PCI_PE_CONFIG_MVE) {
+			/* No MVEs on IODA2 */
+			c->rc = OPAL_UNSUPPORTED;
+			goto next;
+		}
+		if (c->flags & OPAL_PCI_PE_CONFIG_DMA)
+			c->rc = phb3_tve_encode(c->pe_number, c->window_id,
+						c->tce_levels, c->dma_addr,
+						c->dma_size, c->tce_page_size,
+						&tve);
+		else if (c->flags & OPAL_PCI_PE_CONFIG_DMA_REAL)
+			c->rc = phb3_tve_real_encode(c->pe_number, c->window_id,
+						     c->dma_addr, c->dma_size,
+						     &tve);
+		else
+			goto next;
+		if (c->rc)
+			goto next;
+		p->tve_cache[c->window_id] = tve;
+		tve_dirty[c->window_id / 64] |= 1ul << (c->window_id % 64);
+	next:
+		if (c->rc && rc == OPAL_SUCCESS)
+			rc = c->rc;
+	}
+
+	if (rtt_dirty)
+		out_be64(p->regs + PHB_RTC_INVALIDATE, PHB_RTC_INVALIDATE_ALL);
+
+	for (w = 0; w < ARRAY_SIZE(p->tve_cache); w++) {
+		if (!(tve_dirty[w / 64] & (1ul << (w % 64))))
+			continue;
+		phb3_ioda_sel(p, IODA2_TBL_TVT, w, true);
+		while (w < ARRAY_SIZE(p->tve_cache) &&
+		       (tve_dirty[w / 64] & (1ul << (w % 64)))) {
+			out_be64(p->regs + PHB_IODA_DATA0, p->tve_cache[w]);
+			w++;
+		}
+	}
+
+	return rc;
+}
+
 static int64_t phb3_link_state(struct phb *phb)
 {
 	struct phb3 *p = phb_to_phb3(phb);
@@ -2441,7 +2620,7 @@ static void do_capp_recovery_scoms(struct phb3 *p)
  * the power stuff yet. So skip that and do fundamental reset
  * directly after reinitialization the hardware.
  */
-static int64_t phb3_sm_complete_reset(struct phb3 *p)
+static int64_t __phb3_sm_complete_reset(struct phb3 *p)
 {
 	uint64_t cqsts, val;
 
@@ -2517,6 +2696,18 @@ error:
 	return OPAL_PARAMETER;
 }
 
+/* Lock-free EOIs must not touch the PHB during any of the steps */
+static int64_t phb3_sm_complete_reset(struct phb3 *p)
+{
+	int64_t rc;
+
+	lock(&p->eoi_lock);
+	rc = __phb3_sm_complete_reset(p);
+	unlock(&p->eoi_lock);
+
+	return rc;
+}
+
 static int64_t phb3_complete_reset(struct phb *phb, uint8_t assert)
 {
 	struct phb3 *p = phb_to_phb3(phb);
@@ -3507,11 +3698,13 @@ static const struct phb_ops phb3_ops = {
 	.map_pe_dma_window	= phb3_map_pe_dma_window,
 	.map_pe_dma_window_real = phb3_map_pe_dma_window_real,
 	.pci_msi_eoi		= phb3_pci_msi_eoi,
+	.pci_msi_eoi_nolock	= phb3_pci_msi_eoi,
 	.set_xive_pe		= phb3_set_ive_pe,
 	.get_msi_32		= phb3_get_msi_32,
 	.get_msi_64		= phb3_get_msi_64,
 	.set_pe			= phb3_set_pe,
 	.set_peltv		= phb3_set_peltv,
+	.set_pe_batch		= phb3_set_pe_batch,
 	.link_state		= phb3_link_state,
 	.power_state		= phb3_power_state,
 	.slot_power_off		= phb3_slot_power_off,
@@ -4139,11 +4332,11 @@ static void phb3_allocate_tables(struct phb3 *p)
 	uint16_t *rte;
 	uint32_t i;
 
-	/* XXX Our current memalign implementation sucks,
-	 *
-	 * It will do the job, however it doesn't support freeing
-	 * the memory and wastes space by always allocating twice
-	 * as much as requested (size + alignment)
+	/*
+	 * The tables are naturally aligned, local_alloc() hands those
+	 * out of a per-chip buddy pool without alignment padding. They
+	 * are allocated once at probe: their addresses are in the
+	 * device-tree, so a PHB reset keeps them.
 	 */
 	p->tbl_rtt = (uint64_t)local_alloc(p->chip_id, RTT_TABLE_SIZE, RTT_TABLE_SIZE);
 	assert(p->tbl_rtt);
@@ -4162,6 +4355,7 @@ static void phb3_allocate_tables(struct phb3 *p)
 	p->tbl_ivt = (uint64_t)local_alloc(p->chip_id, IVT_TABLE_SIZE, IVT_TABLE_SIZE);
 	assert(p->tbl_ivt);
 	memset((void *)p->tbl_ivt, 0, IVT_TABLE_SIZE);
+	memset(p->ive_gen, 0, sizeof(p->ive_gen));
 
 	p->tbl_rba = (uint64_t)local_alloc(p->chip_id, RBA_TABLE_SIZE, RBA_TABLE_SIZE);
 	assert(p->tbl_rba);
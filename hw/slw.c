@@ -669,6 +669,84 @@ void add_cpu_idle_state_properties(void)
 	free(pmicr_mask_buf);
 }
 
+/*
+ * Per-chip work (image patching, per-core xscom setup) is independent
+ * between chips, so run it on a thread of each chip, all chips at once.
+ * Chips without an available thread, and our own chip, are done locally
+ * and last since jobs queued to ourselves run synchronously.
+ */
+struct slw_chip_job {
+	struct proc_chip	*chip;
+	void			(*func)(struct proc_chip *chip, void *data);
+	void			*data;
+	const char		*name;
+	struct cpu_job		*job;
+};
+
+static void slw_run_chip_job(void *data)
+{
+	struct slw_chip_job *j = data;
+	unsigned long start = mftb();
+
+	j->func(j->chip, j->data);
+
+	prlog(PR_DEBUG, "SLW: %s on chip 0x%x took %lu us\n",
+	      j->name, j->chip->id, tb_to_usecs(mftb() - start));
+}
+
+static void slw_for_each_chip(const char *name,
+			      void (*func)(struct proc_chip *chip, void *data),
+			      void *data)
+{
+	struct slw_chip_job *jobs, *local = NULL;
+	unsigned int i, count = 0;
+	struct proc_chip *chip;
+	struct cpu_thread *cpu;
+
+	for_each_chip(chip)
+		count++;
+
+	jobs = zalloc(count * sizeof(*jobs));
+	if (!jobs) {
+		for_each_chip(chip)
+			func(chip, data);
+		return;
+	}
+
+	i = 0;
+	for_each_chip(chip) {
+		struct slw_chip_job *j = &jobs[i++];
+
+		j->chip = chip;
+		j->func = func;
+		j->data = data;
+		j->name = name;
+
+		cpu = first_available_core_in_chip(chip->id);
+		if (!cpu || cpu->chip_id == this_cpu()->chip_id)
+			continue;
+		j->job = cpu_queue_job(cpu, name, slw_run_chip_job, j);
+	}
+
+	/* Whatever couldn't be queued runs here */
+	for (i = 0; i < count; i++) {
+		if (jobs[i].job)
+			continue;
+		if (jobs[i].chip->id == this_cpu()->chip_id) {
+			local = &jobs[i];
+			continue;
+		}
+		slw_run_chip_job(&jobs[i]);
+	}
+	if (local)
+		slw_run_chip_job(local);
+
+	for (i = 0; i < count; i++)
+		cpu_wait_job(jobs[i].job, true);
+
+	free(jobs);
+}
+
 #ifdef __HAVE_LIBPORE__
 static void slw_cleanup_core(struct proc_chip *chip, struct cpu_thread *c)
 {
@@ -713,7 +791,7 @@ static void slw_cleanup_core(struct proc_chip *chip, struct cpu_thread *c)
 	slw_unset_overrides(chip, c);
 }
 
-static void slw_cleanup_chip(struct proc_chip *chip)
+static void slw_cleanup_chip(struct proc_chip *chip, void *data __unused)
 {
 	struct cpu_thread *c;
 
@@ -721,8 +799,9 @@ static void slw_cleanup_chip(struct proc_chip *chip)
 		slw_cleanup_core(chip, c);
 }
 
-static void slw_patch_scans(struct proc_chip *chip, bool le_mode)
+static void slw_patch_scans(struct proc_chip *chip, void *data)
 {
+	bool le_mode = *(bool *)data;
 	int64_t rc;
 	uint64_t old_val, new_val;
 
@@ -748,9 +827,6 @@ static void slw_patch_scans(struct proc_chip *chip, bool le_mode)
 		return;
 	}
 }
-#else
-static inline void slw_patch_scans(struct proc_chip *chip __unused,
-				   bool le_mode __unused ) { }
 #endif /* __HAVE_LIBPORE__ */
 
 #ifndef __HAVE_LIBPORE__
@@ -787,9 +863,8 @@ int64_t slw_reinit(uint64_t flags)
 				"SLW: Not found on chip %d\n", chip->id);
 			return OPAL_HARDWARE;
 		}
-
-		slw_patch_scans(chip, target_le);
 	}
+	slw_for_each_chip("slw_patch_scans", slw_patch_scans, &target_le);
 	slw_current_le = target_le;
 
 	/* XXX Save HIDs ? Or do that in head.S ... */
@@ -867,8 +942,7 @@ int64_t slw_reinit(uint64_t flags)
 
 	slw_unpatch_reset();
 
-	for_each_chip(chip)
-		slw_cleanup_chip(chip);
+	slw_for_each_chip("slw_cleanup_chip", slw_cleanup_chip, NULL);
 
 	prlog(PR_TRACE, "SLW Reinit complete !\n");
 
@@ -903,7 +977,7 @@ static void slw_patch_regs(struct proc_chip *chip)
 }
 #endif /* __HAVE_LIBPORE__ */
 
-static void slw_init_chip(struct proc_chip *chip)
+static void slw_init_chip(struct proc_chip *chip, void *data __unused)
 {
 	int64_t rc;
 	struct cpu_thread *c;
@@ -1197,7 +1271,7 @@ bool slw_timer_ok(void)
 	return slw_has_timer;
 }
 
-static void slw_init_timer(void)
+void slw_init_timer(void)
 {
 	struct dt_node *np;
 	int64_t rc;
@@ -1226,13 +1300,13 @@ static void slw_init_timer(void)
 
 void slw_init(void)
 {
-	struct proc_chip *chip;
+	unsigned long start;
 
 	if (proc_gen != proc_gen_p8)
 		return;
 
-	for_each_chip(chip)
-		slw_init_chip(chip);
-
-	slw_init_timer();
+	start = mftb();
+	slw_for_each_chip("slw_init_chip", slw_init_chip, NULL);
+	prlog(PR_DEBUG, "SLW: Init of all chips took %lu us\n",
+	      tb_to_usecs(mftb() - start));
 }
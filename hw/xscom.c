@@ -332,35 +332,63 @@ static uint32_t xscom_decode_chiplet(uint32_t partid, uint64_t *pcb_addr)
 }
 
 /*
- * External API
+ * Decode a part ID into a chip ID, adjusting the PCB address for
+ * chiplet targets. Returns XSCOM_PART_CENTAUR for Centaurs, which have
+ * their own access path.
  */
-int xscom_read(uint32_t partid, uint64_t pcb_addr, uint64_t *val)
-{
-	uint32_t gcid;
-	int rc;
+#define XSCOM_PART_CHIP		0
+#define XSCOM_PART_CENTAUR	1
 
-	/* Handle part ID decoding */
+static int xscom_decode_partid(uint32_t partid, uint64_t *pcb_addr,
+			       uint32_t *gcid)
+{
 	switch(partid >> 28) {
 	case 0: /* Normal processor chip */
-		gcid = partid;
-		break;
+		*gcid = partid;
+		return XSCOM_PART_CHIP;
 	case 8: /* Centaur */
-		return centaur_xscom_read(partid, pcb_addr, val);
+		return XSCOM_PART_CENTAUR;
 	case 4: /* EX chiplet */
-		gcid = xscom_decode_chiplet(partid, &pcb_addr);
-		break;
+		*gcid = xscom_decode_chiplet(partid, pcb_addr);
+		return XSCOM_PART_CHIP;
 	default:
 		return OPAL_PARAMETER;
 	}
+}
+
+/* Direct vs indirect access, called with the XSCOM lock held */
+static int __xscom_access(uint32_t gcid, uint64_t pcb_addr, bool is_write,
+			  uint64_t *val)
+{
+	if (pcb_addr & XSCOM_ADDR_IND_FLAG) {
+		if (is_write)
+			return xscom_indirect_write(gcid, pcb_addr, *val);
+		return xscom_indirect_read(gcid, pcb_addr, val);
+	}
+	if (is_write)
+		return __xscom_write(gcid, pcb_addr & 0x7fffffff, *val);
+	return __xscom_read(gcid, pcb_addr & 0x7fffffff, val);
+}
+
+/*
+ * External API
+ */
+int xscom_read(uint32_t partid, uint64_t pcb_addr, uint64_t *val)
+{
+	uint32_t gcid;
+	int rc;
+
+	/* Handle part ID decoding */
+	rc = xscom_decode_partid(partid, &pcb_addr, &gcid);
+	if (rc == XSCOM_PART_CENTAUR)
+		return centaur_xscom_read(partid, pcb_addr, val);
+	if (rc)
+		return rc;
 
 	/* HW822317 requires us to do global locking */
 	lock(&xscom_lock);
 
-	/* Direct vs indirect access */
-	if (pcb_addr & XSCOM_ADDR_IND_FLAG)
-		rc = xscom_indirect_read(gcid, pcb_addr, val);
-	else
-		rc = __xscom_read(gcid, pcb_addr & 0x7fffffff, val);
+	rc = __xscom_access(gcid, pcb_addr, false, val);
 
 	/* Unlock it */
 	unlock(&xscom_lock);
@@ -375,27 +403,16 @@ int xscom_write(uint32_t partid, uint64_t pcb_addr, uint64_t val)
 	int rc;
 
 	/* Handle part ID decoding */
-	switch(partid >> 28) {
-	case 0: /* Normal processor chip */
-		gcid = partid;
-		break;
-	case 8: /* Centaur */
+	rc = xscom_decode_partid(partid, &pcb_addr, &gcid);
+	if (rc == XSCOM_PART_CENTAUR)
 		return centaur_xscom_write(partid, pcb_addr, val);
-	case 4: /* EX chiplet */
-		gcid = xscom_decode_chiplet(partid, &pcb_addr);
-		break;
-	default:
-		return OPAL_PARAMETER;
-	}
+	if (rc)
+		return rc;
 
 	/* HW822317 requires us to do global locking */
 	lock(&xscom_lock);
 
-	/* Direct vs indirect access */
-	if (pcb_addr & XSCOM_ADDR_IND_FLAG)
-		rc = xscom_indirect_write(gcid, pcb_addr, val);
-	else
-		rc = __xscom_write(gcid, pcb_addr & 0x7fffffff, val);
+	rc = __xscom_access(gcid, pcb_addr, true, &val);
 
 	/* Unlock it */
 	unlock(&xscom_lock);
@@ -403,6 +420,132 @@ int xscom_write(uint32_t partid, uint64_t pcb_addr, uint64_t val)
 }
 opal_call(OPAL_XSCOM_WRITE, xscom_write, 3);
 
+/*
+ * Batched access
+ *
+ * HW822317 rules out issuing XSCOMs from several threads at once, even
+ * to different chips, so a batch is simply run in order. What we save
+ * is the lock round trip and partid decoding per access (and, through
+ * OPAL_XSCOM_BATCH, the OPAL call per access). The lock is dropped every
+ * XSCOM_BATCH_RELAX accesses so a long batch can't starve other users,
+ * and around Centaur accesses which go through FSI and take it again.
+ */
+#define XSCOM_BATCH_RELAX	32
+
+/* Entries converted per round in OPAL_XSCOM_BATCH, bounded by stack use */
+#define XSCOM_BATCH_CHUNK	16
+
+static int64_t xscom_batch_one(struct xscom_op *op, bool *locked)
+{
+	bool is_write = op->op == XSCOM_OP_WRITE;
+	uint64_t pcb_addr = op->addr;
+	struct proc_chip *chip;
+	uint32_t gcid;
+	int64_t rc, first_rc = OPAL_SUCCESS;
+
+	if (op->op != XSCOM_OP_READ && !is_write)
+		return OPAL_PARAMETER;
+
+	if (op->partid == XSCOM_OP_ALL_CHIPS) {
+		if (!is_write)
+			return OPAL_PARAMETER;
+		if (!*locked) {
+			lock(&xscom_lock);
+			*locked = true;
+		}
+		/* Write every chip even if one fails, report the first error */
+		for_each_chip(chip) {
+			rc = __xscom_access(chip->id, pcb_addr, true, &op->val);
+			if (rc && first_rc == OPAL_SUCCESS)
+				first_rc = rc;
+		}
+		return first_rc;
+	}
+
+	rc = xscom_decode_partid(op->partid, &pcb_addr, &gcid);
+	if (rc == XSCOM_PART_CENTAUR) {
+		if (*locked) {
+			unlock(&xscom_lock);
+			*locked = false;
+		}
+		if (is_write)
+			return centaur_xscom_write(op->partid, pcb_addr,
+						   op->val);
+		return centaur_xscom_read(op->partid, pcb_addr, &op->val);
+	}
+	if (rc)
+		return rc;
+
+	if (!*locked) {
+		lock(&xscom_lock);
+		*locked = true;
+	}
+	return __xscom_access(gcid, pcb_addr, is_write, &op->val);
+}
+
+/*
+ * Run @count accesses. Every op gets its own status in ->rc, a failure
+ * doesn't stop the batch. Returns the first error, if any.
+ */
+int64_t xscom_batch(struct xscom_op *ops, unsigned int count)
+{
+	int64_t rc = OPAL_SUCCESS;
+	bool locked = false;
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		ops[i].rc = xscom_batch_one(&ops[i], &locked);
+		if (ops[i].rc && rc == OPAL_SUCCESS)
+			rc = ops[i].rc;
+
+		if (locked && (i % XSCOM_BATCH_RELAX) == XSCOM_BATCH_RELAX - 1) {
+			unlock(&xscom_lock);
+			locked = false;
+		}
+	}
+	if (locked)
+		unlock(&xscom_lock);
+
+	return rc;
+}
+
+static int64_t opal_xscom_batch(struct opal_xscom_batch_entry *entries,
+				uint64_t count)
+{
+	struct xscom_op ops[XSCOM_BATCH_CHUNK];
+	int64_t rc = OPAL_SUCCESS, chunk_rc;
+	unsigned int i, j, n;
+
+	if (!entries || !count || count > OPAL_XSCOM_BATCH_MAX)
+		return OPAL_PARAMETER;
+
+	for (i = 0; i < count; i += n) {
+		n = count - i;
+		if (n > ARRAY_SIZE(ops))
+			n = ARRAY_SIZE(ops);
+
+		for (j = 0; j < n; j++) {
+			ops[j].partid = be32_to_cpu(entries[i + j].partid);
+			ops[j].op = be32_to_cpu(entries[i + j].op);
+			ops[j].addr = be64_to_cpu(entries[i + j].addr);
+			ops[j].val = be64_to_cpu(entries[i + j].value);
+		}
+
+		chunk_rc = xscom_batch(ops, n);
+		if (chunk_rc && rc == OPAL_SUCCESS)
+			rc = chunk_rc;
+
+		for (j = 0; j < n; j++) {
+			if (ops[j].op == XSCOM_OP_READ)
+				entries[i + j].value = cpu_to_be64(ops[j].val);
+			entries[i + j].rc = cpu_to_be64(ops[j].rc);
+		}
+	}
+
+	return rc;
+}
+opal_call(OPAL_XSCOM_BATCH, opal_xscom_batch, 2);
+
 int xscom_readme(uint64_t pcb_addr, uint64_t *val)
 {
 	return xscom_read(this_cpu()->chip_id, pcb_addr, val);
@@ -0,0 +1,46 @@
+/* Copyright 2016 IBM Corp.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef __BOOT_TIMELINE_H
+#define __BOOT_TIMELINE_H
+
+#include <boot_timeline_types.h>
+
+#define BOOT_TIMELINE_MAX_ENTRIES	2048
+
+/*
+ * Record a boot timeline entry on the current CPU. Returns a handle for
+ * boot_timeline_end(), or -1 if nothing was recorded (buffer full or
+ * boot_timeline_finish() already called).
+ */
+extern int boot_timeline_start(const char *name, u8 type);
+extern void boot_timeline_end(int handle);
+
+/* Entries started after this are on the synchronised timebase */
+extern void boot_timeline_tb_synced(void);
+
+/* Stop recording and export the timeline in the device-tree */
+extern void boot_timeline_finish(void);
+
+/* Run and record one init stage, named after the call */
+#define boot_stage(call)					\
+	do {							\
+		int __bt = boot_timeline_start(#call,		\
+					BOOT_TIMELINE_STAGE);	\
+		call;						\
+		boot_timeline_end(__bt);			\
+	} while (0)
+
+#endif /* __BOOT_TIMELINE_H */
@@ -0,0 +1,55 @@
+/* Copyright 2016 IBM Corp.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/* Boot timeline as exported to the OS, see doc/boot-timeline.txt */
+#ifndef __BOOT_TIMELINE_TYPES_H
+#define __BOOT_TIMELINE_TYPES_H
+
+#include <types.h>
+
+#define BOOT_TIMELINE_MAGIC	0x42544c4e	/* "BTLN" */
+#define BOOT_TIMELINE_VERSION	1
+#define BOOT_TIMELINE_NAME_LEN	40
+
+/* Entry types */
+#define BOOT_TIMELINE_STAGE	1	/* Init stage on the boot CPU */
+#define BOOT_TIMELINE_JOB	2	/* cpu_job run by some thread */
+
+/* Entry flags */
+#define BOOT_TIMELINE_UNSYNCED	0x01	/* Started before TB sync */
+
+struct boot_timeline_entry {
+	__be64	start;			/* Timebase */
+	__be64	end;			/* Timebase, 0 if it never ended */
+	__be16	pir;
+	u8	type;
+	u8	flags;
+	__be32	reserved;
+	char	name[BOOT_TIMELINE_NAME_LEN];
+};
+
+struct boot_timeline {
+	__be32	magic;
+	__be16	version;
+	__be16	entry_size;
+	__be32	max_entries;
+	__be32	nr_entries;
+	__be32	dropped;		/* Entries that didn't fit */
+	__be32	reserved;
+	__be64	tb_hz;
+	struct boot_timeline_entry entries[];
+};
+
+#endif /* __BOOT_TIMELINE_TYPES_H */
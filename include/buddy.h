@@ -0,0 +1,56 @@
+/* Copyright 2016 IBM Corp.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __BUDDY_H
+#define __BUDDY_H
+
+#include <ccan/list/list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <compiler.h>
+
+#define BUDDY_MAX_ORDERS	32
+
+/*
+ * Binary buddy allocator over a naturally aligned block of
+ * (1 << max_order) bytes. Every allocation is a naturally aligned
+ * power of two, so large aligned tables cost no alignment padding,
+ * and freed blocks coalesce back with their buddy. The free lists
+ * are threaded through the free blocks themselves. Callers provide
+ * the locking.
+ */
+struct buddy {
+	unsigned long base;
+	unsigned int min_order;
+	unsigned int max_order;
+	size_t free_bytes;
+	struct list_head free_list[BUDDY_MAX_ORDERS];
+	/* One byte per min_order block, see buddy.c */
+	uint8_t map[];
+};
+
+struct buddy *buddy_create(void *base, unsigned int max_order,
+			   unsigned int min_order) __warn_unused_result;
+void buddy_destroy(struct buddy *b);
+void *buddy_alloc(struct buddy *b, unsigned int order) __warn_unused_result;
+void buddy_free(struct buddy *b, void *ptr);
+bool buddy_contains(const struct buddy *b, const void *ptr);
+
+/* Smallest order whose block holds size bytes */
+unsigned int buddy_order(size_t size);
+
+#endif /* __BUDDY_H */
@@ -172,6 +172,9 @@ struct proc_chip {
 
 	/* Used by hw/fsi-master.c */
 	struct mfsi		*fsi_masters;
+
+	/* Used by core/hmi.c */
+	struct lock		hmi_lock;
 };
 
 extern uint32_t pir_to_chip_id(uint32_t pir);
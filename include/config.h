@@ -72,6 +72,11 @@
  */
 //#define FORCE_DUMMY_CONSOLE 1
 
+/* Enable this to run all the init stages in main_cpu_entry() one after
+ * the other on the boot CPU, rather than handing some to secondaries
+ */
+//#define INIT_STAGES_SERIAL	1
+
 /* Enable this to do fast resets. Currently unreliable... */
 //#define ENABLE_FAST_RESET	1
 
@@ -70,6 +70,7 @@ extern void enable_mambo_console(void);
 
 ssize_t console_write(bool flush_to_drivers, const void *buf, size_t count);
 
+extern void init_console_stages(void);
 extern void clear_console(void);
 extern void memcons_add_properties(void);
 extern void dummy_console_add_nodes(void);
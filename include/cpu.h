@@ -41,6 +41,8 @@ enum cpu_thread_state {
 };
 
 struct cpu_job;
+struct con_stage;
+struct opal_msg_entry;
 
 struct cpu_thread {
 	uint32_t			pir;
@@ -57,6 +59,10 @@ struct cpu_thread {
 	uint32_t			lock_depth;
 	uint32_t			con_suspend;
 	bool				con_need_flush;
+	bool				con_staging;
+	struct con_stage		*con_stage;
+	struct opal_msg_entry		*msg_cache;
+	uint32_t			msg_cache_len;
 	bool				in_mcount;
 	bool				in_poller;
 	uint32_t			hbrt_spec_wakeup; /* primary only */
@@ -83,6 +89,15 @@ struct cpu_thread {
 	 */
 	uint32_t			core_hmi_state; /* primary only */
 	uint32_t			*core_hmi_state_ptr;
+	/*
+	 * Serializes TFMR checks and recovery between the threads of
+	 * a core. Primary only, secondaries use primary->hmi_lock.
+	 */
+	struct lock			hmi_lock;
+	/* HMI handling latency stats for this thread, in timebase ticks */
+	uint64_t			hmi_count;
+	uint64_t			hmi_tb_total;
+	uint64_t			hmi_tb_max;
 	/* Mask to indicate thread id in core. */
 	uint8_t				thread_mask;
 	bool				tb_invalid;
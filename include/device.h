@@ -61,6 +61,9 @@ struct dt_node *dt_new_root(const char *name);
 /* Graft a root node into this tree. */
 bool dt_attach_root(struct dt_node *parent, struct dt_node *root);
 
+/* Move all children of a node under another one, keeping their order. */
+bool dt_move_children(struct dt_node *from, struct dt_node *to);
+
 /* Add a child node. */
 struct dt_node *dt_new(struct dt_node *parent, const char *name);
 struct dt_node *dt_new_addr(struct dt_node *parent, const char *name,
@@ -162,7 +162,9 @@
 #define OPAL_LEDS_GET_INDICATOR			114
 #define OPAL_LEDS_SET_INDICATOR			115
 #define OPAL_CEC_REBOOT2			116
-#define OPAL_LAST				116
+#define OPAL_XSCOM_BATCH			117
+#define OPAL_PCI_SET_PE_BATCH			118
+#define OPAL_LAST				118
 
 /* Device tree flags */
 
@@ -429,6 +431,56 @@ struct opal_msg {
 	__be64 params[8];
 };
 
+/*
+ * Shared memory ring of OPAL messages, located by the ibm,opal-msg-ring
+ * property. OPAL only posts to it once the host sets
+ * OPAL_MSG_RING_HOST_ACTIVE in flags; otherwise, or when the ring is
+ * full, messages are queued for OPAL_GET_MSG as before.
+ */
+#define OPAL_MSG_RING_MAGIC		0x4f4d5347	/* "OMSG" */
+#define OPAL_MSG_RING_HOST_ACTIVE	0x1
+
+struct opal_msg_ring {
+	__be32 magic;
+	__be32 flags;		/* Written by the host */
+	__be32 nr_entries;	/* Power of two */
+	__be32 entry_size;
+	__be64 head;		/* Next entry OPAL writes */
+	__be64 tail;		/* Next entry the host reads, written by the host */
+	__be64 full_count;	/* Messages diverted to OPAL_GET_MSG, ring full */
+	__be64 overflow_count;	/* Messages queued beyond the preallocated pool */
+	__be64 reserved[2];
+	struct opal_msg msgs[];
+};
+
+/*
+ * Async completion slots, advertised in "ibm,opal-async-comp". Once the
+ * host sets OPAL_ASYNC_COMP_HOST_ACTIVE, the OPAL_MSG_ASYNC_COMP message
+ * for token N is written to slots[N] (if N < nr_slots and the slot is
+ * empty) instead of being queued, and state is set to COMPLETE after
+ * the message. The host consumes it by setting state back to EMPTY.
+ */
+#define OPAL_ASYNC_COMP_MAGIC		0x4f415359	/* "OASY" */
+#define OPAL_ASYNC_COMP_HOST_ACTIVE	0x1
+
+#define OPAL_ASYNC_SLOT_EMPTY		0
+#define OPAL_ASYNC_SLOT_COMPLETE	1
+
+struct opal_async_comp_slot {
+	__be64 state;
+	struct opal_msg msg;
+};
+
+struct opal_async_comp_table {
+	__be32 magic;
+	__be32 flags;		/* Written by the host */
+	__be32 nr_slots;
+	__be32 reserved;
+	__be64 overflow_count;	/* Completions queued as messages instead */
+	__be64 reserved2;
+	struct opal_async_comp_slot slots[];
+};
+
 /* System parameter permission */
 enum OpalSysparamPerm {
 	OPAL_SYSPARAM_READ  = 0x1,
@@ -892,6 +944,7 @@ struct opal_prd_msg {
 #define OCC_RESET			0
 #define OCC_LOAD			1
 #define OCC_THROTTLE			2
+#define OCC_THROTTLE_ALL		3
 #define OCC_MAX_THROTTLE_STATUS		5
 /*
  * struct opal_occ_msg:
@@ -913,6 +966,30 @@ struct opal_occ_msg {
 	__be64 throttle_status;
 };
 
+/*
+ * Throttle status of every chip, in memory shared with the host and
+ * advertised by the ibm,occ-throttle-vector property. Once the host sets
+ * OCC_THROTTLE_VECTOR_HOST_ACTIVE, OPAL updates the vector and bumps
+ * generation on change, and sends a single OCC_THROTTLE_ALL message
+ * instead of one OCC_THROTTLE message per chip.
+ */
+#define OCC_THROTTLE_VECTOR_MAGIC	0x4f544852	/* "OTHR" */
+#define OCC_THROTTLE_VECTOR_HOST_ACTIVE	0x1
+
+struct opal_occ_throttle_entry {
+	__be32 chip;
+	uint8_t throttle_status;
+	uint8_t reserved[3];
+};
+
+struct opal_occ_throttle_vector {
+	__be32 magic;
+	__be32 flags;		/* Written by the host */
+	__be32 generation;
+	__be32 nr_chips;
+	struct opal_occ_throttle_entry chips[];
+};
+
 /*
  * SG entries
  *
@@ -973,6 +1050,47 @@ struct opal_i2c_request {
 	__be64 buffer_ra;		/* Buffer real address */
 };
 
+/* OPAL_XSCOM_BATCH entry */
+struct opal_xscom_batch_entry {
+	__be32 partid;			/* As for OPAL_XSCOM_READ/WRITE */
+#define OPAL_XSCOM_BATCH_ALL_CHIPS	0xffffffff	/* Writes only */
+	__be32 op;
+#define OPAL_XSCOM_BATCH_READ	0
+#define OPAL_XSCOM_BATCH_WRITE	1
+	__be64 addr;
+	__be64 value;			/* In for writes, out for reads */
+	__be64 rc;			/* Out, per entry status */
+};
+#define OPAL_XSCOM_BATCH_MAX	1024
+
+/* OPAL_PCI_SET_PE_BATCH entry, the fields are as for the single calls */
+struct opal_pci_pe_config {
+	__be32 flags;
+#define OPAL_PCI_PE_CONFIG_RID		0x01	/* OPAL_PCI_SET_PE */
+#define OPAL_PCI_PE_CONFIG_PELTV	0x02	/* OPAL_PCI_SET_PELTV */
+#define OPAL_PCI_PE_CONFIG_MVE		0x04	/* OPAL_PCI_SET_MVE + enable */
+#define OPAL_PCI_PE_CONFIG_DMA		0x08	/* OPAL_PCI_MAP_PE_DMA_WINDOW */
+#define OPAL_PCI_PE_CONFIG_DMA_REAL	0x10	/* ..._DMA_WINDOW_REAL */
+	__be32 pe_number;
+	__be64 bus_dev_func;
+	uint8_t bus_compare;
+	uint8_t dev_compare;
+	uint8_t func_compare;
+	uint8_t pe_action;
+	uint8_t peltv_state;		/* pe_number in parent_pe's domain */
+	uint8_t reserved[3];
+	__be32 parent_pe;
+	__be32 mve_number;
+	__be16 window_id;
+	__be16 tce_levels;
+	__be32 reserved2;
+	__be64 dma_addr;		/* TCE table or PCI start address */
+	__be64 dma_size;		/* TCE table or window size */
+	__be64 tce_page_size;
+	__be64 rc;			/* Out, per entry status */
+};
+#define OPAL_PCI_PE_CONFIG_MAX	1024
+
 /* Argument to OPAL_CEC_REBOOT2() */
 enum {
 	OPAL_REBOOT_NORMAL = 0,
@@ -229,6 +229,26 @@ struct pci_lsi_state {
 
 struct phb;
 
+/* One entry of a PE configuration batch, OPAL_PCI_PE_CONFIG_* flags */
+struct pci_pe_config {
+	uint32_t	flags;
+	uint32_t	pe_number;
+	uint64_t	bus_dev_func;
+	uint8_t		bus_compare;
+	uint8_t		dev_compare;
+	uint8_t		func_compare;
+	uint8_t		pe_action;
+	uint8_t		peltv_state;
+	uint32_t	parent_pe;
+	uint32_t	mve_number;
+	uint16_t	window_id;
+	uint16_t	tce_levels;
+	uint64_t	dma_addr;
+	uint64_t	dma_size;
+	uint64_t	tce_page_size;
+	int64_t		rc;
+};
+
 struct phb_ops {
 	/*
 	 * Locking. This is called around OPAL accesses
@@ -357,6 +377,15 @@ struct phb_ops {
 
 	int64_t (*papr_errinjct_reset)(struct phb *phb);
 
+	/*
+	 * Optional, runs a list of PE configurations (see
+	 * OPAL_PCI_SET_PE_BATCH) with a status in each entry and returns
+	 * the first error. Entries whose rc is already set are skipped.
+	 * Without it, the individual methods are used.
+	 */
+	int64_t (*set_pe_batch)(struct phb *phb, struct pci_pe_config *cfg,
+				unsigned int count);
+
 	/*
 	 * P5IOC2 only
 	 */
@@ -368,6 +397,12 @@ struct phb_ops {
 	 */
 	int64_t (*pci_msi_eoi)(struct phb *phb, uint32_t hwirq);
 
+	/*
+	 * Optional, same as pci_msi_eoi but called without the PHB lock
+	 * by backends whose EOI doesn't touch anything the lock protects
+	 */
+	int64_t (*pci_msi_eoi_nolock)(struct phb *phb, uint32_t hwirq);
+
 	/*
 	 * Slot control
 	 */
@@ -304,6 +304,8 @@ struct phb3 {
 	uint8_t			peltv_cache[PELTV_TABLE_SIZE];
 	uint64_t		lxive_cache[8];
 	uint64_t		ive_cache[IVT_TABLE_ENTRIES];
+	uint8_t			ive_gen[IVT_TABLE_ENTRIES]; /* IVE gen counts */
+	struct lock		eoi_lock;	/* EOIs vs IVT/PHB resets */
 	uint64_t		tve_cache[512];
 	uint64_t		m32d_cache[256];
 	uint64_t		m64b_cache[16];
@@ -311,6 +313,15 @@ struct phb3 {
 	bool			err_pending;
 	struct phb3_err		err;
 
+	/*
+	 * MSI EOI statistics, printed by phb3_ioda_reset(). The Q check
+	 * also runs from phb3_msi_set_xive() without the EOI lock, so
+	 * these are only approximate.
+	 */
+	uint64_t		msi_eoi_count;
+	uint64_t		msi_q_flush;	/* Q clear, flushed with a load */
+	uint64_t		msi_q_resend;	/* Q set, resent through FFI */
+
 	struct phb		phb;
 };
 
@@ -175,6 +175,9 @@ extern void start_kernel_secondary(uint64_t entry) __noreturn;
 
 /* Get description of machine from HDAT and create device-tree */
 extern void parse_hdat(bool is_opal, uint32_t master_cpu);
+/* FRU VPD left out by parse_hdat(): parse it on any CPU, then attach it */
+extern void parse_hdat_fru_vpd(void);
+extern void attach_hdat_fru_vpd(void);
 
 /* Root of device tree. */
 extern struct dt_node *dt_root;
@@ -207,6 +210,7 @@ extern void uart_init(bool enable_interrupt);
 extern void homer_init(void);
 extern void occ_pstates_init(void);
 extern void slw_init(void);
+extern void slw_init_timer(void);
 extern void add_cpu_idle_state_properties(void);
 extern void occ_fsp_init(void);
 extern void lpc_rtc_init(void);
@@ -224,6 +228,7 @@ extern void flash_release(void);
 /* NVRAM support */
 extern void nvram_init(void);
 extern void nvram_read_complete(bool success);
+extern void nvram_flush(void);
 
 /* UART stuff */
 extern void uart_setup_linux_passthrough(void);
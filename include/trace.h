@@ -18,6 +18,7 @@
 #define __TRACE_H
 #include <ccan/short_types/short_types.h>
 #include <stddef.h>
+#include <stdarg.h>
 #include <lock.h>
 #include <trace_types.h>
 
@@ -41,6 +42,12 @@ void init_trace_buffers(void);
 /* This will fill in timestamp and cpu; you must do type and len. */
 void trace_add(union trace *trace, u8 type, u16 len);
 
+/*
+ * Log a message as a TRACE_PRLOG record instead of formatting it.
+ * Returns false if it can't be (ap is consumed either way).
+ */
+bool trace_prlog(int log_level, const char *fmt, va_list ap);
+
 /* Put trace node into dt. */
 void trace_add_node(void);
 #endif /* __TRACE_H */
@@ -25,6 +25,7 @@
 #define TRACE_FSP_MSG	4	/* FSP message sent/received */
 #define TRACE_FSP_EVENT	5	/* FSP driver event */
 #define TRACE_UART	6	/* UART driver traces */
+#define TRACE_PRLOG	7	/* Unformatted prlog() message */
 
 /* One per cpu, plus one for NMIs */
 struct tracebuf {
@@ -120,6 +121,26 @@ struct trace_uart {
 	__be16 in_count;
 };
 
+/*
+ * A prlog() message that only went to the in memory console, stored
+ * unformatted. fmt is the offset of the format string from the start
+ * of the skiboot .rodata section. data holds one big endian u64 per
+ * conversion in fmt, as vsnprintf() would have fetched it. For %s the
+ * value is the .rodata offset of the string, or TRACE_PRLOG_INLINE
+ * ORed with its length, in which case the string follows, padded to
+ * 8 bytes.
+ */
+#define TRACE_PRLOG_INLINE	0x8000000000000000ull
+#define TRACE_PRLOG_DATA	96
+
+struct trace_prlog {
+	struct trace_hdr hdr;
+	__be32 fmt;
+	u8 level;
+	u8 unused[3];
+	u8 data[TRACE_PRLOG_DATA]; /* See hdr.len_div_8 */
+};
+
 union trace {
 	struct trace_hdr hdr;
 	/* Trace types go here... */
@@ -129,6 +150,7 @@ union trace {
 	struct trace_fsp_msg fsp_msg;
 	struct trace_fsp_event fsp_evt;
 	struct trace_uart uart;
+	struct trace_prlog prlog;
 };
 
 #endif /* __TRACE_TYPES_H */
@@ -177,6 +177,20 @@
 extern int xscom_read(uint32_t partid, uint64_t pcb_addr, uint64_t *val);
 extern int xscom_write(uint32_t partid, uint64_t pcb_addr, uint64_t val);
 
+/* Batched SCOM access, see xscom_batch() */
+struct xscom_op {
+	uint32_t	partid;		/* XSCOM_OP_ALL_CHIPS: write every chip */
+	uint32_t	op;
+	uint64_t	addr;
+	uint64_t	val;
+	int64_t		rc;
+};
+#define XSCOM_OP_READ		0
+#define XSCOM_OP_WRITE		1
+#define XSCOM_OP_ALL_CHIPS	0xffffffff
+
+extern int64_t xscom_batch(struct xscom_op *ops, unsigned int count);
+
 /* This chip SCOM access */
 extern int xscom_readme(uint64_t pcb_addr, uint64_t *val);
 extern int xscom_writeme(uint64_t pcb_addr, uint64_t val);
@@ -58,6 +58,16 @@ static int ecc_protected(struct blocklevel_device *bl, uint32_t pos, uint32_t le
 	return 0;
 }
 
+static void blocklevel_notify(struct blocklevel_device *bl, uint32_t pos, uint32_t len)
+{
+	struct blocklevel_notifier *n;
+
+	for (n = bl->notifiers; n; n = n->next) {
+		if (pos < n->start + n->len && n->start < pos + len)
+			n->invalidate(n);
+	}
+}
+
 int blocklevel_read(struct blocklevel_device *bl, uint32_t pos, void *buf, uint32_t len)
 {
 	int rc;
@@ -105,7 +115,9 @@ int blocklevel_write(struct blocklevel_device *bl, uint32_t pos, const void *buf
 	}
 
 	if (!ecc_protected(bl, pos, len)) {
-		return bl->write(bl, pos, buf, len);
+		rc = bl->write(bl, pos, buf, len);
+		blocklevel_notify(bl, pos, len);
+		return rc;
 	}
 
 	buffer = malloc(ecc_len);
@@ -120,6 +132,7 @@ int blocklevel_write(struct blocklevel_device *bl, uint32_t pos, const void *buf
 		goto out;
 	}
 	rc = bl->write(bl, pos, buffer, ecc_len);
+	blocklevel_notify(bl, pos, ecc_len);
 out:
 	free(buffer);
 	return rc;
@@ -127,6 +140,8 @@ out:
 
 int blocklevel_erase(struct blocklevel_device *bl, uint32_t pos, uint32_t len)
 {
+	int rc;
+
 	if (!bl || !bl->erase) {
 		errno = EINVAL;
 		return FLASH_ERR_PARM_ERROR;
@@ -139,7 +154,10 @@ int blocklevel_erase(struct blocklevel_device *bl, uint32_t pos, uint32_t len)
 		return FLASH_ERR_ERASE_BOUNDARY;
 	}
 
-	return bl->erase(bl, pos, len);
+	rc = bl->erase(bl, pos, len);
+	blocklevel_notify(bl, pos, len);
+
+	return rc;
 }
 
 int blocklevel_get_info(struct blocklevel_device *bl, const char **name, uint32_t *total_size,
@@ -195,6 +213,7 @@ int blocklevel_smart_write(struct blocklevel_device *bl, uint32_t pos, const voi
 	uint32_t erase_size;
 	const void *write_buf = buf;
 	void *write_buf_start = NULL;
+	uint32_t notify_pos = 0, notify_len = 0;
 	void *erase_buf;
 	int rc = 0;
 
@@ -234,6 +253,9 @@ int blocklevel_smart_write(struct blocklevel_device *bl, uint32_t pos, const voi
 		goto out;
 	}
 
+	notify_pos = pos;
+	notify_len = len;
+
 	while (len > 0) {
 		uint32_t erase_block = pos & ~(erase_size - 1);
 		uint32_t block_offset = pos & (erase_size - 1);
@@ -264,6 +286,8 @@ int blocklevel_smart_write(struct blocklevel_device *bl, uint32_t pos, const voi
 	}
 
 out:
+	if (notify_len)
+		blocklevel_notify(bl, notify_pos, notify_len);
 	free(write_buf_start);
 	free(erase_buf);
 	return rc;
@@ -335,3 +359,21 @@ int blocklevel_ecc_protect(struct blocklevel_device *bl, uint32_t start, uint32_
 		return -1;
 	return insert_bl_prot_range(&bl->ecc_prot, range);
 }
+
+void blocklevel_add_notifier(struct blocklevel_device *bl, struct blocklevel_notifier *n)
+{
+	n->next = bl->notifiers;
+	bl->notifiers = n;
+}
+
+void blocklevel_remove_notifier(struct blocklevel_device *bl, struct blocklevel_notifier *n)
+{
+	struct blocklevel_notifier **p;
+
+	for (p = &bl->notifiers; *p; p = &(*p)->next) {
+		if (*p == n) {
+			*p = n->next;
+			break;
+		}
+	}
+}
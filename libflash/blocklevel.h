@@ -33,6 +33,18 @@ enum blocklevel_flags {
 	WRITE_NEED_ERASE = 1,
 };
 
+/*
+ * Called after a write or erase through the blocklevel API touched
+ * [start, start + len), so that users caching flash content (eg. the
+ * libffs partition table) know their copy may be stale.
+ */
+struct blocklevel_notifier {
+	uint32_t start;
+	uint32_t len;
+	void (*invalidate)(struct blocklevel_notifier *n);
+	struct blocklevel_notifier *next;
+};
+
 /*
  * libffs may be used with different backends, all should provide these for
  * libflash to get the information it needs
@@ -52,6 +64,8 @@ struct blocklevel_device {
 	enum blocklevel_flags flags;
 
 	struct blocklevel_range ecc_prot;
+
+	struct blocklevel_notifier *notifiers;
 };
 
 int blocklevel_read(struct blocklevel_device *bl, uint32_t pos, void *buf, uint32_t len);
@@ -66,4 +80,7 @@ int blocklevel_smart_write(struct blocklevel_device *bl, uint32_t pos, const voi
 /* Implemented in software at this level */
 int blocklevel_ecc_protect(struct blocklevel_device *bl, uint32_t start, uint32_t len);
 
+void blocklevel_add_notifier(struct blocklevel_device *bl, struct blocklevel_notifier *n);
+void blocklevel_remove_notifier(struct blocklevel_device *bl, struct blocklevel_notifier *n);
+
 #endif /* __LIBFLASH_BLOCKLEVEL_H */
@@ -25,6 +25,7 @@
 #endif
 
 #include <ccan/endian/endian.h>
+#include <ccan/container_of/container_of.h>
 
 #include "libffs.h"
 
@@ -33,6 +34,12 @@ enum ffs_type {
 	ffs_type_image,
 };
 
+/* A partition entry converted to host endian */
+struct ffs_part {
+	struct ffs_entry	ent;
+	bool			valid;
+};
+
 struct ffs_handle {
 	struct ffs_hdr		hdr;	/* Converted header */
 	enum ffs_type		type;
@@ -42,6 +49,15 @@ struct ffs_handle {
 	void			*cache;
 	uint32_t		cached_size;
 	struct blocklevel_device *bl;
+
+	/* Converted entries and a name -> index hash over them */
+	struct ffs_part		*parts;
+	uint32_t		*hash;
+	uint32_t		hash_size;
+
+	/* Set when the TOC on flash was written after we cached it */
+	struct blocklevel_notifier notifier;
+	bool			stale;
 };
 
 static uint32_t ffs_checksum(void* data, size_t size)
@@ -72,10 +88,155 @@ static int ffs_check_convert_header(struct ffs_hdr *dst, struct ffs_hdr *src)
 	return 0;
 }
 
+static int ffs_check_convert_entry(struct ffs_entry *dst, struct ffs_entry *src);
+
+static uint32_t ffs_name_hash(const char *name)
+{
+	uint32_t i, hash = 5381;
+
+	for (i = 0; i < PART_NAME_MAX + 1 && name[i]; i++)
+		hash = hash * 33 + name[i];
+
+	return hash;
+}
+
+static void ffs_free_parts(struct ffs_handle *ffs)
+{
+	free(ffs->parts);
+	free(ffs->hash);
+	ffs->parts = NULL;
+	ffs->hash = NULL;
+	ffs->hash_size = 0;
+}
+
+/*
+ * Convert every entry of the cached partition map to host endian once, and
+ * hash them by name so that lookups don't have to walk (and re-checksum)
+ * the whole map.
+ */
+static int ffs_load_parts(struct ffs_handle *ffs)
+{
+	uint32_t i, slot, size = 8;
+	struct ffs_part *part;
+
+	ffs_free_parts(ffs);
+
+	while (size < ffs->hdr.entry_count * 2)
+		size <<= 1;
+
+	ffs->parts = malloc(ffs->hdr.entry_count * sizeof(*ffs->parts));
+	ffs->hash = malloc(size * sizeof(*ffs->hash));
+	/* An empty map is fine, malloc(0) may then give us NULL */
+	if ((ffs->hdr.entry_count && !ffs->parts) || !ffs->hash) {
+		ffs_free_parts(ffs);
+		return FLASH_ERR_MALLOC_FAILED;
+	}
+	if (ffs->parts)
+		memset(ffs->parts, 0,
+		       ffs->hdr.entry_count * sizeof(*ffs->parts));
+	memset(ffs->hash, 0, size * sizeof(*ffs->hash));
+	ffs->hash_size = size;
+
+	for (i = 0; i < ffs->hdr.entry_count; i++) {
+		struct ffs_entry *src = ffs->cache + FFS_HDR_SIZE +
+					i * ffs->hdr.entry_size;
+
+		part = &ffs->parts[i];
+		if (ffs_check_convert_entry(&part->ent, src))
+			continue;
+		part->valid = true;
+
+		/* The first entry with a given name wins, as it always has */
+		slot = ffs_name_hash(part->ent.name) & (size - 1);
+		while (ffs->hash[slot]) {
+			struct ffs_entry *ent = &ffs->parts[ffs->hash[slot] - 1].ent;
+
+			if (!strncmp(ent->name, part->ent.name, sizeof(ent->name)))
+				break;
+			slot = (slot + 1) & (size - 1);
+		}
+		if (!ffs->hash[slot])
+			ffs->hash[slot] = i + 1;
+	}
+
+	return 0;
+}
+
+/* Read (or re-read) the header and partition map from flash */
+static int ffs_read_toc(struct ffs_handle *f)
+{
+	struct ffs_hdr hdr;
+	int rc;
+
+	/* Read flash header */
+	rc = blocklevel_read(f->bl, f->toc_offset, &hdr, sizeof(hdr));
+	if (rc) {
+		FL_ERR("FFS: Error %d reading flash header\n", rc);
+		return rc;
+	}
+
+	/* Convert and check flash header */
+	rc = ffs_check_convert_header(&f->hdr, &hdr);
+	if (rc) {
+		FL_ERR("FFS: Error %d checking flash header\n", rc);
+		return rc;
+	}
+
+	/*
+	 * Decide how much of the image to grab to get the whole
+	 * partition map.
+	 */
+	f->cached_size = f->hdr.block_size * f->hdr.size;
+	FL_DBG("FFS: Partition map size: 0x%x\n", f->cached_size);
+
+	/* Allocate cache */
+	free(f->cache);
+	f->cache = malloc(f->cached_size);
+	if (!f->cache)
+		return FLASH_ERR_MALLOC_FAILED;
+
+	/* Read the cached map */
+	rc = blocklevel_read(f->bl, f->toc_offset, f->cache, f->cached_size);
+	if (rc) {
+		FL_ERR("FFS: Error %d reading flash partition map\n", rc);
+		return rc;
+	}
+
+	rc = ffs_load_parts(f);
+	if (rc)
+		return rc;
+
+	f->stale = false;
+
+	return 0;
+}
+
+static void ffs_invalidate(struct blocklevel_notifier *n)
+{
+	struct ffs_handle *f = container_of(n, struct ffs_handle, notifier);
+
+	f->stale = true;
+}
+
+/* Pick up any changes made to the partition map since we cached it */
+static int ffs_revalidate(struct ffs_handle *ffs)
+{
+	int rc;
+
+	if (!ffs->stale)
+		return 0;
+
+	FL_DBG("FFS: Partition map changed, re-reading\n");
+	rc = ffs_read_toc(ffs);
+	if (rc)
+		FL_ERR("FFS: Error %d re-reading partition map\n", rc);
+
+	return rc;
+}
+
 int ffs_init(uint32_t offset, uint32_t max_size, struct blocklevel_device *bl,
 		struct ffs_handle **ffs, int mark_ecc)
 {
-	struct ffs_hdr hdr;
 	struct ffs_handle *f;
 	uint32_t total_size;
 	int rc, i;
@@ -95,13 +256,6 @@ int ffs_init(uint32_t offset, uint32_t max_size, struct blocklevel_device *bl,
 	if ((max_size > total_size))
 		return FLASH_ERR_PARM_ERROR;
 
-	/* Read flash header */
-	rc = blocklevel_read(bl, offset, &hdr, sizeof(hdr));
-	if (rc) {
-		FL_ERR("FFS: Error %d reading flash header\n", rc);
-		return rc;
-	}
-
 	/* Allocate ffs_handle structure and start populating */
 	f = malloc(sizeof(*f));
 	if (!f)
@@ -112,33 +266,9 @@ int ffs_init(uint32_t offset, uint32_t max_size, struct blocklevel_device *bl,
 	f->max_size = max_size;
 	f->bl = bl;
 
-	/* Convert and check flash header */
-	rc = ffs_check_convert_header(&f->hdr, &hdr);
-	if (rc) {
-		FL_ERR("FFS: Error %d checking flash header\n", rc);
-		goto out;
-	}
-
-	/*
-	 * Decide how much of the image to grab to get the whole
-	 * partition map.
-	 */
-	f->cached_size = f->hdr.block_size * f->hdr.size;
-	FL_DBG("FFS: Partition map size: 0x%x\n", f->cached_size);
-
-	/* Allocate cache */
-	f->cache = malloc(f->cached_size);
-	if (!f->cache) {
-		rc = FLASH_ERR_MALLOC_FAILED;
-		goto out;
-	}
-
-	/* Read the cached map */
-	rc = blocklevel_read(bl, offset, f->cache, f->cached_size);
-	if (rc) {
-		FL_ERR("FFS: Error %d reading flash partition map\n", rc);
+	rc = ffs_read_toc(f);
+	if (rc)
 		goto out;
-	}
 
 	if (mark_ecc) {
 		uint32_t start, total_size;
@@ -162,11 +292,20 @@ int ffs_init(uint32_t offset, uint32_t max_size, struct blocklevel_device *bl,
 		} /* for */
 	}
 
+	/* Find out about writes to the partition map behind our back */
+	f->notifier.start = offset;
+	f->notifier.len = f->cached_size;
+	f->notifier.invalidate = ffs_invalidate;
+	blocklevel_add_notifier(bl, &f->notifier);
+
 out:
-	if (rc == 0)
+	if (rc == 0) {
 		*ffs = f;
-	else
+	} else {
+		ffs_free_parts(f);
+		free(f->cache);
 		free(f);
+	}
 
 	return rc;
 }
@@ -240,10 +379,18 @@ int ffs_open_image(int fd, uint32_t size, uint32_t toc_offset,
 	rc = read(fd, f->cache, f->cached_size);
 	if (rc != f->cached_size) {
 		FL_ERR("FFS: Error %d reading flash partition map\n", rc);
+		free(f->cache);
 		free(f);
 		return FLASH_ERR_BAD_READ;
 	}
 
+	rc = ffs_load_parts(f);
+	if (rc) {
+		free(f->cache);
+		free(f);
+		return rc;
+	}
+
 	*ffsh = f;
 
 	return 0;
@@ -252,6 +399,9 @@ int ffs_open_image(int fd, uint32_t size, uint32_t toc_offset,
 
 void ffs_close(struct ffs_handle *ffs)
 {
+	if (ffs->bl)
+		blocklevel_remove_notifier(ffs->bl, &ffs->notifier);
+	ffs_free_parts(ffs);
 	if (ffs->cache)
 		free(ffs->cache);
 	free(ffs);
@@ -290,62 +440,63 @@ static int ffs_check_convert_entry(struct ffs_entry *dst, struct ffs_entry *src)
 int ffs_lookup_part(struct ffs_handle *ffs, const char *name,
 		    uint32_t *part_idx)
 {
-	struct ffs_entry ent;
-	uint32_t i;
+	uint32_t slot;
 	int rc;
 
+	rc = ffs_revalidate(ffs);
+	if (rc)
+		return rc;
+
 	/* Lookup the requested partition */
-	for (i = 0; i < ffs->hdr.entry_count; i++) {
-		struct ffs_entry *src_ent  = ffs_get_part(ffs, i, NULL);
-		rc = ffs_check_convert_entry(&ent, src_ent);
-		if (rc) {
-			FL_ERR("FFS: Bad entry %d in partition map\n", i);
-			continue;
+	slot = ffs_name_hash(name) & (ffs->hash_size - 1);
+	while (ffs->hash[slot]) {
+		struct ffs_entry *ent = &ffs->parts[ffs->hash[slot] - 1].ent;
+
+		if (!strncmp(name, ent->name, sizeof(ent->name))) {
+			if (part_idx)
+				*part_idx = ffs->hash[slot] - 1;
+			return 0;
 		}
-		if (!strncmp(name, ent.name, sizeof(ent.name)))
-			break;
+		slot = (slot + 1) & (ffs->hash_size - 1);
 	}
-	if (i >= ffs->hdr.entry_count)
-		return FFS_ERR_PART_NOT_FOUND;
-	if (part_idx)
-		*part_idx = i;
-	return 0;
+
+	return FFS_ERR_PART_NOT_FOUND;
 }
 
 int ffs_part_info(struct ffs_handle *ffs, uint32_t part_idx,
 		  char **name, uint32_t *start,
 		  uint32_t *total_size, uint32_t *act_size, bool *ecc)
 {
-	struct ffs_entry *raw_ent;
-	struct ffs_entry ent;
+	struct ffs_entry *ent;
 	char *n;
 	int rc;
 
-	if (part_idx >= ffs->hdr.entry_count)
-		return FFS_ERR_PART_NOT_FOUND;
+	rc = ffs_revalidate(ffs);
+	if (rc)
+		return rc;
 
-	raw_ent = ffs_get_part(ffs, part_idx, NULL);
-	if (!raw_ent)
+	if (part_idx >= ffs->hdr.entry_count)
 		return FFS_ERR_PART_NOT_FOUND;
 
-	rc = ffs_check_convert_entry(&ent, raw_ent);
-	if (rc) {
+	if (!ffs->parts[part_idx].valid) {
 		FL_ERR("FFS: Bad entry %d in partition map\n", part_idx);
-		return rc;
+		return FFS_ERR_BAD_CKSUM;
 	}
+	ent = &ffs->parts[part_idx].ent;
+
 	if (start)
-		*start = ent.base * ffs->hdr.block_size;
+		*start = ent->base * ffs->hdr.block_size;
 	if (total_size)
-		*total_size = ent.size * ffs->hdr.block_size;
+		*total_size = ent->size * ffs->hdr.block_size;
 	if (act_size)
-		*act_size = ent.actual;
+		*act_size = ent->actual;
 	if (ecc)
-		*ecc = ((ent.user.datainteg & FFS_ENRY_INTEG_ECC) != 0);
+		*ecc = ((ent->user.datainteg & FFS_ENRY_INTEG_ECC) != 0);
 
 	if (name) {
 		n = malloc(PART_NAME_MAX + 1);
 		memset(n, 0, PART_NAME_MAX + 1);
-		strncpy(n, ent.name, PART_NAME_MAX);
+		memcpy(n, ent->name, PART_NAME_MAX);
 		*name = n;
 	}
 	return 0;
@@ -356,6 +507,11 @@ int ffs_update_act_size(struct ffs_handle *ffs, uint32_t part_idx,
 {
 	struct ffs_entry *ent;
 	uint32_t offset;
+	int rc;
+
+	rc = ffs_revalidate(ffs);
+	if (rc)
+		return rc;
 
 	if (part_idx >= ffs->hdr.entry_count) {
 		FL_DBG("FFS: Entry out of bound\n");
@@ -381,9 +537,16 @@ int ffs_update_act_size(struct ffs_handle *ffs, uint32_t part_idx,
 	}
 	ent->actual = cpu_to_be32(act_size);
 	ent->checksum = ffs_checksum(ent, FFS_ENTRY_SIZE_CSUM);
+	ffs->parts[part_idx].ent.actual = act_size;
 	if (!ffs->chip)
 		return 0;
 
-	return blocklevel_write(ffs->bl, offset, ent, FFS_ENTRY_SIZE);
+	rc = blocklevel_write(ffs->bl, offset, ent, FFS_ENTRY_SIZE);
+
+	/* Our own write doesn't make the cached map stale */
+	if (rc == 0)
+		ffs->stale = false;
+
+	return rc;
 }
 
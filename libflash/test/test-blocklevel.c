@@ -27,6 +27,68 @@
 
 #define ERR(fmt...) fprintf(stderr, fmt)
 
+static int notified;
+
+static void test_invalidate(struct blocklevel_notifier *n __unused)
+{
+	notified++;
+}
+
+static int test_write(struct blocklevel_device *bl __unused, uint32_t pos __unused,
+		const void *buf __unused, uint32_t len __unused)
+{
+	return 0;
+}
+
+static int test_erase(struct blocklevel_device *bl __unused, uint32_t pos __unused,
+		uint32_t len __unused)
+{
+	return 0;
+}
+
+static int test_notifiers(void)
+{
+	struct blocklevel_device bl_mem = { 0 };
+	struct blocklevel_device *bl = &bl_mem;
+	struct blocklevel_notifier n = {
+		.start = 0x1000,
+		.len = 0x1000,
+		.invalidate = test_invalidate,
+	};
+	uint8_t buf[0x100] = { 0 };
+
+	bl->write = test_write;
+	bl->erase = test_erase;
+	blocklevel_add_notifier(bl, &n);
+
+	/* Outside the range, either side */
+	blocklevel_write(bl, 0, buf, 0x100);
+	blocklevel_write(bl, 0xf00, buf, 0x100);
+	blocklevel_write(bl, 0x2000, buf, 0x100);
+	if (notified) {
+		ERR("Notified for writes outside the range\n");
+		return 1;
+	}
+
+	/* Overlapping the start, and inside */
+	blocklevel_write(bl, 0xf80, buf, 0x100);
+	blocklevel_write(bl, 0x1800, buf, 0x100);
+	blocklevel_erase(bl, 0x1000, 0x1000);
+	if (notified != 3) {
+		ERR("Expected 3 notifications, got %d\n", notified);
+		return 1;
+	}
+
+	blocklevel_remove_notifier(bl, &n);
+	blocklevel_write(bl, 0x1000, buf, 0x100);
+	if (notified != 3 || bl->notifiers) {
+		ERR("Notified after removal\n");
+		return 1;
+	}
+
+	return 0;
+}
+
 int main(void)
 {
 	int i;
@@ -178,6 +240,8 @@ int main(void)
 		}
 	}
 
+	if (test_notifiers())
+		return 1;
 
 	return 0;
 }